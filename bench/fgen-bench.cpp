@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Microbenchmark of the generator which works on serialized ASTs. Parsing
+ * is done once up front, e.g. with
+ *
+ *     clang++ -x c++ -std=c++17 -emit-ast test/cpp/example.hpp -o example.ast
+ *
+ * so the measurements only contain the traversal of 'FGenVisitor' as well
+ * as 'FunctionGenerator::add()' and 'FunctionGenerator::dump()'.
+ *
+ * Usage: build/fgen-bench [-repetitions <N>] <file.ast> [<file.ast> ...]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <clang/Basic/DiagnosticOptions.h>
+#include <clang/Basic/FileSystemOptions.h>
+#include <clang/Frontend/ASTUnit.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Serialization/PCHContainerOperations.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <util/CommandLine.hpp>
+#include <util/File.hpp>
+
+#include <FGenConfiguration.hpp>
+#include <FGenVisitor.hpp>
+#include <FunctionGenerator.hpp>
+
+/* clang-format off */
+
+static llvm::cl::opt<unsigned int> Repetitions(
+    "repetitions",
+    llvm::cl::desc(
+        "Number of measured repetitions per benchmark."
+    ),
+    llvm::cl::value_desc("N"),
+    llvm::cl::init(20)
+);
+
+static llvm::cl::list<std::string> InputFiles(
+    llvm::cl::desc("<file.ast> ..."),
+    llvm::cl::Positional,
+    llvm::cl::OneOrMore
+);
+
+/* clang-format on */
+
+struct Sample {
+    double Ns;
+    uint64_t Cycles;
+};
+
+class Stopwatch {
+public:
+    void start()
+    {
+        Cycles_ = readCycles();
+        Start_ = std::chrono::steady_clock::now();
+    }
+
+    Sample stop() const
+    {
+        auto Duration = std::chrono::steady_clock::now() - Start_;
+        auto Cycles = readCycles() - Cycles_;
+
+        return {std::chrono::duration<double, std::nano>(Duration).count(),
+                Cycles};
+    }
+
+private:
+    static uint64_t readCycles()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+
+    std::chrono::steady_clock::time_point Start_;
+    uint64_t Cycles_;
+};
+
+static void report(llvm::StringRef Name,
+                   std::vector<Sample> &Samples,
+                   size_t NumDecls)
+{
+    const auto Less = [](const Sample &A, const Sample &B) {
+        return A.Ns < B.Ns;
+    };
+
+    std::sort(Samples.begin(), Samples.end(), Less);
+
+    auto Count = static_cast<double>(Samples.size());
+    auto Sum = 0.0;
+
+    for (const auto &Value : Samples)
+        Sum += Value.Ns;
+
+    auto Mean = Sum / Count;
+    auto Variance = 0.0;
+
+    for (const auto &Value : Samples)
+        Variance += (Value.Ns - Mean) * (Value.Ns - Mean);
+
+    auto StdDev = (Samples.size() > 1) ? std::sqrt(Variance / (Count - 1))
+                                       : 0.0;
+    auto &Median = Samples[Samples.size() / 2];
+
+    /* Cycles are taken from the median run to be robust to outliers */
+    auto CyclesPerDecl = (NumDecls) ? static_cast<double>(Median.Cycles) /
+                                          static_cast<double>(NumDecls)
+                                    : 0.0;
+
+    llvm::outs() << llvm::format("%-40s %12.1f %12.1f %12.1f %12.1f %12.1f\n",
+                                 Name.str().c_str(),
+                                 Mean / 1000.0,
+                                 Median.Ns / 1000.0,
+                                 StdDev / 1000.0,
+                                 Samples.front().Ns / 1000.0,
+                                 CyclesPerDecl);
+}
+
+static bool runBenchmark(const std::string &File)
+{
+    auto PCHContainerOps = std::make_shared<clang::PCHContainerOperations>();
+    auto Diagnostics = clang::CompilerInstance::createDiagnostics(
+        new clang::DiagnosticOptions());
+
+    auto Unit = clang::ASTUnit::LoadFromASTFile(
+        File,
+        PCHContainerOps->getRawReader(),
+        clang::ASTUnit::LoadEverything,
+        Diagnostics,
+        clang::FileSystemOptions());
+
+    if (!Unit) {
+        util::cl::error() << "fgen-bench: failed to load AST file \"" << File
+                          << "\"\n";
+        return false;
+    }
+
+    auto &Context = Unit->getASTContext();
+    auto &FileManager = Unit->getFileManager();
+
+    /*
+     * The declarations of the main file are only collected during the
+     * traversal. This allows to time the generator on its own.
+     */
+    std::vector<std::string> MainFile = {
+        util::file::getRealPath(FileManager, Unit->getOriginalSourceFileName())
+    };
+
+    auto Configuration = std::make_shared<FGenConfiguration>();
+
+    std::vector<Sample> Traversals, Additions, Dumps;
+    size_t NumDecls = 0;
+
+    std::string Output;
+    Stopwatch Watch;
+
+    /* The first round deserializes the declarations and is not measured */
+    for (unsigned int i = 0; i <= Repetitions; ++i) {
+        FGenVisitor Visitor;
+        Visitor.setConfiguration(Configuration);
+        Visitor.setInputFiles(MainFile);
+
+        Watch.start();
+        Visitor.TraverseDecl(Context.getTranslationUnitDecl());
+        auto Traversal = Watch.stop();
+
+        auto &Functions = Visitor.functions();
+
+        FunctionGenerator Generator;
+        Generator.setConfiguration(Configuration);
+
+        Watch.start();
+        for (const auto Function : Functions)
+            Generator.add(Function);
+        auto Addition = Watch.stop();
+
+        Output.clear();
+        llvm::raw_string_ostream OS(Output);
+
+        Watch.start();
+        Generator.dump(OS);
+        OS.flush();
+        auto Dump = Watch.stop();
+
+        if (!i)
+            continue;
+
+        Traversals.push_back(Traversal);
+        Additions.push_back(Addition);
+        Dumps.push_back(Dump);
+
+        NumDecls = Functions.size();
+    }
+
+    auto Name = llvm::sys::path::filename(File);
+
+    report(Name.str() + "/traverse", Traversals, NumDecls);
+    report(Name.str() + "/add", Additions, NumDecls);
+    report(Name.str() + "/dump", Dumps, NumDecls);
+
+    return true;
+}
+
+int main(int argc, const char *argv[])
+{
+    llvm::cl::ParseCommandLineOptions(argc, argv);
+
+    if (!Repetitions) {
+        util::cl::error() << "fgen-bench: at least one repetition required\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    llvm::outs() << llvm::format("%-40s %12s %12s %12s %12s %12s\n",
+                                 "Benchmark",
+                                 "Mean(us)",
+                                 "Median(us)",
+                                 "StdDev(us)",
+                                 "Min(us)",
+                                 "Cycles/Decl");
+
+    int Result = EXIT_SUCCESS;
+
+    for (const auto &File : InputFiles) {
+        if (!runBenchmark(File))
+            Result = EXIT_FAILURE;
+    }
+
+    return Result;
+}
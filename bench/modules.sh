@@ -0,0 +1,48 @@
+#!/usr/bin/env bash
+
+#
+# Copyright (C) 2019  Steffen Nüssle
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+#
+# Compares the parse times of fgen with and without implicit clang modules.
+# The module cache is placed in a temporary directory, so the first
+# modules run shows the cost of building the modules (cold cache) and
+# the second one the cost of importing them (warm cache).
+#
+# Usage: bench/modules.sh [<fgen-args> ...] <file> [<file> ...]
+#
+
+FGEN="${FGEN:-build/fgen}"
+CACHE="$(mktemp -d)"
+
+trap 'rm -rf "${CACHE}"' EXIT
+
+run()
+{
+    local name="$1"
+    shift
+
+    printf "### %s\n" "${name}"
+    "${FGEN}" -print-stats "$@" 2>&1 >/dev/null \
+        | grep -E "parse-time-us|files-parsed|modules-|module-cache"
+}
+
+run "textual includes" -use-modules=false "$@"
+run "modules (cold cache)" -use-modules -module-cache-path="${CACHE}" "$@"
+run "modules (warm cache)" -use-modules -module-cache-path="${CACHE}" "$@"
+
+exit 0
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Runs 'fgen' as part of a regular compiler invocation. The translation
+ * unit is already parsed by the build, so the definitions for the header
+ * of the main file are generated without parsing anything a second time:
+ *
+ *      clang++ -fplugin=libfgen.so \
+ *              -Xclang -plugin-arg-fgen -Xclang o=%{dir}/%{stem}.gen.cpp \
+ *              -c src/a.cpp
+ *
+ * The plugin runs after the main action of the compiler, so the object
+ * file is still produced as usual. Without an output file the plugin is
+ * disabled and does not add any work to the compilation.
+ */
+
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <clang/AST/ASTConsumer.h>
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/FrontendAction.h>
+#include <clang/Frontend/FrontendPluginRegistry.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <util/Path.hpp>
+
+#include <FGenASTConsumer.hpp>
+#include <FGenConfiguration.hpp>
+
+class FGenPluginAction : public clang::PluginASTAction {
+public:
+    FGenPluginAction();
+
+protected:
+    virtual std::unique_ptr<clang::ASTConsumer>
+    CreateASTConsumer(clang::CompilerInstance &CI,
+                      llvm::StringRef File) override;
+
+    virtual bool ParseArgs(const clang::CompilerInstance &CI,
+                           const std::vector<std::string> &Args) override;
+
+    virtual ActionType getActionType() override;
+
+private:
+    void reportError(const clang::CompilerInstance &CI, llvm::StringRef Msg);
+
+    /*
+     * Every compiler invocation gets its own action and configuration.
+     * Nothing is shared between translation units which are compiled
+     * concurrently within the same process.
+     */
+    std::shared_ptr<FGenConfiguration> Configuration_;
+};
+
+FGenPluginAction::FGenPluginAction()
+    : Configuration_(std::make_shared<FGenConfiguration>())
+{
+    /* A compiled source file includes its own header */
+    Configuration_->setPairedHeaders(true);
+}
+
+std::unique_ptr<clang::ASTConsumer>
+FGenPluginAction::CreateASTConsumer(clang::CompilerInstance &CI,
+                                    llvm::StringRef File)
+{
+    /* A disabled plugin must not traverse the translation unit at all */
+    if (Configuration_->outputFile().empty())
+        return llvm::make_unique<clang::ASTConsumer>();
+
+    llvm::SmallString<256> Path(File);
+
+    CI.getFileManager().makeAbsolutePath(Path);
+
+    auto Consumer = llvm::make_unique<FGenASTConsumer>(Path);
+    Consumer->setConfiguration(Configuration_);
+
+    return Consumer;
+}
+
+bool FGenPluginAction::ParseArgs(const clang::CompilerInstance &CI,
+                                 const std::vector<std::string> &Args)
+{
+    /*
+     * Arguments are passed with "-Xclang -plugin-arg-fgen -Xclang <arg>",
+     * e.g. "o=<file>" or "no-stubs".
+     */
+    for (llvm::StringRef Arg : Args) {
+        llvm::StringRef Name, Value;
+        std::tie(Name, Value) = Arg.split('=');
+
+        if (Name == "o") {
+            Configuration_->setOutputFile(Value.str());
+        } else if (Name == "fcontains") {
+            Configuration_->targets().push_back(Value.str());
+        } else if (Name == "write-if-changed") {
+            Configuration_->setWriteIfChanged(true);
+        } else {
+            bool Enable = !Name.consume_front("no-");
+
+            if (!Configuration_->setGeneratorOption(Name, Enable)) {
+                reportError(CI, "unknown argument \"" + Arg.str() + "\"");
+                return false;
+            }
+        }
+    }
+
+    /*
+     * The compiler is invoked for many translation units at once. A
+     * single output file would be written by all of them concurrently.
+     */
+    auto &OutputFile = Configuration_->outputFile();
+
+    if (!OutputFile.empty() && !util::path::isTemplate(OutputFile)) {
+        reportError(CI, "output file \"" + OutputFile +
+                            "\" must contain a placeholder, e.g. %{stem}");
+        return false;
+    }
+
+    return true;
+}
+
+clang::PluginASTAction::ActionType FGenPluginAction::getActionType()
+{
+    return AddAfterMainAction;
+}
+
+void FGenPluginAction::reportError(const clang::CompilerInstance &CI,
+                                   llvm::StringRef Msg)
+{
+    auto &Diagnostics = CI.getDiagnostics();
+    auto ID = Diagnostics.getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                          "fgen: %0");
+
+    Diagnostics.Report(ID) << Msg;
+}
+
+static clang::FrontendPluginRegistry::Add<FGenPluginAction>
+    FGenPlugin("fgen", "generate the function definitions of a header");
@@ -0,0 +1,471 @@
+/*
+ * Copyright (C) 2018  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <clang/AST/ASTContext.h>
+#include <clang/Basic/SourceManager.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <util/CommandLine.hpp>
+#include <util/File.hpp>
+#include <util/Path.hpp>
+
+#include <FGenASTConsumer.hpp>
+#include <FGenDeclCache.hpp>
+#include <FGenPatcher.hpp>
+#include <FGenVisitor.hpp>
+
+static std::string getAbsolutePath(llvm::StringRef Path)
+{
+    /*
+     * The tool runs in the directory of the compile command. Queued
+     * files are written later, when another directory may be current.
+     */
+    llvm::SmallString<256> Buffer(Path);
+    llvm::sys::fs::make_absolute(Buffer);
+
+    return Buffer.str().str();
+}
+
+FGenASTConsumer::FGenASTConsumer(llvm::StringRef File)
+    : File_(File),
+      Configuration_(nullptr),
+      OutputCache_(nullptr),
+      Outputs_(),
+      Writer_(nullptr),
+      Diagnostics_(nullptr),
+      Failed_(false)
+{}
+
+void FGenASTConsumer::setConfiguration(
+    std::shared_ptr<FGenConfiguration> Configuration)
+{
+    Configuration_ = std::move(Configuration);
+}
+
+void FGenASTConsumer::setOutputCache(
+    std::shared_ptr<FGenOutputCache> OutputCache)
+{
+    OutputCache_ = std::move(OutputCache);
+}
+
+void FGenASTConsumer::setOutputs(std::vector<FGenOutput> Outputs)
+{
+    Outputs_ = std::move(Outputs);
+}
+
+void FGenASTConsumer::setWriter(std::shared_ptr<FGenWriter> Writer)
+{
+    Writer_ = std::move(Writer);
+}
+
+void FGenASTConsumer::HandleTranslationUnit(clang::ASTContext &Context)
+{
+    auto Visitor = FGenVisitor();
+    bool Patch = !Configuration_->patchFile().empty();
+
+    Diagnostics_ = &Context.getDiagnostics();
+
+    Visitor.setConfiguration(Configuration_);
+
+    for (const auto &Output : Outputs_)
+        Visitor.addConfiguration(Output.Configuration);
+
+    if (Patch)
+        Visitor.setInputFiles(Configuration_->patchHeaders());
+
+    if (Configuration_->pairedHeaders()) {
+        auto Headers = getPairedHeaders(Context.getSourceManager());
+
+        /* Nothing to generate for a main file without a header */
+        if (Headers.empty())
+            return;
+
+        Visitor.setTargetFiles(Headers);
+    }
+
+    /*
+     * In project mode every translation unit generates the functions
+     * which were assigned to it by the project index.
+     */
+    auto &ProjectUSRs = Configuration_->projectUSRs();
+    if (!ProjectUSRs.empty()) {
+        auto &FileManager = Context.getSourceManager().getFileManager();
+
+        auto It = ProjectUSRs.find(util::file::getRealPath(FileManager, File_));
+        if (It == ProjectUSRs.end())
+            return;
+
+        Visitor.setUSRs(&It->second);
+    }
+
+    if (Configuration_->hasRange()) {
+        auto Range = getTargetRange(Context.getSourceManager());
+
+        /* The file of the range is not part of this translation unit */
+        if (Range.isInvalid())
+            return;
+
+        Visitor.setRange(Range);
+    }
+
+    /*
+     * Definitions which did not change since the last run are taken
+     * from the declaration cache of the input file. A range covers
+     * only a few of its declarations and would empty the cache.
+     */
+    std::vector<std::pair<std::string, std::shared_ptr<FGenDeclCache>>>
+        DeclCaches;
+
+    auto &Directory = Configuration_->declCacheDirectory();
+
+    if (!Directory.empty() && !Patch && !Configuration_->hasRange()) {
+        auto &FileManager = Context.getSourceManager().getFileManager();
+        auto File = util::file::getRealPath(FileManager, File_);
+
+        for (size_t i = 0; i <= Outputs_.size(); ++i) {
+            auto &Configuration = (i) ? *Outputs_[i - 1].Configuration
+                                      : *Configuration_;
+
+            auto Path = FGenDeclCache::getPath(Directory, File, Configuration);
+            auto DeclCache = std::make_shared<FGenDeclCache>();
+            std::string ErrMsg;
+
+            if (!DeclCache->load(Path, ErrMsg)) {
+                util::cl::warning() << "fgen: failed to load declaration "
+                                    << "cache \"" << Path << "\" - "
+                                    << ErrMsg << "\n";
+            }
+
+            Visitor.setDeclCache(i, DeclCache);
+            DeclCaches.emplace_back(std::move(Path), std::move(DeclCache));
+        }
+    }
+
+    /*
+     * The IR of the input file allows to generate it again with other
+     * options but without a parse, see 'HandleIR()'. Headers read from
+     * modules or serialized ASTs are unknown to the source manager, so
+     * the IR could not tell when it is outdated.
+     */
+    std::shared_ptr<FGenIR> IR;
+    auto &IRDirectory = Configuration_->irDirectory();
+
+    bool CaptureIR = !IRDirectory.empty() && !Patch &&
+                     !Configuration_->hasRange() &&
+                     !Configuration_->pairedHeaders() &&
+                     ProjectUSRs.empty() && !Context.getExternalSource();
+
+    if (CaptureIR) {
+        IR = std::make_shared<FGenIR>();
+        Visitor.setIR(IR);
+    }
+
+    Visitor.TraverseDecl(Context.getTranslationUnitDecl());
+
+    /*
+     * In patch mode the parsed file is the file to be patched. The
+     * declarations of interest stem from the headers it includes.
+     */
+    if (Patch) {
+        auto Patcher = FGenPatcher(Context);
+        std::string ErrMsg;
+
+        Patcher.setConfiguration(Configuration_);
+
+        if (!Patcher.patch(Visitor.functions(), ErrMsg))
+            reportError("failed to patch file \"" + File_ + "\" - " + ErrMsg);
+
+        return;
+    }
+
+    const auto Dependencies = [&Context]() {
+        return util::file::getDependencies(Context.getSourceManager());
+    };
+
+    /*
+     * With additional outputs, the main output is only written if an
+     * output file was given explicitly.
+     */
+    if (Outputs_.empty() || !Configuration_->outputFile().empty()) {
+        const auto Dump = [&Visitor](llvm::raw_ostream &OStream) {
+            Visitor.dump(0, OStream);
+        };
+
+        writeOutput(Dump, Dependencies, *Configuration_, OutputCache_.get());
+    }
+
+    for (size_t i = 0; i < Outputs_.size(); ++i) {
+        auto &Output = Outputs_[i];
+
+        const auto Dump = [&Visitor, i](llvm::raw_ostream &OStream) {
+            Visitor.dump(i + 1, OStream);
+        };
+
+        writeOutput(Dump, Dependencies, *Output.Configuration,
+                    Output.OutputCache.get());
+    }
+
+    if (IR) {
+        auto Path = FGenIR::getPath(IRDirectory, util::file::getRealPath(File_),
+                                    *Configuration_);
+        std::string ErrMsg;
+
+        IR->setDependencies(Dependencies());
+
+        if (!IR->save(Path, ErrMsg)) {
+            util::cl::warning() << "fgen: failed to save IR \"" << Path
+                                << "\" - " << ErrMsg << "\n";
+        }
+    }
+
+    for (const auto &Pair : DeclCaches) {
+        std::string ErrMsg;
+
+        if (!Pair.second->save(Pair.first, ErrMsg)) {
+            util::cl::warning() << "fgen: failed to save declaration cache \""
+                                << Pair.first << "\" - " << ErrMsg << "\n";
+        }
+    }
+}
+
+void FGenASTConsumer::HandleIR(const FGenIR &IR)
+{
+    const auto Dependencies = [&IR]() { return IR.dependencies(); };
+
+    if (Outputs_.empty() || !Configuration_->outputFile().empty()) {
+        const auto Dump = [this, &IR](llvm::raw_ostream &OStream) {
+            IR.generate(*Configuration_, OStream);
+        };
+
+        writeOutput(Dump, Dependencies, *Configuration_, OutputCache_.get());
+    }
+
+    for (const auto &Output : Outputs_) {
+        auto &Configuration = *Output.Configuration;
+
+        const auto Dump = [&Configuration, &IR](llvm::raw_ostream &OStream) {
+            IR.generate(Configuration, OStream);
+        };
+
+        writeOutput(Dump, Dependencies, Configuration,
+                    Output.OutputCache.get());
+    }
+}
+
+bool FGenASTConsumer::failed() const
+{
+    return Failed_;
+}
+
+void FGenASTConsumer::writeOutput(const DumpFunction &Dump,
+                                  const DependencyFunction &Dependencies,
+                                  const FGenConfiguration &Configuration,
+                                  FGenOutputCache *OutputCache)
+{
+    /*
+     * If an output cache is present the caller is responsible for
+     * writing the generated output. This is the case if 'fgen'
+     * runs in watch mode or processes files in parallel and needs to
+     * assemble the output of multiple independently generated files.
+     */
+    if (OutputCache) {
+        std::string Content;
+        llvm::raw_string_ostream OS(Content);
+
+        Dump(OS);
+        OS.flush();
+
+        OutputCache->insert(util::file::getRealPath(File_), std::move(Content),
+                            Dependencies());
+        return;
+    }
+
+    auto &OutputFile = Configuration.outputFile();
+
+    /*
+     * Every input file gets its own output file. These files are
+     * independent of each other and can be written without any
+     * synchronization, even if multiple files are processed in parallel.
+     */
+    if (util::path::isTemplate(OutputFile)) {
+        auto Path = util::path::expandTemplate(OutputFile, File_);
+
+        if (Configuration.writeIfChanged())
+            writeOutputFileIfChanged(Dump, Path);
+        else
+            writeOutputFile(Dump, Path, llvm::sys::fs::F_None);
+
+        return;
+    }
+
+    if (!OutputFile.empty()) {
+        writeOutputFile(Dump, OutputFile, llvm::sys::fs::F_Append);
+        return;
+    }
+
+    Dump(llvm::outs());
+}
+
+clang::SourceRange
+FGenASTConsumer::getTargetRange(clang::SourceManager &SM) const
+{
+    auto File = SM.getFileManager().getFile(Configuration_->rangeFile());
+    if (!File)
+        return {};
+
+    auto &Begin = Configuration_->rangeBegin();
+    auto &End = Configuration_->rangeEnd();
+
+    /* Locations of a file included more than once refer to the first */
+    auto BeginLoc = SM.translateFileLineCol(File, Begin.Line, Begin.Column);
+    auto EndLoc = SM.translateFileLineCol(File, End.Line, End.Column);
+
+    if (BeginLoc.isInvalid() || EndLoc.isInvalid())
+        return {};
+
+    return {BeginLoc, EndLoc};
+}
+
+std::vector<std::string>
+FGenASTConsumer::getPairedHeaders(const clang::SourceManager &SM) const
+{
+    auto &FileManager = SM.getFileManager();
+    auto Stem = llvm::sys::path::stem(File_);
+    auto MainFileID = SM.getMainFileID();
+
+    std::vector<std::string> Headers;
+
+    /*
+     * The header of a source file shares its name, but may reside in a
+     * different directory, e.g. "include/a.hpp" belongs to "src/a.cpp".
+     * Only user headers included by the main file itself are considered,
+     * otherwise "src/time.c" would be paired with <time.h>.
+     */
+    for (unsigned i = 0, n = SM.local_sloc_entry_size(); i < n; ++i) {
+        auto &Entry = SM.getLocalSLocEntry(i);
+        if (!Entry.isFile())
+            continue;
+
+        auto &FileInfo = Entry.getFile();
+        auto *FileEntry = FileInfo.getContentCache()->OrigEntry;
+
+        if (!FileEntry || FileInfo.getIncludeLoc().isInvalid())
+            continue;
+
+        if (SM.getFileID(FileInfo.getIncludeLoc()) != MainFileID)
+            continue;
+
+        if (FileInfo.getFileCharacteristic() != clang::SrcMgr::C_User)
+            continue;
+
+        auto Name = FileEntry->getName();
+
+        if (!util::path::isHeaderFile(Name))
+            continue;
+
+        if (llvm::sys::path::stem(Name) != Stem)
+            continue;
+
+        auto Path = util::file::getRealPath(FileManager, Name);
+
+        /* A header without include guard may be included twice */
+        if (std::find(Headers.begin(), Headers.end(), Path) == Headers.end())
+            Headers.push_back(std::move(Path));
+    }
+
+    return Headers;
+}
+
+void FGenASTConsumer::writeOutputFile(const DumpFunction &Dump,
+                                      const std::string &OutputFile,
+                                      llvm::sys::fs::OpenFlags Flags)
+{
+    /* The writer's thread writes the file while the next one is parsed */
+    if (Writer_) {
+        std::string Content;
+        llvm::raw_string_ostream OS(Content);
+
+        Dump(OS);
+        OS.flush();
+
+        Writer_->write(getAbsolutePath(OutputFile), std::move(Content), Flags);
+        return;
+    }
+
+    auto Directory = llvm::sys::path::parent_path(OutputFile);
+
+    if (!Directory.empty())
+        llvm::sys::fs::create_directories(Directory);
+
+    std::error_code Error;
+
+    llvm::raw_fd_ostream OS(OutputFile, Error, Flags);
+    if (Error) {
+        reportError("failed to open file \"" + OutputFile +
+                    "\" for writing - " + Error.message());
+        return;
+    }
+
+    Dump(OS);
+}
+
+void FGenASTConsumer::writeOutputFileIfChanged(const DumpFunction &Dump,
+                                               const std::string &OutputFile)
+{
+    std::string Content;
+    llvm::raw_string_ostream OS(Content);
+
+    Dump(OS);
+    OS.flush();
+
+    if (Writer_) {
+        Writer_->writeIfChanged(getAbsolutePath(OutputFile),
+                                std::move(Content));
+        return;
+    }
+
+    auto Directory = llvm::sys::path::parent_path(OutputFile);
+
+    if (!Directory.empty())
+        llvm::sys::fs::create_directories(Directory);
+
+    std::string ErrMsg;
+
+    if (!util::file::writeIfChanged(OutputFile, Content, ErrMsg))
+        reportError("failed to write file \"" + OutputFile + "\" - " + ErrMsg);
+}
+
+void FGenASTConsumer::reportError(llvm::StringRef Msg)
+{
+    Failed_ = true;
+
+    if (!Diagnostics_) {
+        util::cl::error() << "fgen: " << Msg << "\n";
+        return;
+    }
+
+    auto ID = Diagnostics_->getCustomDiagID(clang::DiagnosticsEngine::Error,
+                                            "fgen: %0");
+
+    Diagnostics_->Report(ID) << Msg;
+}
+
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2018  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FGEN_FGENASTCONSUMER_HPP_
+#define FGEN_FGENASTCONSUMER_HPP_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <clang/AST/ASTConsumer.h>
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Basic/SourceManager.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/FileSystem.h>
+
+#include <FGenConfiguration.hpp>
+#include <FGenIR.hpp>
+#include <FGenOutputCache.hpp>
+#include <FGenWriter.hpp>
+
+class FGenVisitor;
+
+/*
+ * An additional output of a run. It is generated from the same parse
+ * and traversal as the main output, but with its own generation options
+ * and output file.
+ */
+struct FGenOutput {
+    std::shared_ptr<FGenConfiguration> Configuration;
+    std::shared_ptr<FGenOutputCache> OutputCache;
+};
+
+/*
+ * Generates the functions of a translation unit once it is completely
+ * parsed. The consumer is used by the frontend action of the tool, for
+ * serialized ASTs and by the compiler plugin. Input files with an up to
+ * date IR are written by the consumer, too, but without any AST.
+ *
+ * Errors are reported through the diagnostics of the AST context, if
+ * there is one, and never end the process: the plugin runs inside of
+ * the compiler. Callers without an AST context check 'failed()'.
+ */
+
+class FGenASTConsumer : public clang::ASTConsumer {
+public:
+    explicit FGenASTConsumer(llvm::StringRef File);
+
+    void setConfiguration(std::shared_ptr<FGenConfiguration> Configuration);
+    void setOutputCache(std::shared_ptr<FGenOutputCache> OutputCache);
+    void setOutputs(std::vector<FGenOutput> Outputs);
+    void setWriter(std::shared_ptr<FGenWriter> Writer);
+
+    virtual void HandleTranslationUnit(clang::ASTContext &Context) override;
+    void HandleIR(const FGenIR &IR);
+
+    bool failed() const;
+
+private:
+    using DumpFunction = std::function<void(llvm::raw_ostream &)>;
+    using DependencyFunction = std::function<std::vector<std::string>()>;
+
+    clang::SourceRange getTargetRange(clang::SourceManager &SM) const;
+    std::vector<std::string>
+    getPairedHeaders(const clang::SourceManager &SM) const;
+
+    void writeOutput(const DumpFunction &Dump,
+                     const DependencyFunction &Dependencies,
+                     const FGenConfiguration &Configuration,
+                     FGenOutputCache *OutputCache);
+    void writeOutputFile(const DumpFunction &Dump,
+                         const std::string &OutputFile,
+                         llvm::sys::fs::OpenFlags Flags);
+    void writeOutputFileIfChanged(const DumpFunction &Dump,
+                                  const std::string &OutputFile);
+
+    void reportError(llvm::StringRef Msg);
+
+    std::string File_;
+
+    std::shared_ptr<FGenConfiguration> Configuration_;
+    std::shared_ptr<FGenOutputCache> OutputCache_;
+    std::vector<FGenOutput> Outputs_;
+    std::shared_ptr<FGenWriter> Writer_;
+
+    clang::DiagnosticsEngine *Diagnostics_;
+    bool Failed_;
+};
+
+#endif /* FGEN_FGENASTCONSUMER_HPP_ */
@@ -15,78 +15,163 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <llvm/Support/raw_ostream.h>
+#include <clang/AST/ASTContext.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Lex/Preprocessor.h>
+#include <clang/Serialization/ASTReader.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
 
-#include <util/CommandLine.hpp>
+#include <util/File.hpp>
+#include <util/Statistics.hpp>
 
 #include <FGenAction.hpp>
-#include <FGenVisitor.hpp>
 
-class FGenASTConsumer : public clang::ASTConsumer {
-public:
-    FGenASTConsumer() = default;
+static util::stats::Counter NumFilesParsed(
+    "files-parsed", "Number of parsed translation units");
+static util::stats::Counter ParseTimeUs(
+    "parse-time-us", "Time spent parsing and generating (microseconds)");
+static util::stats::Counter NumModulesLoaded(
+    "modules-loaded", "Number of implicit modules loaded from the cache");
 
-    void setConfiguration(std::shared_ptr<FGenConfiguration> Configuration);
+static uint64_t getMemoryUsage(const clang::CompilerInstance &CI)
+{
+    uint64_t Bytes = 0;
+
+    /*
+     * The resident set size of the process is shared by all worker
+     * threads. The memory held by the AST, the source manager and the
+     * preprocessor of this translation unit makes up the bulk of the
+     * footprint of a single job and is released with it.
+     */
+    if (CI.hasASTContext()) {
+        auto &Context = CI.getASTContext();
+
+        Bytes += Context.getASTAllocatedMemory();
+        Bytes += Context.getSideTableAllocatedMemory();
+    }
+
+    if (CI.hasSourceManager()) {
+        auto &SourceManager = CI.getSourceManager();
 
-    virtual void HandleTranslationUnit(clang::ASTContext &Context) override;
+        Bytes += SourceManager.getContentCacheSize();
+        Bytes += SourceManager.getDataStructureSizes();
 
-private:
-    std::shared_ptr<FGenConfiguration> Configuration_;
-};
+        auto Sizes = SourceManager.getMemoryBufferSizes();
+        Bytes += Sizes.malloc_bytes + Sizes.mmap_bytes;
+    }
 
-void FGenASTConsumer::setConfiguration(
+    if (CI.hasPreprocessor())
+        Bytes += CI.getPreprocessor().getTotalMemory();
+
+    return Bytes;
+}
+
+void FGenAction::setConfiguration(
     std::shared_ptr<FGenConfiguration> Configuration)
 {
     Configuration_ = std::move(Configuration);
 }
 
-void FGenASTConsumer::HandleTranslationUnit(clang::ASTContext &Context)
+void FGenAction::setOutputCache(std::shared_ptr<FGenOutputCache> OutputCache)
 {
-    auto Visitor = FGenVisitor();
-
-    Visitor.setConfiguration(Configuration_);
-    Visitor.TraverseDecl(Context.getTranslationUnitDecl());
-
-    auto &OutputFile = Configuration_->outputFile();
-
-    if (!OutputFile.empty()) {
-        std::error_code Error;
+    OutputCache_ = std::move(OutputCache);
+}
 
-        llvm::raw_fd_ostream OS(OutputFile, Error, llvm::sys::fs::F_Append);
-        if (Error) {
-            util::cl::error() << "fgen: failed to open file \"" << OutputFile
-                              << "\" for writing:\n"
-                              << "    " << Error.message() << "\n";
-            std::exit(EXIT_FAILURE);
-        }
+void FGenAction::setHistory(std::shared_ptr<FGenHistory> History)
+{
+    History_ = std::move(History);
+}
 
-        Visitor.dump(OS);
-        return;
-    }
+void FGenAction::setDepFile(std::shared_ptr<FGenDepFile> DepFile)
+{
+    DepFile_ = std::move(DepFile);
+}
 
-    Visitor.dump(llvm::outs());
+void FGenAction::setWriter(std::shared_ptr<FGenWriter> Writer)
+{
+    Writer_ = std::move(Writer);
 }
 
-void FGenAction::setConfiguration(
-    std::shared_ptr<FGenConfiguration> Configuration)
+void FGenAction::setOutputs(std::vector<FGenOutput> Outputs)
 {
-    Configuration_ = std::move(Configuration);
+    Outputs_ = std::move(Outputs);
 }
 
 std::unique_ptr<clang::ASTConsumer>
 FGenAction::CreateASTConsumer(clang::CompilerInstance &CI, llvm::StringRef File)
 {
-    (void) CI;
-    (void) File;
+    llvm::SmallString<256> Path(File);
+
+    CI.getFileManager().makeAbsolutePath(Path);
 
-    auto Consumer = llvm::make_unique<FGenASTConsumer>();
+    auto Consumer = llvm::make_unique<FGenASTConsumer>(Path);
     Consumer->setConfiguration(Configuration_);
+    Consumer->setOutputCache(OutputCache_);
+    Consumer->setOutputs(Outputs_);
+    Consumer->setWriter(Writer_);
 
     return Consumer;
 }
 
+bool FGenAction::BeginSourceFileAction(clang::CompilerInstance &CI)
+{
+    (void) CI;
+
+    StartTime_ = std::chrono::steady_clock::now();
+
+    return true;
+}
+
+void FGenAction::EndSourceFileAction()
+{
+    auto Duration = std::chrono::steady_clock::now() - StartTime_;
+    auto Us = std::chrono::duration_cast<std::chrono::microseconds>(Duration);
+
+    ++NumFilesParsed;
+    ParseTimeUs += Us.count();
+
+    auto &CI = getCompilerInstance();
+
+    if (History_) {
+        auto &FileManager = CI.getFileManager();
+        auto File = util::file::getRealPath(FileManager, getCurrentFile());
+
+        History_->setMemory(File, getMemoryUsage(CI));
+        History_->setDuration(File, Us.count());
+    }
+
+    if (DepFile_) {
+        auto &FileManager = CI.getFileManager();
+        auto File = util::file::getRealPath(FileManager, getCurrentFile());
+
+        DepFile_->insert(File,
+                         util::file::getDependencies(CI.getSourceManager()));
+    }
+
+    /*
+     * If clang modules are enabled, count the modules which were
+     * imported instead of being textually included. Together with the
+     * number of modules built during the run this yields the module
+     * cache hit rate.
+     */
+    if (!CI.hasModuleManager())
+        return;
+
+    for (const auto &Module : CI.getModuleManager()->getModuleManager()) {
+        if (Module.Kind == clang::serialization::MK_ImplicitModule)
+            ++NumModulesLoaded;
+    }
+}
+
 FGenActionFactory::FGenActionFactory()
-    : Configuration_(std::make_shared<FGenConfiguration>())
+    : Configuration_(std::make_shared<FGenConfiguration>()),
+      OutputCache_(nullptr),
+      History_(nullptr),
+      DepFile_(nullptr),
+      Writer_(nullptr),
+      Outputs_()
 {
     /* clang-format... */
 }
@@ -100,10 +185,85 @@ const FGenConfiguration &FGenActionFactory::configuration() const
     return *Configuration_;
 }
 
+void FGenActionFactory::setOutputCache(
+    std::shared_ptr<FGenOutputCache> OutputCache)
+{
+    OutputCache_ = std::move(OutputCache);
+}
+
+const std::shared_ptr<FGenOutputCache> &FGenActionFactory::outputCache() const
+{
+    return OutputCache_;
+}
+
+void FGenActionFactory::setHistory(std::shared_ptr<FGenHistory> History)
+{
+    History_ = std::move(History);
+}
+
+const std::shared_ptr<FGenHistory> &FGenActionFactory::history() const
+{
+    return History_;
+}
+
+void FGenActionFactory::setDepFile(std::shared_ptr<FGenDepFile> DepFile)
+{
+    DepFile_ = std::move(DepFile);
+}
+
+const std::shared_ptr<FGenDepFile> &FGenActionFactory::depFile() const
+{
+    return DepFile_;
+}
+
+void FGenActionFactory::setWriter(std::shared_ptr<FGenWriter> Writer)
+{
+    Writer_ = std::move(Writer);
+}
+
+void FGenActionFactory::addOutput(
+    std::shared_ptr<FGenConfiguration> Configuration,
+    std::shared_ptr<FGenOutputCache> OutputCache)
+{
+    Outputs_.push_back({std::move(Configuration), std::move(OutputCache)});
+}
+
+const std::vector<FGenOutput> &FGenActionFactory::outputs() const
+{
+    return Outputs_;
+}
+
 clang::FrontendAction *FGenActionFactory::create()
 {
     auto Action = new FGenAction();
     Action->setConfiguration(Configuration_);
+    Action->setOutputCache(OutputCache_);
+    Action->setHistory(History_);
+    Action->setDepFile(DepFile_);
+    Action->setWriter(Writer_);
+    Action->setOutputs(Outputs_);
 
     return Action;
 }
+
+std::unique_ptr<FGenASTConsumer>
+FGenActionFactory::createASTConsumer(llvm::StringRef File)
+{
+    llvm::SmallString<256> Path(File);
+
+    /*
+     * Serialized ASTs are not run through a frontend action. Their
+     * consumer gets the deserialized AST context directly. The same
+     * applies to the compiler plugin, which runs its own action, and to
+     * input files generated from their IR.
+     */
+    llvm::sys::fs::make_absolute(Path);
+
+    auto Consumer = llvm::make_unique<FGenASTConsumer>(Path);
+    Consumer->setConfiguration(Configuration_);
+    Consumer->setOutputCache(OutputCache_);
+    Consumer->setOutputs(Outputs_);
+    Consumer->setWriter(Writer_);
+
+    return Consumer;
+}
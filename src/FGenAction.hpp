@@ -18,25 +18,48 @@
 #ifndef FGEN_FGENACTION_HPP_
 #define FGEN_FGENACTION_HPP_
 
+#include <chrono>
+#include <memory>
 #include <unordered_set>
+#include <vector>
 
 #include <clang/Frontend/FrontendAction.h>
 #include <clang/Tooling/Tooling.h>
 
+#include <FGenASTConsumer.hpp>
 #include <FGenConfiguration.hpp>
+#include <FGenDepFile.hpp>
+#include <FGenHistory.hpp>
+#include <FGenOutputCache.hpp>
 
 class FGenAction : public clang::ASTFrontendAction {
 public:
     FGenAction() = default;
 
     void setConfiguration(std::shared_ptr<FGenConfiguration> Configuration);
+    void setOutputCache(std::shared_ptr<FGenOutputCache> OutputCache);
+    const std::shared_ptr<FGenOutputCache> &outputCache() const;
+    void setHistory(std::shared_ptr<FGenHistory> History);
+    void setDepFile(std::shared_ptr<FGenDepFile> DepFile);
+    void setWriter(std::shared_ptr<FGenWriter> Writer);
+    void setOutputs(std::vector<FGenOutput> Outputs);
 
     virtual std::unique_ptr<clang::ASTConsumer>
     CreateASTConsumer(clang::CompilerInstance &CI,
                       llvm::StringRef File) override;
 
+    virtual bool BeginSourceFileAction(clang::CompilerInstance &CI) override;
+    virtual void EndSourceFileAction() override;
+
 private:
     std::shared_ptr<FGenConfiguration> Configuration_;
+    std::shared_ptr<FGenOutputCache> OutputCache_;
+    std::shared_ptr<FGenHistory> History_;
+    std::shared_ptr<FGenDepFile> DepFile_;
+    std::shared_ptr<FGenWriter> Writer_;
+    std::vector<FGenOutput> Outputs_;
+
+    std::chrono::steady_clock::time_point StartTime_;
 };
 
 class FGenActionFactory : public clang::tooling::FrontendActionFactory {
@@ -46,10 +69,29 @@ public:
     FGenConfiguration &configuration();
     const FGenConfiguration &configuration() const;
 
+    void setOutputCache(std::shared_ptr<FGenOutputCache> OutputCache);
+    const std::shared_ptr<FGenOutputCache> &outputCache() const;
+    void setHistory(std::shared_ptr<FGenHistory> History);
+    const std::shared_ptr<FGenHistory> &history() const;
+    void setDepFile(std::shared_ptr<FGenDepFile> DepFile);
+    const std::shared_ptr<FGenDepFile> &depFile() const;
+    void setWriter(std::shared_ptr<FGenWriter> Writer);
+
+    void addOutput(std::shared_ptr<FGenConfiguration> Configuration,
+                   std::shared_ptr<FGenOutputCache> OutputCache);
+    const std::vector<FGenOutput> &outputs() const;
+
     virtual clang::FrontendAction *create() override;
 
+    std::unique_ptr<FGenASTConsumer> createASTConsumer(llvm::StringRef File);
+
 private:
     std::shared_ptr<FGenConfiguration> Configuration_;
+    std::shared_ptr<FGenOutputCache> OutputCache_;
+    std::shared_ptr<FGenHistory> History_;
+    std::shared_ptr<FGenDepFile> DepFile_;
+    std::shared_ptr<FGenWriter> Writer_;
+    std::vector<FGenOutput> Outputs_;
 };
 
 #endif /* FGEN_FGENACTION_HPP_ */
@@ -84,4 +84,12 @@ const clang::tooling::CompilationDatabase &FGenCompilationDatabase::get() const
     return *Database_;
 }
 
+void FGenCompilationDatabase::setEmpty()
+{
+    using namespace clang::tooling;
+
+    /* Used if none of the input files needs a compile command */
+    Database_ = llvm::make_unique<FixedCompilationDatabase>(
+        ".", std::vector<std::string>());
+}
 
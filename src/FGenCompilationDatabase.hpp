@@ -25,6 +25,7 @@ public:
     FGenCompilationDatabase() = default;
 
     bool autoDetect(llvm::StringRef Path, std::string &ErrMsg);
+    void setEmpty();
 
     const clang::tooling::CompilationDatabase &get() const;
 
@@ -19,6 +19,64 @@
 
 #include <FGenConfiguration.hpp>
 
+/*
+ * Identifies the format of the generated code. Increment it whenever
+ * a change of the generator changes its output for the same options.
+ */
+static const llvm::StringRef GeneratorVersion = "fgen-generator 1";
+
+/*
+ * The generator options by their name without the "-f" prefix. Every
+ * option in this table is part of the generator key, so an option which
+ * changes the generated code only needs to be added here.
+ */
+static const struct {
+    llvm::StringRef Name;
+    bool (FGenConfiguration::*Get)() const;
+    void (FGenConfiguration::*Set)(bool);
+} GeneratorOptions[] = {
+    { "accessors", &FGenConfiguration::implementAccessors,
+      &FGenConfiguration::setImplementAccessors },
+    { "conversions", &FGenConfiguration::implementConversions,
+      &FGenConfiguration::setImplemenConversions },
+    { "stubs", &FGenConfiguration::implementStubs,
+      &FGenConfiguration::setImplementStubs },
+    { "move", &FGenConfiguration::allowMove,
+      &FGenConfiguration::setAllowMove },
+    { "namespace-definitions", &FGenConfiguration::namespaceDefinitions,
+      &FGenConfiguration::setNamespaceDefinitions },
+    { "trim", &FGenConfiguration::trimOutput,
+      &FGenConfiguration::setTrimOutput },
+};
+
+FGenConfiguration::FGenConfiguration()
+    : AllowMove_(true),
+      ImplementAccessors_(true),
+      ImplementConversions_(true),
+      ImplementStubs_(true),
+      TrimOutput_(false),
+      NamespaceDefinitions_(true),
+      WriteIfChanged_(false),
+      PairedHeaders_(false),
+      ChangedOnly_(false),
+      GeneratorJobs_(1),
+      DeclCacheDirectory_(),
+      IRDirectory_(),
+      OutputFile_(),
+      PatchFile_(),
+      PatchHeaders_(),
+      RangeFile_(),
+      RangeBegin_(),
+      RangeEnd_(),
+      ProjectUSRs_(),
+      Targets_()
+{
+    /*
+     * The defaults of the command line options, the compiler plugin and
+     * the benchmark are taken from here.
+     */
+}
+
 void FGenConfiguration::setAllowMove(bool Value)
 {
     AllowMove_ = Value;
@@ -79,6 +137,91 @@ bool FGenConfiguration::namespaceDefinitions() const
     return NamespaceDefinitions_;
 }
 
+bool FGenConfiguration::setGeneratorOption(llvm::StringRef Name, bool Value)
+{
+    for (const auto &Option : GeneratorOptions) {
+        if (Option.Name == Name) {
+            (this->*Option.Set)(Value);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::string FGenConfiguration::generatorKey() const
+{
+    auto Key = GeneratorVersion.str();
+
+    for (const auto &Option : GeneratorOptions) {
+        Key += ' ';
+        Key += ((this->*Option.Get)()) ? "" : "no-";
+        Key += Option.Name.str();
+    }
+
+    return Key;
+}
+
+void FGenConfiguration::setWriteIfChanged(bool Value)
+{
+    WriteIfChanged_ = Value;
+}
+
+bool FGenConfiguration::writeIfChanged() const
+{
+    return WriteIfChanged_;
+}
+
+void FGenConfiguration::setPairedHeaders(bool Value)
+{
+    PairedHeaders_ = Value;
+}
+
+bool FGenConfiguration::pairedHeaders() const
+{
+    return PairedHeaders_;
+}
+
+void FGenConfiguration::setGeneratorJobs(unsigned int Jobs)
+{
+    GeneratorJobs_ = (Jobs) ? Jobs : 1;
+}
+
+unsigned int FGenConfiguration::generatorJobs() const
+{
+    return GeneratorJobs_;
+}
+
+void FGenConfiguration::setDeclCacheDirectory(std::string Directory)
+{
+    DeclCacheDirectory_ = std::move(Directory);
+}
+
+const std::string &FGenConfiguration::declCacheDirectory() const
+{
+    return DeclCacheDirectory_;
+}
+
+void FGenConfiguration::setChangedOnly(bool Value)
+{
+    ChangedOnly_ = Value;
+}
+
+bool FGenConfiguration::changedOnly() const
+{
+    return ChangedOnly_;
+}
+
+void FGenConfiguration::setIRDirectory(std::string Directory)
+{
+    IRDirectory_ = std::move(Directory);
+}
+
+const std::string &FGenConfiguration::irDirectory() const
+{
+    return IRDirectory_;
+}
+
 void FGenConfiguration::setOutputFile(std::string File)
 {
     OutputFile_ = std::move(File);
@@ -89,6 +232,63 @@ const std::string &FGenConfiguration::outputFile() const
     return OutputFile_;
 }
 
+void FGenConfiguration::setPatchFile(std::string File)
+{
+    PatchFile_ = std::move(File);
+}
+
+const std::string &FGenConfiguration::patchFile() const
+{
+    return PatchFile_;
+}
+
+std::vector<std::string> &FGenConfiguration::patchHeaders()
+{
+    return PatchHeaders_;
+}
+
+const std::vector<std::string> &FGenConfiguration::patchHeaders() const
+{
+    return PatchHeaders_;
+}
+
+void FGenConfiguration::setRange(std::string File, Location Begin, Location End)
+{
+    RangeFile_ = std::move(File);
+    RangeBegin_ = Begin;
+    RangeEnd_ = End;
+}
+
+bool FGenConfiguration::hasRange() const
+{
+    return !RangeFile_.empty();
+}
+
+const std::string &FGenConfiguration::rangeFile() const
+{
+    return RangeFile_;
+}
+
+const FGenConfiguration::Location &FGenConfiguration::rangeBegin() const
+{
+    return RangeBegin_;
+}
+
+const FGenConfiguration::Location &FGenConfiguration::rangeEnd() const
+{
+    return RangeEnd_;
+}
+
+FGenConfiguration::USRMap &FGenConfiguration::projectUSRs()
+{
+    return ProjectUSRs_;
+}
+
+const FGenConfiguration::USRMap &FGenConfiguration::projectUSRs() const
+{
+    return ProjectUSRs_;
+}
+
 std::vector<std::string> &FGenConfiguration::targets()
 {
     return Targets_;
@@ -19,11 +19,20 @@
 #define FGEN_FGENCONFIGURATION_HPP_
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/StringSet.h>
+
 class FGenConfiguration {
 public:
-    FGenConfiguration() = default;
+    struct Location {
+        unsigned int Line;
+        unsigned int Column;
+    };
+
+    FGenConfiguration();
 
     void setAllowMove(bool Value);
     bool allowMove() const;
@@ -43,9 +52,47 @@ public:
     void setNamespaceDefinitions(bool Value);
     bool namespaceDefinitions() const;
 
+    bool setGeneratorOption(llvm::StringRef Name, bool Value);
+    std::string generatorKey() const;
+
+    void setWriteIfChanged(bool Value);
+    bool writeIfChanged() const;
+
+    void setPairedHeaders(bool Value);
+    bool pairedHeaders() const;
+
+    void setGeneratorJobs(unsigned int Jobs);
+    unsigned int generatorJobs() const;
+
+    void setDeclCacheDirectory(std::string Directory);
+    const std::string &declCacheDirectory() const;
+
+    void setChangedOnly(bool Value);
+    bool changedOnly() const;
+
+    void setIRDirectory(std::string Directory);
+    const std::string &irDirectory() const;
+
     void setOutputFile(std::string File);
     const std::string &outputFile() const;
 
+    void setPatchFile(std::string File);
+    const std::string &patchFile() const;
+
+    std::vector<std::string> &patchHeaders();
+    const std::vector<std::string> &patchHeaders() const;
+
+    void setRange(std::string File, Location Begin, Location End);
+    bool hasRange() const;
+    const std::string &rangeFile() const;
+    const Location &rangeBegin() const;
+    const Location &rangeEnd() const;
+
+    using USRMap = std::unordered_map<std::string, llvm::StringSet<>>;
+
+    USRMap &projectUSRs();
+    const USRMap &projectUSRs() const;
+
     std::vector<std::string> &targets();
     const std::vector<std::string> &targets() const;
 
@@ -56,8 +103,21 @@ private:
     unsigned int ImplementStubs_ : 1;
     unsigned int TrimOutput_ : 1;
     unsigned int NamespaceDefinitions_ : 1;
+    unsigned int WriteIfChanged_ : 1;
+    unsigned int PairedHeaders_ : 1;
+    unsigned int ChangedOnly_ : 1;
+    unsigned int GeneratorJobs_;
+
+    std::string DeclCacheDirectory_;
+    std::string IRDirectory_;
 
     std::string OutputFile_;
+    std::string PatchFile_;
+    std::vector<std::string> PatchHeaders_;
+    std::string RangeFile_;
+    Location RangeBegin_;
+    Location RangeEnd_;
+    USRMap ProjectUSRs_;
     std::vector<std::string> Targets_;
 };
 
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <map>
+#include <tuple>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
+#include <util/File.hpp>
+
+#include <FGenDeclCache.hpp>
+
+static const llvm::StringRef DeclCacheMagic = "fgen-decls 1";
+
+std::string FGenDeclCache::getPath(llvm::StringRef Directory,
+                                   llvm::StringRef File,
+                                   const FGenConfiguration &Configuration)
+{
+    /*
+     * The same declarations render differently with different
+     * generator options, so every combination gets a cache of its own.
+     */
+    auto Key = File.str() + '\0' + Configuration.generatorKey();
+    auto Hash = llvm::xxHash64(Key);
+
+    llvm::SmallString<256> Path(Directory);
+    llvm::sys::path::append(Path, llvm::utohexstr(Hash) + ".decls");
+
+    return Path.str().str();
+}
+
+bool FGenDeclCache::load(llvm::StringRef File, std::string &ErrMsg)
+{
+    auto Buffer = llvm::MemoryBuffer::getFile(File);
+    if (!Buffer) {
+        /* Everything gets rendered on the very first run */
+        if (Buffer.getError() == std::errc::no_such_file_or_directory)
+            return true;
+
+        ErrMsg = Buffer.getError().message();
+        return false;
+    }
+
+    auto Content = (*Buffer)->getBuffer();
+
+    llvm::StringRef Line;
+    std::tie(Line, Content) = Content.split('\n');
+
+    if (Line != DeclCacheMagic) {
+        ErrMsg = "invalid declaration cache";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    /*
+     * Every entry starts with a line holding the hash and the sizes of
+     * its parts. Definitions span multiple lines, so they are read by
+     * their size.
+     */
+    while (!Content.empty()) {
+        llvm::SmallVector<llvm::StringRef, 4> Fields;
+
+        std::tie(Line, Content) = Content.split('\n');
+        Line.split(Fields, ' ');
+
+        uint64_t Hash, USRSize, Size, NumIncludes;
+
+        bool Ok = Fields.size() == 4 && !Fields[0].getAsInteger(16, Hash) &&
+                  !Fields[1].getAsInteger(10, USRSize) &&
+                  !Fields[2].getAsInteger(10, Size) &&
+                  !Fields[3].getAsInteger(10, NumIncludes) &&
+                  Content.size() >= USRSize + Size + 2;
+
+        if (!Ok) {
+            Entries_.clear();
+            ErrMsg = "invalid declaration cache";
+            return false;
+        }
+
+        auto USR = Content.substr(0, USRSize);
+        auto &Entry = Entries_[USR.str()];
+
+        Entry.Hash = Hash;
+        Entry.Definition = Content.substr(USRSize + 1, Size).str();
+
+        Content = Content.drop_front(USRSize + 1 + Size + 1);
+
+        while (NumIncludes--) {
+            std::tie(Line, Content) = Content.split('\n');
+            Entry.Includes.push_back(Line.str());
+        }
+    }
+
+    return true;
+}
+
+bool FGenDeclCache::save(llvm::StringRef File, std::string &ErrMsg) const
+{
+    std::string Content;
+    llvm::raw_string_ostream OS(Content);
+
+    OS << DeclCacheMagic << "\n";
+
+    {
+        std::lock_guard<std::mutex> Lock(Mutex_);
+
+        /* Sorted, so an unchanged cache is written byte by byte again */
+        std::map<llvm::StringRef, const Entry *> Sorted;
+
+        for (const auto &Pair : Used_)
+            Sorted.emplace(Pair.first, &Pair.second);
+
+        for (const auto &Pair : Sorted) {
+            const auto &Entry = *Pair.second;
+
+            OS << llvm::utohexstr(Entry.Hash) << " " << Pair.first.size()
+               << " " << Entry.Definition.size() << " "
+               << Entry.Includes.size() << "\n";
+            OS << Pair.first << "\n" << Entry.Definition << "\n";
+
+            for (const auto &Include : Entry.Includes)
+                OS << Include << "\n";
+        }
+    }
+
+    OS.flush();
+
+    return util::file::writeAtomic(File, Content, ErrMsg);
+}
+
+bool FGenDeclCache::lookup(const std::string &USR,
+                           uint64_t Hash,
+                           Entry &Result)
+{
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    auto It = Entries_.find(USR);
+    if (It == Entries_.end() || It->second.Hash != Hash)
+        return false;
+
+    Result = It->second;
+    Used_[USR] = It->second;
+
+    return true;
+}
+
+void FGenDeclCache::insert(const std::string &USR,
+                           uint64_t Hash,
+                           llvm::StringRef Definition,
+                           llvm::ArrayRef<llvm::StringRef> Includes)
+{
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    auto &Entry = Used_[USR];
+
+    Entry.Hash = Hash;
+    Entry.Definition = Definition.str();
+    Entry.Includes.assign(Includes.begin(), Includes.end());
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FGEN_FGENDECLCACHE_HPP_
+#define FGEN_FGENDECLCACHE_HPP_
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <FGenConfiguration.hpp>
+
+/*
+ * Keeps the rendered definitions of the functions declared in an input
+ * file between runs. Every definition is stored under the USR of its
+ * declaration together with a hash of everything it was rendered from.
+ * If the hash did not change, the generator reuses the definition
+ * instead of rendering it again.
+ *
+ * A cache only holds the definitions looked up or inserted during the
+ * current run, so definitions of removed declarations are dropped once
+ * the cache is saved. Generators working on chunks of the same input
+ * file may share a cache.
+ */
+
+class FGenDeclCache {
+public:
+    struct Entry {
+        uint64_t Hash;
+        std::string Definition;
+        std::vector<std::string> Includes;
+    };
+
+    FGenDeclCache() = default;
+
+    static std::string getPath(llvm::StringRef Directory,
+                               llvm::StringRef File,
+                               const FGenConfiguration &Configuration);
+
+    bool load(llvm::StringRef File, std::string &ErrMsg);
+    bool save(llvm::StringRef File, std::string &ErrMsg) const;
+
+    bool lookup(const std::string &USR, uint64_t Hash, Entry &Result);
+    void insert(const std::string &USR,
+                uint64_t Hash,
+                llvm::StringRef Definition,
+                llvm::ArrayRef<llvm::StringRef> Includes);
+
+private:
+    mutable std::mutex Mutex_;
+    std::unordered_map<std::string, Entry> Entries_;
+    std::unordered_map<std::string, Entry> Used_;
+};
+
+#endif /* FGEN_FGENDECLCACHE_HPP_ */
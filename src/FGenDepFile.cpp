@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <util/File.hpp>
+#include <util/Statistics.hpp>
+
+#include <FGenDepFile.hpp>
+
+static util::stats::Counter NumOutputsUpToDate(
+    "outputs-up-to-date", "Number of outputs newer than their dependencies");
+
+static void writeEscaped(llvm::raw_ostream &OS, llvm::StringRef Path)
+{
+    for (auto Char : Path) {
+        if (Char == ' ' || Char == '#')
+            OS << '\\';
+        else if (Char == '$')
+            OS << '$';
+
+        OS << Char;
+    }
+}
+
+static std::vector<std::string> splitEscaped(llvm::StringRef Line)
+{
+    std::vector<std::string> Words;
+    std::string Word;
+
+    for (size_t i = 0; i < Line.size(); ++i) {
+        auto Char = Line[i];
+        auto Next = (i + 1 < Line.size()) ? Line[i + 1] : '\0';
+
+        if ((Char == '\\' && (Next == ' ' || Next == '#')) ||
+            (Char == '$' && Next == '$')) {
+            Word += Next;
+            ++i;
+        } else if (Char == ' ' || Char == '\t') {
+            if (!Word.empty())
+                Words.push_back(std::move(Word));
+
+            Word.clear();
+        } else {
+            Word += Char;
+        }
+    }
+
+    if (!Word.empty())
+        Words.push_back(std::move(Word));
+
+    return Words;
+}
+
+static bool getModificationTime(const std::string &File,
+                                llvm::sys::TimePoint<> &Time)
+{
+    llvm::sys::fs::file_status Status;
+
+    if (llvm::sys::fs::status(File, Status))
+        return false;
+
+    Time = Status.getLastModificationTime();
+    return true;
+}
+
+bool FGenDepFile::load(llvm::StringRef File, std::string &ErrMsg)
+{
+    auto Buffer = llvm::MemoryBuffer::getFile(File);
+    if (!Buffer) {
+        /* Everything is out of date on the very first run */
+        if (Buffer.getError() == std::errc::no_such_file_or_directory)
+            return true;
+
+        ErrMsg = Buffer.getError().message();
+        return false;
+    }
+
+    /* Rules may be continued on the next line */
+    std::string Content = (*Buffer)->getBuffer().str();
+    std::string Joined;
+    Joined.reserve(Content.size());
+
+    for (size_t i = 0; i < Content.size(); ++i) {
+        if (Content[i] == '\\' && i + 1 < Content.size() &&
+            Content[i + 1] == '\n') {
+            Joined += ' ';
+            ++i;
+        } else {
+            Joined += Content[i];
+        }
+    }
+
+    llvm::SmallVector<llvm::StringRef, 0> Lines;
+    llvm::StringRef(Joined).split(Lines, '\n', -1, false);
+
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    for (auto Line : Lines) {
+        auto Words = splitEscaped(Line);
+
+        if (Words.empty() || Words[0].back() != ':') {
+            Rules_.clear();
+            ErrMsg = "invalid dependency file";
+            return false;
+        }
+
+        /* Rules without dependencies only keep make from failing */
+        if (Words.size() == 1)
+            continue;
+
+        auto &Rule = Rules_[Words[0].substr(0, Words[0].size() - 1)];
+        Rule.insert(std::next(Words.begin()), Words.end());
+    }
+
+    Path_ = File.str();
+
+    return true;
+}
+
+bool FGenDepFile::save(llvm::StringRef File, std::string &ErrMsg) const
+{
+    std::string Content;
+    llvm::raw_string_ostream OS(Content);
+    std::set<std::string> Dependencies;
+
+    {
+        std::lock_guard<std::mutex> Lock(Mutex_);
+
+        for (const auto &Rule : Rules_) {
+            writeEscaped(OS, Rule.first);
+            OS << ":";
+
+            for (const auto &Dependency : Rule.second) {
+                OS << " \\\n  ";
+                writeEscaped(OS, Dependency);
+
+                Dependencies.insert(Dependency);
+            }
+
+            OS << "\n";
+        }
+    }
+
+    /*
+     * Like "-MP" of the compilers, add an empty rule for every
+     * dependency. Make would otherwise fail on a deleted header instead
+     * of generating the output again.
+     */
+    for (const auto &Dependency : Dependencies) {
+        OS << "\n";
+        writeEscaped(OS, Dependency);
+        OS << ":\n";
+    }
+
+    OS.flush();
+
+    return util::file::writeAtomic(File, Content, ErrMsg);
+}
+
+void FGenDepFile::insert(const std::string &File,
+                         std::vector<std::string> Dependencies)
+{
+    /*
+     * Files only existing in memory, e.g. the prelude of the fast C
+     * mode, cannot be prerequisites of a make rule.
+     */
+    const auto IsMissing = [](const std::string &Dependency) {
+        return !llvm::sys::fs::exists(Dependency);
+    };
+
+    auto End = std::remove_if(Dependencies.begin(), Dependencies.end(),
+                              IsMissing);
+    Dependencies.erase(End, Dependencies.end());
+
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    Files_[File] = std::move(Dependencies);
+}
+
+void FGenDepFile::addRule(const std::string &Target, const std::string &File)
+{
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    /* Inputs skipped by this run keep the rules of the previous run */
+    auto It = Files_.find(File);
+    if (It == Files_.end())
+        return;
+
+    auto &Rule = Rules_[Target];
+
+    if (Updated_.insert(Target).second)
+        Rule.clear();
+
+    Rule.insert(It->second.begin(), It->second.end());
+}
+
+bool FGenDepFile::isUpToDate(const std::string &Target,
+                             bool WriteIfChanged) const
+{
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    auto It = Rules_.find(Target);
+    if (It == Rules_.end())
+        return false;
+
+    llvm::sys::TimePoint<> TargetTime;
+    llvm::sys::TimePoint<> DepFileTime;
+
+    if (!getModificationTime(Target, TargetTime))
+        return false;
+
+    /*
+     * With "-write-if-changed" an output keeps its old modification
+     * time if its content did not change. The dependency file is
+     * written at the end of every run, which makes it the more recent
+     * point in time at which the output was known to be up to date.
+     * Any other output is rewritten by every run and the dependency
+     * file tells nothing about it.
+     */
+    if (WriteIfChanged && getModificationTime(Path_, DepFileTime))
+        TargetTime = std::max(TargetTime, DepFileTime);
+
+    for (const auto &Dependency : It->second) {
+        llvm::sys::TimePoint<> Time;
+
+        if (!getModificationTime(Dependency, Time) || Time > TargetTime)
+            return false;
+    }
+
+    ++NumOutputsUpToDate;
+
+    return true;
+}
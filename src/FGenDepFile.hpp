@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FGEN_FGENDEPFILE_HPP_
+#define FGEN_FGENDEPFILE_HPP_
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/ADT/StringRef.h>
+
+/*
+ * Makefile style dependency file of the generated outputs, like the
+ * ones written by compilers with "-MD". The frontend actions record the
+ * include closure of every parsed input file, possibly from multiple
+ * threads at once. Afterwards, every output file gets a rule listing
+ * the closures of the input files it was generated from.
+ *
+ * The rules of a previous run tell whether an output is up to date, i.e.
+ * whether it is newer than every file its input depended on back then.
+ */
+
+class FGenDepFile {
+public:
+    FGenDepFile() = default;
+
+    bool load(llvm::StringRef File, std::string &ErrMsg);
+    bool save(llvm::StringRef File, std::string &ErrMsg) const;
+
+    void insert(const std::string &File,
+                std::vector<std::string> Dependencies);
+
+    void addRule(const std::string &Target, const std::string &File);
+    bool isUpToDate(const std::string &Target, bool WriteIfChanged) const;
+
+private:
+    mutable std::mutex Mutex_;
+    std::unordered_map<std::string, std::vector<std::string>> Files_;
+    std::map<std::string, std::set<std::string>> Rules_;
+    std::set<std::string> Updated_;
+    std::string Path_;
+};
+
+#endif /* FGEN_FGENDEPFILE_HPP_ */
@@ -0,0 +1,555 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Basic/DiagnosticIDs.h>
+#include <clang/Basic/FileManager.h>
+#include <clang/Basic/LangOptions.h>
+#include <clang/Lex/Lexer.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/VirtualFileSystem.h>
+
+#include <util/CommandLine.hpp>
+#include <util/Statistics.hpp>
+
+#include <FGenFastCRunner.hpp>
+
+static util::stats::Counter NumFastCFiles(
+    "fast-c-files", "Number of input files parsed without includes");
+static util::stats::Counter NumOpaqueTypes(
+    "fast-c-opaque-types", "Number of unknown types declared as opaque");
+static util::stats::Counter NumEmptyMacros(
+    "fast-c-empty-macros", "Number of unknown names defined as empty macros");
+
+static const char *const Keywords[] = {
+    "_Alignas", "_Alignof", "_Atomic", "_Bool", "_Complex", "_Generic",
+    "_Imaginary", "_Noreturn", "_Static_assert", "_Thread_local", "__asm",
+    "__asm__", "__attribute__", "__const", "__const__", "__extension__",
+    "__inline", "__inline__", "__restrict", "__restrict__", "__signed",
+    "__signed__", "__typeof", "__typeof__", "__volatile", "__volatile__",
+    "asm", "auto", "break", "case", "char", "const", "continue", "default",
+    "do", "double", "else", "enum", "extern", "float", "for", "goto", "if",
+    "inline", "int", "long", "register", "restrict", "return", "short",
+    "signed", "sizeof", "static", "struct", "switch", "typedef", "typeof",
+    "union", "unsigned", "void", "volatile", "while",
+};
+
+/* Keywords which may follow the name of a declarator */
+static const char *const TrailingKeywords[] = {
+    "__asm", "__asm__", "__attribute__", "asm",
+};
+
+/* Directives which need files or conditions unknown to this mode */
+static const char *const BlankedDirectives[] = {
+    "error", "import", "include", "include_next",
+};
+
+/*
+ * Common library types which are usually declared by system headers.
+ * Declaring them with their actual type allows the generator to treat
+ * them like any other integer type, e.g. when writing stubs.
+ */
+static const std::pair<const char *, const char *> KnownTypes[] = {
+    { "bool", "_Bool" },
+    { "int16_t", "short" },
+    { "int32_t", "int" },
+    { "int64_t", "long long" },
+    { "int8_t", "signed char" },
+    { "intptr_t", "long" },
+    { "off_t", "long" },
+    { "ptrdiff_t", "long" },
+    { "size_t", "unsigned long" },
+    { "ssize_t", "long" },
+    { "uint16_t", "unsigned short" },
+    { "uint32_t", "unsigned int" },
+    { "uint64_t", "unsigned long long" },
+    { "uint8_t", "unsigned char" },
+    { "uintptr_t", "unsigned long" },
+    { "va_list", "__builtin_va_list" },
+    { "wchar_t", "int" },
+};
+
+template <size_t N>
+static bool contains(const char *const (&Words)[N], llvm::StringRef Word)
+{
+    for (const auto Entry : Words) {
+        if (Word == Entry)
+            return true;
+    }
+
+    return false;
+}
+
+static const char *getKnownType(llvm::StringRef Name)
+{
+    for (const auto &Entry : KnownTypes) {
+        if (Name == Entry.first)
+            return Entry.second;
+    }
+
+    return nullptr;
+}
+
+static bool isIdentifierChar(char Char)
+{
+    return llvm::isAlnum(Char) || Char == '_';
+}
+
+static bool isKeyword(const clang::Token &Token)
+{
+    return Token.is(clang::tok::raw_identifier) &&
+           contains(Keywords, Token.getRawIdentifier());
+}
+
+static bool isName(const clang::Token &Token)
+{
+    return Token.is(clang::tok::raw_identifier) &&
+           !contains(Keywords, Token.getRawIdentifier());
+}
+
+static bool isTagKeyword(const clang::Token &Token)
+{
+    if (!Token.is(clang::tok::raw_identifier))
+        return false;
+
+    auto Word = Token.getRawIdentifier();
+
+    return Word == "struct" || Word == "union" || Word == "enum";
+}
+
+/*
+ * Wrong guesses of the prelude only invalidate single declarations.
+ * Reporting them would bury the user in errors about code which compiles
+ * just fine with its actual compile command. Only the errors of the
+ * generator itself, e.g. failed writes, are custom diagnostics and get
+ * reported.
+ */
+class FGenFastCDiagConsumer : public clang::DiagnosticConsumer {
+public:
+    FGenFastCDiagConsumer();
+
+    virtual void HandleDiagnostic(clang::DiagnosticsEngine::Level Level,
+                                  const clang::Diagnostic &Info) override;
+
+    bool failed() const;
+
+private:
+    bool Failed_;
+};
+
+FGenFastCDiagConsumer::FGenFastCDiagConsumer() : Failed_(false)
+{
+}
+
+void FGenFastCDiagConsumer::HandleDiagnostic(
+    clang::DiagnosticsEngine::Level Level, const clang::Diagnostic &Info)
+{
+    if (Level < clang::DiagnosticsEngine::Error)
+        return;
+
+    if (clang::DiagnosticIDs::isBuiltinDiag(Info.getID()))
+        return;
+
+    llvm::SmallString<128> Msg;
+    Info.FormatDiagnostic(Msg);
+
+    util::cl::error() << Msg << "\n";
+    Failed_ = true;
+}
+
+bool FGenFastCDiagConsumer::failed() const
+{
+    return Failed_;
+}
+
+static bool isBlankedDirective(llvm::StringRef Line)
+{
+    auto Directive = Line.ltrim();
+    if (!Directive.consume_front("#"))
+        return false;
+
+    auto Name = Directive.ltrim().take_while(isIdentifierChar);
+
+    return contains(BlankedDirectives, Name);
+}
+
+FGenFastCRunner::FGenFastCRunner(clang::tooling::FrontendActionFactory &Factory,
+                                 unsigned int Jobs)
+    : Factory_(Factory), Jobs_(std::max(Jobs, 1u))
+{
+}
+
+int FGenFastCRunner::run(llvm::ArrayRef<std::string> Files)
+{
+    size_t Next = 0;
+
+    const auto NextFile = [Files, &Next](std::string &File) {
+        if (Next >= Files.size())
+            return false;
+
+        File = Files[Next++];
+        return true;
+    };
+
+    return run(NextFile);
+}
+
+int FGenFastCRunner::run(const std::function<bool(std::string &)> &NextFile)
+{
+    std::mutex Mutex;
+    std::atomic<int> Result(EXIT_SUCCESS);
+
+    const auto Work = [this, &NextFile, &Mutex, &Result]() {
+        std::string File;
+
+        while (true) {
+            {
+                std::lock_guard<std::mutex> Lock(Mutex);
+
+                if (!NextFile(File))
+                    break;
+            }
+
+            if (runFile(File))
+                ++NumFastCFiles;
+            else
+                Result.store(EXIT_FAILURE);
+        }
+    };
+
+    if (Jobs_ == 1) {
+        Work();
+        return Result.load();
+    }
+
+    std::vector<std::thread> Threads;
+    Threads.reserve(Jobs_);
+
+    for (size_t i = 0; i < Jobs_; ++i)
+        Threads.emplace_back(Work);
+
+    for (auto &Thread : Threads)
+        Thread.join();
+
+    return Result.load();
+}
+
+bool FGenFastCRunner::runFile(const std::string &File)
+{
+    auto Buffer = llvm::MemoryBuffer::getFile(File);
+    if (!Buffer) {
+        util::cl::error() << "fgen: failed to read \"" << File << "\" - "
+                          << Buffer.getError().message() << "\n";
+        return false;
+    }
+
+    llvm::SmallString<256> Path(File);
+    llvm::sys::fs::make_absolute(Path);
+
+    auto Content = (*Buffer)->getBuffer();
+    auto PreludePath = (Path + ".fgen-prelude.h").str();
+
+    /*
+     * The modified file replaces the original one under the same name.
+     * This way, all generated locations still refer to the input file.
+     */
+    llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> MemoryFS(
+        new llvm::vfs::InMemoryFileSystem());
+
+    MemoryFS->addFile(Path, 0,
+                      llvm::MemoryBuffer::getMemBufferCopy(getSource(Content),
+                                                           Path));
+    MemoryFS->addFile(PreludePath, 0,
+                      llvm::MemoryBuffer::getMemBufferCopy(getPrelude(Content),
+                                                           PreludePath));
+
+    llvm::IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> FileSystem(
+        new llvm::vfs::OverlayFileSystem(llvm::vfs::getRealFileSystem()));
+
+    FileSystem->pushOverlay(MemoryFS);
+
+    llvm::IntrusiveRefCntPtr<clang::FileManager> FileManager(
+        new clang::FileManager(clang::FileSystemOptions(), FileSystem));
+
+    std::vector<std::string> Args = {
+        "fgen",       "-fsyntax-only", "-x",          "c",
+        "-std=gnu11", "-nostdinc",     "-ferror-limit=0",
+        "-include",   PreludePath,     Path.str().str(),
+    };
+
+    FGenFastCDiagConsumer DiagConsumer;
+
+    clang::tooling::ToolInvocation Invocation(std::move(Args), &Factory_,
+                                              FileManager.get());
+    Invocation.setDiagnosticConsumer(&DiagConsumer);
+
+    /* The parse fails whenever a guess was wrong, which is no error */
+    Invocation.run();
+
+    return !DiagConsumer.failed();
+}
+
+std::string FGenFastCRunner::getSource(llvm::StringRef Content)
+{
+    /*
+     * Included files are either unavailable or only needed for a few
+     * type names. Their directives are blanked out, but all line breaks
+     * are kept to preserve the locations of the remaining declarations.
+     */
+    std::string Source;
+    Source.reserve(Content.size());
+
+    bool Blank = false;
+    bool Continued = false;
+
+    while (true) {
+        auto End = Content.find('\n');
+        auto Line = Content.take_front(End);
+
+        if (!Continued)
+            Blank = isBlankedDirective(Line);
+
+        if (!Blank)
+            Source += Line;
+
+        Continued = Line.rtrim('\r').endswith("\\");
+
+        if (End == llvm::StringRef::npos)
+            break;
+
+        Source += '\n';
+        Content = Content.drop_front(End + 1);
+    }
+
+    return Source;
+}
+
+std::string FGenFastCRunner::getPrelude(llvm::StringRef Content)
+{
+    clang::LangOptions LangOpts;
+    LangOpts.C99 = true;
+    LangOpts.C11 = true;
+    LangOpts.GNUMode = true;
+    LangOpts.LineComment = true;
+
+    clang::Lexer Lexer(clang::SourceLocation(), LangOpts, Content.begin(),
+                       Content.begin(), Content.end());
+
+    /* Sorted sets keep the prelude independent of the lexing order */
+    std::set<std::string> Types;
+    std::set<std::string> Macros;
+    llvm::StringSet<> Defined;
+
+    std::vector<llvm::StringRef> Run;
+    clang::Token RunPrev;
+    clang::Token Prev;
+    clang::Token Token;
+
+    RunPrev.startToken();
+    Prev.startToken();
+
+    unsigned int Braces = 0;
+    unsigned int Parens = 0;
+    unsigned int BodyBraces = 0;
+    unsigned int TypedefBraces = 0;
+    bool InTypedef = false;
+    bool InDirective = false;
+    bool InDefine = false;
+
+    /*
+     * Declarations are sequences of names and keywords. Within a run of
+     * consecutive names, the last one usually names the declarator and
+     * the one before names its type. Any further names in front of them
+     * are most likely macros expanding to attributes or nothing at all.
+     */
+    const auto Finish = [&](const clang::Token &Next) {
+        if (Run.empty())
+            return;
+
+        size_t Begin = (isTagKeyword(RunPrev)) ? 1 : 0;
+        size_t End = Run.size();
+
+        const auto AddMacros = [&](size_t First, size_t Last) {
+            for (size_t i = First; i < Last; ++i)
+                Macros.insert(Run[i].str());
+        };
+
+        if (RunPrev.is(clang::tok::r_paren) && !Parens) {
+            /* Annotations after a parameter list, e.g. "NOEXCEPT" */
+            AddMacros(Begin, End);
+        } else if (isKeyword(Next) &&
+                   !contains(TrailingKeywords, Next.getRawIdentifier())) {
+            AddMacros(Begin, End);
+        } else if (Next.is(clang::tok::star)) {
+            if (End > Begin) {
+                Types.insert(Run[End - 1].str());
+                AddMacros(Begin, End - 1);
+            }
+        } else if (End - Begin == 1 && Parens &&
+                   RunPrev.isOneOf(clang::tok::l_paren, clang::tok::comma) &&
+                   Next.isOneOf(clang::tok::r_paren, clang::tok::comma)) {
+            /* Unnamed parameter */
+            Types.insert(Run[Begin].str());
+        } else if (End - Begin >= 2) {
+            Types.insert(Run[End - 2].str());
+            AddMacros(Begin, End - 2);
+        }
+
+        bool IsDeclarator = Next.isOneOf(clang::tok::semi, clang::tok::comma,
+                                         clang::tok::r_paren,
+                                         clang::tok::l_square);
+
+        if (InTypedef && IsDeclarator)
+            Defined.insert(Run.back());
+
+        Run.clear();
+    };
+
+    while (true) {
+        Lexer.LexFromRawLexer(Token);
+
+        /* Declarations may span lines, directives may not */
+        if (Token.isAtStartOfLine()) {
+            InDirective = Token.is(clang::tok::hash);
+            InDefine = false;
+
+            if (InDirective)
+                Finish(Token);
+        }
+
+        if (Token.is(clang::tok::eof)) {
+            Finish(Token);
+            break;
+        }
+
+        if (InDirective) {
+            if (Token.is(clang::tok::raw_identifier)) {
+                auto Name = Token.getRawIdentifier();
+
+                if (InDefine)
+                    Defined.insert(Name);
+
+                InDefine = !InDefine && Name == "define";
+            }
+
+            continue;
+        }
+
+        /* Function bodies declare nothing of interest */
+        if (BodyBraces) {
+            if (Token.is(clang::tok::l_brace))
+                ++BodyBraces;
+            else if (Token.is(clang::tok::r_brace))
+                --BodyBraces;
+
+            continue;
+        }
+
+        if (isName(Token)) {
+            if (Run.empty())
+                RunPrev = Prev;
+
+            Run.push_back(Token.getRawIdentifier());
+            Prev = Token;
+            continue;
+        }
+
+        Finish(Token);
+
+        switch (Token.getKind()) {
+        case clang::tok::l_brace:
+            if (Prev.is(clang::tok::r_paren))
+                BodyBraces = 1;
+            else
+                ++Braces;
+            break;
+        case clang::tok::r_brace:
+            if (Braces)
+                --Braces;
+            break;
+        case clang::tok::l_paren:
+            ++Parens;
+            break;
+        case clang::tok::r_paren:
+            if (Parens)
+                --Parens;
+            break;
+        case clang::tok::semi:
+            if (InTypedef && Braces == TypedefBraces)
+                InTypedef = false;
+            break;
+        default:
+            if (!InTypedef && Token.is(clang::tok::raw_identifier) &&
+                Token.getRawIdentifier() == "typedef") {
+                InTypedef = true;
+                TypedefBraces = Braces;
+            }
+            break;
+        }
+
+        Prev = Token;
+    }
+
+    std::string Prelude;
+
+    for (const auto &Name : Macros) {
+        if (Defined.count(Name))
+            continue;
+
+        Prelude += "#define " + Name + "\n";
+        ++NumEmptyMacros;
+    }
+
+    /*
+     * Opaque types are complete structures. Fields and parameters of
+     * these types stay valid and can still be matched by the accessor
+     * strategies, but no stub ever makes up a value for them.
+     */
+    for (const auto &Name : Types) {
+        llvm::StringRef Ref(Name);
+
+        if (Defined.count(Name) || Macros.count(Name) ||
+            Ref.startswith("__builtin"))
+            continue;
+
+        auto KnownType = getKnownType(Ref);
+        if (KnownType) {
+            Prelude += "typedef " + std::string(KnownType) + " " + Name + ";\n";
+            continue;
+        }
+
+        Prelude += "typedef struct fgen_opaque_" + Name +
+                   " { char fgen_opaque_; } " + Name + ";\n";
+        ++NumOpaqueTypes;
+    }
+
+    return Prelude;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FGEN_FGENFASTCRUNNER_HPP_
+#define FGEN_FGENFASTCRUNNER_HPP_
+
+#include <functional>
+#include <string>
+
+#include <clang/Tooling/Tooling.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+
+/*
+ * Runs a 'FrontendActionFactory' on C files without a compile command.
+ * The includes of a file are removed and a short prelude declares every
+ * name which the file seems to use as a type without defining it. These
+ * names become opaque structures, names which seem to be annotation
+ * macros expand to nothing. Parsing a file then only costs the file
+ * itself and the generator works on an approximate, but mostly complete
+ * AST. Errors caused by wrong guesses are not reported. Up to 'Jobs'
+ * files are parsed in parallel.
+ */
+
+class FGenFastCRunner {
+public:
+    explicit FGenFastCRunner(clang::tooling::FrontendActionFactory &Factory,
+                             unsigned int Jobs = 1);
+
+    int run(llvm::ArrayRef<std::string> Files);
+    int run(const std::function<bool(std::string &)> &NextFile);
+
+private:
+    bool runFile(const std::string &File);
+
+    static std::string getSource(llvm::StringRef Content);
+    static std::string getPrelude(llvm::StringRef Content);
+
+    clang::tooling::FrontendActionFactory &Factory_;
+    unsigned int Jobs_;
+};
+
+#endif /* FGEN_FGENFASTCRUNNER_HPP_ */
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <FGenFileList.hpp>
+
+FGenFileList::FGenFileList() : Files_(), Next_(0)
+{}
+
+bool FGenFileList::open(llvm::StringRef File, std::string &ErrMsg)
+{
+    /* The file name "-" refers to stdin */
+    auto Buffer = llvm::MemoryBuffer::getFileOrSTDIN(File);
+    if (!Buffer) {
+        ErrMsg = Buffer.getError().message();
+        return false;
+    }
+
+    llvm::SmallVector<llvm::StringRef, 0> Lines;
+    (*Buffer)->getBuffer().split(Lines, '\n', -1, false);
+
+    for (auto Line : Lines) {
+        auto Name = Line.trim();
+
+        if (!Name.empty())
+            Files_.push_back(Name.str());
+    }
+
+    return true;
+}
+
+bool FGenFileList::peek(std::string &File)
+{
+    if (Next_ == Files_.size())
+        return false;
+
+    File = Files_[Next_];
+
+    return true;
+}
+
+bool FGenFileList::next(std::string &File)
+{
+    if (!peek(File))
+        return false;
+
+    ++Next_;
+
+    return true;
+}
+
+const std::vector<std::string> &FGenFileList::files() const
+{
+    return Files_;
+}
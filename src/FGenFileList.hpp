@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FGEN_FGENFILELIST_HPP_
+#define FGEN_FGENFILELIST_HPP_
+
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/StringRef.h>
+
+/*
+ * Reads the names of input files from a file or from stdin, one name per
+ * line. The complete list is read when it is opened. The names are then
+ * handed out one at a time and are kept in their original order.
+ */
+
+class FGenFileList {
+public:
+    FGenFileList();
+
+    bool open(llvm::StringRef File, std::string &ErrMsg);
+
+    bool peek(std::string &File);
+    bool next(std::string &File);
+
+    const std::vector<std::string> &files() const;
+
+private:
+    std::vector<std::string> Files_;
+    size_t Next_;
+};
+
+#endif /* FGEN_FGENFILELIST_HPP_ */
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <tuple>
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <util/File.hpp>
+
+#include <FGenHistory.hpp>
+
+static const llvm::StringRef HistoryMagic = "fgen-history 1";
+
+bool FGenHistory::load(llvm::StringRef File, std::string &ErrMsg)
+{
+    auto Buffer = llvm::MemoryBuffer::getFile(File);
+    if (!Buffer) {
+        /* Nothing is known about the files on the very first run. */
+        if (Buffer.getError() == std::errc::no_such_file_or_directory)
+            return true;
+
+        ErrMsg = Buffer.getError().message();
+        return false;
+    }
+
+    llvm::SmallVector<llvm::StringRef, 0> Lines;
+    (*Buffer)->getBuffer().split(Lines, '\n', -1, false);
+
+    if (Lines.empty() || Lines[0] != HistoryMagic) {
+        ErrMsg = "invalid history file";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    for (auto It = std::next(Lines.begin()); It != Lines.end(); ++It) {
+        llvm::StringRef Key, Value, Path;
+        std::tie(Key, Value) = It->split(' ');
+        std::tie(Value, Path) = Value.split(' ');
+
+        uint64_t Number;
+        bool Ok = !Path.empty() && !Value.getAsInteger(10, Number);
+
+        if (Ok && Key == "mem")
+            Entries_[Path.str()].Memory = Number;
+        else if (Ok && Key == "time")
+            Entries_[Path.str()].Duration = Number;
+        else
+            Ok = false;
+
+        /* The history is only a hint, an empty one does no harm */
+        if (!Ok) {
+            Entries_.clear();
+            ErrMsg = "invalid history file";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool FGenHistory::save(llvm::StringRef File, std::string &ErrMsg) const
+{
+    std::string Content;
+    llvm::raw_string_ostream OS(Content);
+
+    OS << HistoryMagic << "\n";
+
+    {
+        std::lock_guard<std::mutex> Lock(Mutex_);
+
+        for (const auto &Pair : Entries_) {
+            const auto &Entry = Pair.second;
+
+            if (Entry.Memory)
+                OS << "mem " << Entry.Memory << " " << Pair.first << "\n";
+
+            if (Entry.Duration)
+                OS << "time " << Entry.Duration << " " << Pair.first << "\n";
+        }
+    }
+
+    OS.flush();
+
+    return util::file::writeAtomic(File, Content, ErrMsg);
+}
+
+void FGenHistory::setMemory(const std::string &File, uint64_t Bytes)
+{
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    Entries_[File].Memory = Bytes;
+}
+
+uint64_t FGenHistory::memory(const std::string &File) const
+{
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    auto It = Entries_.find(File);
+    if (It == Entries_.end())
+        return 0;
+
+    return It->second.Memory;
+}
+
+void FGenHistory::setDuration(const std::string &File, uint64_t Us)
+{
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    Entries_[File].Duration = Us;
+}
+
+uint64_t FGenHistory::duration(const std::string &File) const
+{
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    auto It = Entries_.find(File);
+    if (It == Entries_.end())
+        return 0;
+
+    return It->second.Duration;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FGEN_FGENHISTORY_HPP_
+#define FGEN_FGENHISTORY_HPP_
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <llvm/ADT/StringRef.h>
+
+/*
+ * Persistent record of the resources the translation units needed when
+ * they were processed the last time. The scheduler uses these values
+ * to predict the cost of the next run. Files are identified by their
+ * real path and may be updated concurrently from multiple threads.
+ */
+
+class FGenHistory {
+public:
+    FGenHistory() = default;
+
+    bool load(llvm::StringRef File, std::string &ErrMsg);
+    bool save(llvm::StringRef File, std::string &ErrMsg) const;
+
+    void setMemory(const std::string &File, uint64_t Bytes);
+    uint64_t memory(const std::string &File) const;
+
+    void setDuration(const std::string &File, uint64_t Us);
+    uint64_t duration(const std::string &File) const;
+
+private:
+    struct Entry {
+        uint64_t Memory = 0;
+        uint64_t Duration = 0;
+    };
+
+    mutable std::mutex Mutex_;
+    std::map<std::string, Entry> Entries_;
+};
+
+#endif /* FGEN_FGENHISTORY_HPP_ */
@@ -0,0 +1,468 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <chrono>
+#include <tuple>
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/xxhash.h>
+
+#include <util/File.hpp>
+
+#include <FGenIR.hpp>
+
+static const llvm::StringRef IRMagic = "fgen-ir 1";
+
+/* Strings of an entry are separated by a newline to keep the file legible */
+static bool readString(llvm::StringRef &Content,
+                       uint64_t Size,
+                       llvm::StringRef &Result)
+{
+    if (Content.size() <= Size || Content[Size] != '\n')
+        return false;
+
+    Result = Content.take_front(Size);
+    Content = Content.drop_front(Size + 1);
+
+    return true;
+}
+
+static bool getModificationTime(llvm::StringRef File, uint64_t &Time)
+{
+    llvm::sys::fs::file_status Status;
+
+    if (llvm::sys::fs::status(File, Status))
+        return false;
+
+    auto Duration = Status.getLastModificationTime().time_since_epoch();
+    auto Ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Duration);
+
+    Time = static_cast<uint64_t>(Ns.count());
+
+    return true;
+}
+
+static void writeNamespaces(llvm::raw_ostream &OStream,
+                            llvm::ArrayRef<FGenIR::Scope> Scopes,
+                            llvm::SmallVectorImpl<llvm::StringRef> &Active,
+                            bool Trim)
+{
+    /*
+     * Same as 'FunctionGenerator::writeNamespaceDefinitions()'. Two
+     * namespaces at the same depth of equal chains are the same if they
+     * have the same name, so the names take the place of the canonical
+     * declarations.
+     */
+    size_t OkIndex = 0;
+
+    for (const auto &Scope : Scopes) {
+        if (Scope.Kind != FGenIR::SK_Namespace)
+            continue;
+
+        auto Size = Active.size();
+        if (OkIndex < Size) {
+            if (Active[OkIndex] == Scope.Text) {
+                ++OkIndex;
+                continue;
+            }
+
+            Active.resize(OkIndex);
+
+            while (Size-- > OkIndex)
+                OStream << "}\n";
+
+            if (!Trim)
+                OStream << '\n';
+        }
+
+        Active.push_back(Scope.Text);
+        ++OkIndex;
+
+        OStream << "namespace " << Scope.Text << " {\n";
+
+        if (!Trim)
+            OStream << '\n';
+    }
+
+    auto Size = Active.size();
+    if (OkIndex < Size) {
+        Active.resize(OkIndex);
+
+        while (Size-- > OkIndex)
+            OStream << "}\n";
+
+        if (!Trim)
+            OStream << '\n';
+    }
+}
+
+FGenIR::FGenIR()
+    : Buffer_(nullptr),
+      Allocator_(),
+      Saver_(Allocator_),
+      Dependencies_(),
+      Scopes_(),
+      Entries_()
+{}
+
+std::string FGenIR::getPath(llvm::StringRef Directory,
+                            llvm::StringRef File,
+                            const FGenConfiguration &Configuration)
+{
+    /*
+     * The targets decide which functions of the file are captured.
+     * All other options only affect how the IR is put together.
+     */
+    std::string Key = File.str();
+
+    for (const auto &Target : Configuration.targets()) {
+        Key += '\0';
+        Key += Target;
+    }
+
+    llvm::SmallString<256> Path(Directory);
+    llvm::sys::path::append(Path, llvm::utohexstr(llvm::xxHash64(Key)) + ".ir");
+
+    return Path.str().str();
+}
+
+bool FGenIR::load(llvm::StringRef File, std::string &ErrMsg)
+{
+    /* Large IRs are memory mapped instead of being read */
+    Dependencies_.clear();
+    Scopes_.clear();
+    Entries_.clear();
+
+    auto Buffer = llvm::MemoryBuffer::getFile(File, -1, false);
+    if (!Buffer) {
+        /* Without an IR, the input file is parsed as usual */
+        if (Buffer.getError() == std::errc::no_such_file_or_directory)
+            return true;
+
+        ErrMsg = Buffer.getError().message();
+        return false;
+    }
+
+    const auto Fail = [this, &ErrMsg]() {
+        Dependencies_.clear();
+        Scopes_.clear();
+        Entries_.clear();
+
+        ErrMsg = "invalid IR";
+        return false;
+    };
+
+    auto Content = (*Buffer)->getBuffer();
+
+    llvm::StringRef Line;
+    std::tie(Line, Content) = Content.split('\n');
+
+    if (Line != IRMagic)
+        return Fail();
+
+    llvm::StringRef NumDepsStr, NumFunctionsStr;
+    uint64_t NumDeps, NumFunctions;
+
+    std::tie(Line, Content) = Content.split('\n');
+    std::tie(NumDepsStr, NumFunctionsStr) = Line.split(' ');
+
+    if (NumDepsStr.getAsInteger(10, NumDeps) ||
+        NumFunctionsStr.getAsInteger(10, NumFunctions))
+        return Fail();
+
+    while (NumDeps--) {
+        llvm::StringRef TimeStr, Path;
+        uint64_t Time;
+
+        std::tie(Line, Content) = Content.split('\n');
+        std::tie(TimeStr, Path) = Line.split(' ');
+
+        if (TimeStr.getAsInteger(10, Time) || Path.empty())
+            return Fail();
+
+        Dependencies_.push_back({Path, Time});
+    }
+
+    Entries_.reserve(NumFunctions);
+
+    /*
+     * Every function starts with a line holding the kinds of its scopes
+     * and the sizes of all of its strings, followed by the strings.
+     */
+    while (NumFunctions--) {
+        llvm::SmallVector<llvm::StringRef, 16> Fields;
+        llvm::SmallVector<llvm::StringRef, 16> Strings;
+
+        std::tie(Line, Content) = Content.split('\n');
+        Line.split(Fields, ' ');
+
+        if (Fields.size() < 7)
+            return Fail();
+
+        auto Kinds = Fields.front();
+
+        if (Fields.size() != Kinds.size() + 7)
+            return Fail();
+
+        for (const auto &Field : llvm::makeArrayRef(Fields).drop_front()) {
+            uint64_t Size;
+            llvm::StringRef String;
+
+            if (Field.getAsInteger(10, Size) ||
+                !readString(Content, Size, String))
+                return Fail();
+
+            Strings.push_back(String);
+        }
+
+        Entry Entry;
+        Entry.ScopeBegin = Scopes_.size();
+        Entry.NumScopes = Kinds.size();
+
+        for (size_t i = 0; i < Kinds.size(); ++i) {
+            auto Kind = static_cast<ScopeKind>(Kinds[i]);
+
+            switch (Kind) {
+            case SK_Namespace:
+            case SK_Record:
+            case SK_Name:
+                Scopes_.push_back({Kind, Strings[i]});
+                break;
+            default:
+                return Fail();
+            }
+        }
+
+        auto Pieces = llvm::makeArrayRef(Strings).drop_front(Kinds.size());
+
+        Entry.Pieces.Head = Pieces[0];
+        Entry.Pieces.Tail = Pieces[1];
+        Entry.Pieces.Accessor = Pieces[2];
+        Entry.Pieces.MoveAccessor = Pieces[3];
+        Entry.Pieces.Conversion = Pieces[4];
+        Entry.Pieces.Stub = Pieces[5];
+
+        Entries_.push_back(Entry);
+    }
+
+    if (!Content.empty())
+        return Fail();
+
+    Buffer_ = std::move(*Buffer);
+
+    return true;
+}
+
+bool FGenIR::save(llvm::StringRef File, std::string &ErrMsg) const
+{
+    std::string Content;
+    llvm::raw_string_ostream OS(Content);
+
+    OS << IRMagic << "\n";
+    OS << Dependencies_.size() << " " << Entries_.size() << "\n";
+
+    for (const auto &Dependency : Dependencies_)
+        OS << Dependency.ModTime << " " << Dependency.File << "\n";
+
+    for (const auto &Entry : Entries_) {
+        auto Scopes = llvm::makeArrayRef(Scopes_).slice(Entry.ScopeBegin,
+                                                        Entry.NumScopes);
+        const auto &Pieces = Entry.Pieces;
+
+        const llvm::StringRef Strings[] = {
+            Pieces.Head,
+            Pieces.Tail,
+            Pieces.Accessor,
+            Pieces.MoveAccessor,
+            Pieces.Conversion,
+            Pieces.Stub,
+        };
+
+        for (const auto &Scope : Scopes)
+            OS << static_cast<char>(Scope.Kind);
+
+        for (const auto &Scope : Scopes)
+            OS << " " << Scope.Text.size();
+
+        for (const auto &String : Strings)
+            OS << " " << String.size();
+
+        OS << "\n";
+
+        for (const auto &Scope : Scopes)
+            OS << Scope.Text << "\n";
+
+        for (const auto &String : Strings)
+            OS << String << "\n";
+    }
+
+    OS.flush();
+
+    return util::file::writeAtomic(File, Content, ErrMsg);
+}
+
+void FGenIR::add(llvm::ArrayRef<Scope> Scopes, const Function &Pieces)
+{
+    Entry Entry;
+    Entry.ScopeBegin = Scopes_.size();
+    Entry.NumScopes = Scopes.size();
+
+    for (const auto &Scope : Scopes)
+        Scopes_.push_back({Scope.Kind, Saver_.save(Scope.Text)});
+
+    Entry.Pieces.Head = Saver_.save(Pieces.Head);
+    Entry.Pieces.Tail = Saver_.save(Pieces.Tail);
+    Entry.Pieces.Accessor = Saver_.save(Pieces.Accessor);
+    Entry.Pieces.MoveAccessor = Saver_.save(Pieces.MoveAccessor);
+    Entry.Pieces.Conversion = Saver_.save(Pieces.Conversion);
+    Entry.Pieces.Stub = Saver_.save(Pieces.Stub);
+
+    Entries_.push_back(Entry);
+}
+
+size_t FGenIR::size() const
+{
+    return Entries_.size();
+}
+
+void FGenIR::setDependencies(llvm::ArrayRef<std::string> Files)
+{
+    Dependencies_.clear();
+
+    /* A file which cannot be examined makes the IR outdated right away */
+    for (const auto &File : Files) {
+        uint64_t Time = 0;
+
+        getModificationTime(File, Time);
+        Dependencies_.push_back({Saver_.save(File), Time});
+    }
+}
+
+std::vector<std::string> FGenIR::dependencies() const
+{
+    std::vector<std::string> Files;
+    Files.reserve(Dependencies_.size());
+
+    for (const auto &Dependency : Dependencies_)
+        Files.push_back(Dependency.File.str());
+
+    return Files;
+}
+
+bool FGenIR::isUpToDate() const
+{
+    /*
+     * The modification times are compared for equality. A file which
+     * was replaced by an older version changed as well.
+     */
+    if (Dependencies_.empty())
+        return false;
+
+    for (const auto &Dependency : Dependencies_) {
+        uint64_t Time;
+
+        if (!getModificationTime(Dependency.File, Time))
+            return false;
+
+        if (Time != Dependency.ModTime)
+            return false;
+    }
+
+    return true;
+}
+
+void FGenIR::generate(const FGenConfiguration &Configuration,
+                      llvm::raw_ostream &OStream) const
+{
+    bool Trim = Configuration.trimOutput();
+    bool Namespaces = Configuration.namespaceDefinitions();
+    bool Accessors = Configuration.implementAccessors();
+    bool Conversions = Configuration.implementConversions();
+    bool Stubs = Configuration.implementStubs();
+    bool Move = Accessors && Configuration.allowMove();
+
+    /* Only accessors which move their value need an include */
+    const auto UsesMove = [](const Entry &Entry) {
+        return !Entry.Pieces.MoveAccessor.empty();
+    };
+
+    if (Move && llvm::any_of(Entries_, UsesMove))
+        OStream << "#include <utility>\n";
+
+    OStream << "\n";
+
+    llvm::SmallVector<llvm::StringRef, 8> Active;
+
+    for (const auto &Entry : Entries_) {
+        auto Scopes = llvm::makeArrayRef(Scopes_).slice(Entry.ScopeBegin,
+                                                        Entry.NumScopes);
+        const auto &Pieces = Entry.Pieces;
+
+        if (Namespaces)
+            writeNamespaces(OStream, Scopes, Active, Trim);
+
+        OStream << Pieces.Head;
+
+        for (const auto &Scope : Scopes) {
+            switch (Scope.Kind) {
+            case SK_Namespace:
+                if (!Namespaces)
+                    OStream << Scope.Text << "::";
+                break;
+            case SK_Record:
+                OStream << Scope.Text << "::";
+                break;
+            case SK_Name:
+                OStream << Scope.Text;
+                break;
+            }
+        }
+
+        OStream << Pieces.Tail;
+
+        if (Accessors && !Pieces.Accessor.empty()) {
+            if (Move && !Pieces.MoveAccessor.empty())
+                OStream << Pieces.MoveAccessor;
+            else
+                OStream << Pieces.Accessor;
+        } else if (Conversions && !Pieces.Conversion.empty()) {
+            OStream << Pieces.Conversion;
+        } else if (Stubs && !Pieces.Stub.empty()) {
+            OStream << Pieces.Stub;
+        } else {
+            OStream << "{}";
+        }
+
+        OStream << ((Trim) ? "\n" : "\n\n");
+    }
+
+    OStream << "\n";
+
+    if (!Active.empty()) {
+        for (size_t i = 0; i < Active.size(); ++i)
+            OStream << "}\n";
+
+        if (!Trim)
+            OStream << '\n';
+    }
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FGEN_FGENIR_HPP_
+#define FGEN_FGENIR_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Allocator.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/StringSaver.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <FGenConfiguration.hpp>
+
+/*
+ * Compact intermediate representation of the functions generated for an
+ * input file. Every function is kept as the pieces of text the generator
+ * derives from the AST: the scopes of its qualified name, everything
+ * before and after the name, and each body the generation options may
+ * select. Only the options decide how the pieces are put together, so
+ * the output for any configuration is assembled without parsing the
+ * input file again.
+ *
+ * A saved IR is memory mapped when loaded and its strings refer to the
+ * mapping. The IR also records the modification times of all files the
+ * input depended on, which tells whether it is still up to date.
+ */
+
+class FGenIR {
+public:
+    enum ScopeKind : char {
+        SK_Namespace = 'n',
+        SK_Record = 'r',
+        SK_Name = 'f',
+    };
+
+    struct Scope {
+        ScopeKind Kind;
+        llvm::StringRef Text;
+    };
+
+    struct Function {
+        /* Template parameters and the return type or "auto" */
+        llvm::StringRef Head;
+        /* Parameters, qualifiers and the trailing return type */
+        llvm::StringRef Tail;
+        /* Bodies for "-faccessors", with and without "-fmove" */
+        llvm::StringRef Accessor;
+        llvm::StringRef MoveAccessor;
+        llvm::StringRef Conversion;
+        llvm::StringRef Stub;
+    };
+
+    FGenIR();
+
+    static std::string getPath(llvm::StringRef Directory,
+                               llvm::StringRef File,
+                               const FGenConfiguration &Configuration);
+
+    bool load(llvm::StringRef File, std::string &ErrMsg);
+    bool save(llvm::StringRef File, std::string &ErrMsg) const;
+
+    void add(llvm::ArrayRef<Scope> Scopes, const Function &Pieces);
+    size_t size() const;
+
+    void setDependencies(llvm::ArrayRef<std::string> Files);
+    std::vector<std::string> dependencies() const;
+    bool isUpToDate() const;
+
+    void generate(const FGenConfiguration &Configuration,
+                  llvm::raw_ostream &OStream = llvm::outs()) const;
+
+private:
+    struct Dependency {
+        llvm::StringRef File;
+        uint64_t ModTime;
+    };
+
+    struct Entry {
+        size_t ScopeBegin;
+        size_t NumScopes;
+        Function Pieces;
+    };
+
+    std::unique_ptr<llvm::MemoryBuffer> Buffer_;
+    llvm::BumpPtrAllocator Allocator_;
+    llvm::StringSaver Saver_;
+
+    std::vector<Dependency> Dependencies_;
+    std::vector<Scope> Scopes_;
+    std::vector<Entry> Entries_;
+};
+
+#endif /* FGEN_FGENIR_HPP_ */
@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tuple>
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
+#include <util/File.hpp>
+#include <util/Statistics.hpp>
+
+#include <FGenIndex.hpp>
+
+static util::stats::Counter NumUnresolved(
+    "unresolved-functions", "Number of declared but undefined functions");
+
+static const llvm::StringRef IndexMagic = "fgen-index 1";
+
+/* Generated outputs span multiple lines, the index has one per value */
+static std::string escape(llvm::StringRef Text)
+{
+    std::string Result;
+    Result.reserve(Text.size());
+
+    for (auto Char : Text) {
+        if (Char == '\\')
+            Result += "\\\\";
+        else if (Char == '\n')
+            Result += "\\n";
+        else
+            Result += Char;
+    }
+
+    return Result;
+}
+
+static bool unescape(llvm::StringRef Text, std::string &Result)
+{
+    Result.clear();
+    Result.reserve(Text.size());
+
+    for (size_t i = 0; i < Text.size(); ++i) {
+        if (Text[i] != '\\') {
+            Result += Text[i];
+            continue;
+        }
+
+        if (++i == Text.size())
+            return false;
+
+        if (Text[i] == '\\')
+            Result += '\\';
+        else if (Text[i] == 'n')
+            Result += '\n';
+        else
+            return false;
+    }
+
+    return true;
+}
+
+uint64_t
+FGenIndex::getCommandHash(const clang::tooling::CompilationDatabase &Database,
+                          llvm::StringRef File)
+{
+    std::string Buffer;
+
+    /*
+     * A changed compile command (e.g. a new macro definition) may change
+     * the declarations of a translation unit, even if none of its files
+     * were modified.
+     */
+    for (const auto &Command : Database.getCompileCommands(File)) {
+        Buffer += Command.Directory;
+        Buffer += '\0';
+
+        for (const auto &Arg : Command.CommandLine) {
+            Buffer += Arg;
+            Buffer += '\0';
+        }
+    }
+
+    return llvm::xxHash64(Buffer);
+}
+
+bool FGenIndex::load(llvm::StringRef File, std::string &ErrMsg)
+{
+    auto Buffer = llvm::MemoryBuffer::getFile(File);
+    if (!Buffer) {
+        /* Everything gets indexed on the very first run. */
+        if (Buffer.getError() == std::errc::no_such_file_or_directory)
+            return true;
+
+        ErrMsg = Buffer.getError().message();
+        return false;
+    }
+
+    llvm::SmallVector<llvm::StringRef, 0> Lines;
+    (*Buffer)->getBuffer().split(Lines, '\n', -1, false);
+
+    if (Lines.empty() || Lines[0] != IndexMagic) {
+        ErrMsg = "invalid index file";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    Entry *Current = nullptr;
+
+    for (auto It = std::next(Lines.begin()); It != Lines.end(); ++It) {
+        llvm::StringRef Key, Value;
+        std::tie(Key, Value) = It->split(' ');
+
+        bool Ok = true;
+
+        if (Key == "tu") {
+            Current = &Entries_[Value.str()];
+            *Current = Entry();
+        } else if (!Current) {
+            Ok = false;
+        } else if (Key == "command") {
+            Ok = !Value.getAsInteger(16, Current->CommandHash);
+        } else if (Key == "dep") {
+            llvm::StringRef Time, Path;
+            std::tie(Time, Path) = Value.split(' ');
+
+            int64_t MTime;
+            Ok = !Time.getAsInteger(10, MTime);
+
+            Current->Dependencies.emplace_back(Path.str(), MTime);
+        } else if (Key == "decl") {
+            Current->Declarations.push_back(Value.str());
+        } else if (Key == "def") {
+            Current->Definitions.push_back(Value.str());
+        } else if (Key == "generated") {
+            Ok = !Value.getAsInteger(16, Current->GeneratorHash);
+        } else if (Key == "unresolved") {
+            Current->Generated.push_back(Value.str());
+        } else if (Key == "output") {
+            Current->Outputs.emplace_back();
+            Ok = unescape(Value, Current->Outputs.back());
+        } else {
+            Ok = false;
+        }
+
+        /* Start from scratch rather than trusting a corrupted index */
+        if (!Ok) {
+            Entries_.clear();
+            ErrMsg = "invalid index file";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool FGenIndex::save(llvm::StringRef File, std::string &ErrMsg) const
+{
+    std::string Content;
+    llvm::raw_string_ostream OS(Content);
+
+    OS << IndexMagic << "\n";
+
+    {
+        std::lock_guard<std::mutex> Lock(Mutex_);
+
+        for (const auto &Pair : Entries_) {
+            const auto &Entry = Pair.second;
+
+            auto Hash = llvm::format_hex_no_prefix(Entry.CommandHash, 16);
+
+            OS << "tu " << Pair.first << "\n";
+            OS << "command " << Hash << "\n";
+
+            for (const auto &Dependency : Entry.Dependencies)
+                OS << "dep " << Dependency.second << " " << Dependency.first
+                   << "\n";
+
+            for (const auto &USR : Entry.Declarations)
+                OS << "decl " << USR << "\n";
+
+            for (const auto &USR : Entry.Definitions)
+                OS << "def " << USR << "\n";
+
+            if (Entry.Outputs.empty())
+                continue;
+
+            auto Generator = llvm::format_hex_no_prefix(Entry.GeneratorHash,
+                                                        16);
+
+            OS << "generated " << Generator << "\n";
+
+            for (const auto &USR : Entry.Generated)
+                OS << "unresolved " << USR << "\n";
+
+            for (const auto &Output : Entry.Outputs)
+                OS << "output " << escape(Output) << "\n";
+        }
+    }
+
+    OS.flush();
+
+    return util::file::writeAtomic(File, Content, ErrMsg);
+}
+
+bool FGenIndex::isUpToDate(const std::string &File, uint64_t CommandHash) const
+{
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    auto It = Entries_.find(File);
+    if (It == Entries_.end() || It->second.CommandHash != CommandHash)
+        return false;
+
+    for (const auto &Dependency : It->second.Dependencies) {
+        llvm::sys::fs::file_status Status;
+
+        if (llvm::sys::fs::status(Dependency.first, Status))
+            return false;
+
+        auto MTime = Status.getLastModificationTime().time_since_epoch();
+        if (MTime.count() != Dependency.second)
+            return false;
+    }
+
+    return true;
+}
+
+void FGenIndex::insert(std::string File, Entry Entry)
+{
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    Entries_[std::move(File)] = std::move(Entry);
+}
+
+void FGenIndex::retain(llvm::ArrayRef<std::string> Files)
+{
+    llvm::StringSet<> Keep;
+
+    for (const auto &File : Files)
+        Keep.insert(File);
+
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    /* Forget about translation units removed from the project */
+    for (auto It = Entries_.begin(); It != Entries_.end();) {
+        if (Keep.count(It->first))
+            ++It;
+        else
+            It = Entries_.erase(It);
+    }
+}
+
+std::map<std::string, std::vector<std::string>> FGenIndex::unresolved() const
+{
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    llvm::StringSet<> Definitions;
+
+    for (const auto &Pair : Entries_) {
+        for (const auto &USR : Pair.second.Definitions)
+            Definitions.insert(USR);
+    }
+
+    /*
+     * A function is usually declared in many translation units. Assign
+     * each unresolved function to the first translation unit declaring
+     * it, so its definition gets generated exactly once.
+     */
+    llvm::StringSet<> Assigned;
+    std::map<std::string, std::vector<std::string>> Result;
+
+    for (const auto &Pair : Entries_) {
+        for (const auto &USR : Pair.second.Declarations) {
+            if (Definitions.count(USR) || !Assigned.insert(USR).second)
+                continue;
+
+            Result[Pair.first].push_back(USR);
+            ++NumUnresolved;
+        }
+    }
+
+    return Result;
+}
+
+bool FGenIndex::outputs(const std::string &File,
+                        uint64_t GeneratorHash,
+                        llvm::ArrayRef<std::string> USRs,
+                        std::vector<std::string> &Outputs) const
+{
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    auto It = Entries_.find(File);
+    if (It == Entries_.end() || It->second.Outputs.empty())
+        return false;
+
+    auto &Entry = It->second;
+
+    /* Other options or a changed project need a new output */
+    if (Entry.GeneratorHash != GeneratorHash || !USRs.equals(Entry.Generated))
+        return false;
+
+    Outputs = Entry.Outputs;
+
+    return true;
+}
+
+void FGenIndex::setOutputs(const std::string &File,
+                           uint64_t GeneratorHash,
+                           std::vector<std::string> USRs,
+                           std::vector<std::string> Outputs)
+{
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    auto It = Entries_.find(File);
+    if (It == Entries_.end())
+        return;
+
+    It->second.GeneratorHash = GeneratorHash;
+    It->second.Generated = std::move(USRs);
+    It->second.Outputs = std::move(Outputs);
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FGEN_FGENINDEX_HPP_
+#define FGEN_FGENINDEX_HPP_
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <clang/Tooling/CompilationDatabase.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+
+/*
+ * Persistent index of the function declarations and definitions of all
+ * translation units of a project. Functions are identified by their
+ * USR. Every entry remembers the compile command and the modification
+ * times of the included files, so only translation units affected by a
+ * change need to be indexed again. The output generated for the
+ * unresolved functions of a translation unit is kept as well, until the
+ * unit changes or other functions are assigned to it. Entries may be
+ * inserted concurrently from multiple threads.
+ */
+
+class FGenIndex {
+public:
+    struct Entry {
+        uint64_t CommandHash;
+        std::vector<std::pair<std::string, int64_t>> Dependencies;
+        std::vector<std::string> Declarations;
+        std::vector<std::string> Definitions;
+        uint64_t GeneratorHash;
+        std::vector<std::string> Generated;
+        std::vector<std::string> Outputs;
+    };
+
+    FGenIndex() = default;
+
+    static uint64_t
+    getCommandHash(const clang::tooling::CompilationDatabase &Database,
+                   llvm::StringRef File);
+
+    bool load(llvm::StringRef File, std::string &ErrMsg);
+    bool save(llvm::StringRef File, std::string &ErrMsg) const;
+
+    bool isUpToDate(const std::string &File, uint64_t CommandHash) const;
+
+    void insert(std::string File, Entry Entry);
+    void retain(llvm::ArrayRef<std::string> Files);
+
+    std::map<std::string, std::vector<std::string>> unresolved() const;
+
+    bool outputs(const std::string &File,
+                 uint64_t GeneratorHash,
+                 llvm::ArrayRef<std::string> USRs,
+                 std::vector<std::string> &Outputs) const;
+    void setOutputs(const std::string &File,
+                    uint64_t GeneratorHash,
+                    std::vector<std::string> USRs,
+                    std::vector<std::string> Outputs);
+
+private:
+    mutable std::mutex Mutex_;
+    std::map<std::string, Entry> Entries_;
+};
+
+#endif /* FGEN_FGENINDEX_HPP_ */
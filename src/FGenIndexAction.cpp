@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <set>
+
+#include <clang/AST/RecursiveASTVisitor.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+
+#include <util/Decl.hpp>
+#include <util/File.hpp>
+#include <util/Statistics.hpp>
+
+#include <FGenIndexAction.hpp>
+
+static util::stats::Counter NumFilesIndexed(
+    "files-indexed", "Number of translation units added to the index");
+
+class FGenIndexVisitor : public clang::RecursiveASTVisitor<FGenIndexVisitor> {
+public:
+    FGenIndexVisitor(const clang::SourceManager &SourceManager,
+                     llvm::StringRef Root);
+
+    bool VisitFunctionDecl(clang::FunctionDecl *FunctionDecl);
+
+    const std::set<std::string> &declarations() const;
+    const std::set<std::string> &definitions() const;
+
+private:
+    bool isInProject(clang::SourceLocation Loc);
+
+    const clang::SourceManager &SourceManager_;
+    llvm::StringRef Root_;
+    llvm::DenseMap<clang::FileID, bool> InProject_;
+
+    std::set<std::string> Declarations_;
+    std::set<std::string> Definitions_;
+};
+
+FGenIndexVisitor::FGenIndexVisitor(const clang::SourceManager &SourceManager,
+                                   llvm::StringRef Root)
+    : SourceManager_(SourceManager),
+      Root_(Root),
+      InProject_(),
+      Declarations_(),
+      Definitions_()
+{}
+
+bool FGenIndexVisitor::VisitFunctionDecl(clang::FunctionDecl *FunctionDecl)
+{
+    if (FunctionDecl->isImplicit())
+        return true;
+
+    /*
+     * Functions declared in system headers or in the headers of other
+     * libraries are defined in those libraries, not in the project.
+     */
+    auto Loc = FunctionDecl->getLocation();
+    if (Loc.isInvalid() || SourceManager_.isInSystemHeader(Loc))
+        return true;
+
+    if (!isInProject(Loc))
+        return true;
+
+    auto USR = util::decl::generateUSR(FunctionDecl);
+    if (USR.empty())
+        return true;
+
+    /* Deleted and defaulted functions never need a definition */
+    if (FunctionDecl->doesThisDeclarationHaveABody() ||
+        FunctionDecl->isDeleted() || FunctionDecl->isDefaulted()) {
+        Definitions_.insert(std::move(USR));
+        return true;
+    }
+
+    if (!FunctionDecl->isPure())
+        Declarations_.insert(std::move(USR));
+
+    return true;
+}
+
+const std::set<std::string> &FGenIndexVisitor::declarations() const
+{
+    return Declarations_;
+}
+
+const std::set<std::string> &FGenIndexVisitor::definitions() const
+{
+    return Definitions_;
+}
+
+bool FGenIndexVisitor::isInProject(clang::SourceLocation Loc)
+{
+    auto FileID = SourceManager_.getFileID(SourceManager_.getExpansionLoc(Loc));
+
+    /* A header declares many functions, resolve its path only once */
+    auto It = InProject_.find(FileID);
+    if (It != InProject_.end())
+        return It->second;
+
+    bool Result = false;
+
+    auto File = SourceManager_.getFileEntryForID(FileID);
+    if (File) {
+        auto &FileManager = SourceManager_.getFileManager();
+        auto Path = util::file::getRealPath(FileManager, File->getName());
+
+        Result = llvm::StringRef(Path).startswith(Root_);
+    }
+
+    InProject_[FileID] = Result;
+
+    return Result;
+}
+
+class FGenIndexASTConsumer : public clang::ASTConsumer {
+public:
+    FGenIndexASTConsumer(llvm::StringRef File,
+                         llvm::StringRef Root,
+                         const clang::tooling::CompilationDatabase &Database,
+                         std::shared_ptr<FGenIndex> Index);
+
+    virtual void HandleTranslationUnit(clang::ASTContext &Context) override;
+
+private:
+    std::string File_;
+    llvm::StringRef Root_;
+
+    const clang::tooling::CompilationDatabase &Database_;
+    std::shared_ptr<FGenIndex> Index_;
+};
+
+FGenIndexASTConsumer::FGenIndexASTConsumer(
+    llvm::StringRef File,
+    llvm::StringRef Root,
+    const clang::tooling::CompilationDatabase &Database,
+    std::shared_ptr<FGenIndex> Index)
+    : File_(File), Root_(Root), Database_(Database), Index_(std::move(Index))
+{}
+
+void FGenIndexASTConsumer::HandleTranslationUnit(clang::ASTContext &Context)
+{
+    auto &SourceManager = Context.getSourceManager();
+    auto Visitor = FGenIndexVisitor(SourceManager, Root_);
+
+    Visitor.TraverseDecl(Context.getTranslationUnitDecl());
+
+    FGenIndex::Entry Entry;
+
+    Entry.CommandHash = FGenIndex::getCommandHash(Database_, File_);
+
+    /*
+     * The modification times are taken after parsing. A file modified
+     * while it was parsed will therefore only be indexed again with
+     * the next change, which is acceptable for a build helper.
+     */
+    for (auto &File : util::file::getDependencies(SourceManager)) {
+        llvm::sys::fs::file_status Status;
+
+        if (llvm::sys::fs::status(File, Status))
+            continue;
+
+        auto MTime = Status.getLastModificationTime().time_since_epoch();
+        Entry.Dependencies.emplace_back(std::move(File), MTime.count());
+    }
+
+    const auto &Declarations = Visitor.declarations();
+    const auto &Definitions = Visitor.definitions();
+
+    Entry.Declarations.assign(Declarations.begin(), Declarations.end());
+    Entry.Definitions.assign(Definitions.begin(), Definitions.end());
+
+    auto &FileManager = SourceManager.getFileManager();
+
+    Index_->insert(util::file::getRealPath(FileManager, File_),
+                   std::move(Entry));
+
+    ++NumFilesIndexed;
+}
+
+FGenIndexAction::FGenIndexAction(
+    const clang::tooling::CompilationDatabase &Database,
+    std::shared_ptr<FGenIndex> Index,
+    llvm::StringRef Root)
+    : Database_(Database), Index_(std::move(Index)), Root_(Root)
+{}
+
+std::unique_ptr<clang::ASTConsumer>
+FGenIndexAction::CreateASTConsumer(clang::CompilerInstance &CI,
+                                   llvm::StringRef File)
+{
+    llvm::SmallString<256> Path(File);
+
+    CI.getFileManager().makeAbsolutePath(Path);
+
+    return llvm::make_unique<FGenIndexASTConsumer>(Path, Root_, Database_,
+                                                   Index_);
+}
+
+FGenIndexActionFactory::FGenIndexActionFactory(
+    const clang::tooling::CompilationDatabase &Database,
+    std::shared_ptr<FGenIndex> Index,
+    std::string Root)
+    : Database_(Database), Index_(std::move(Index)), Root_(std::move(Root))
+{}
+
+clang::FrontendAction *FGenIndexActionFactory::create()
+{
+    return new FGenIndexAction(Database_, Index_, Root_);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FGEN_FGENINDEXACTION_HPP_
+#define FGEN_FGENINDEXACTION_HPP_
+
+#include <memory>
+#include <string>
+
+#include <clang/Frontend/FrontendAction.h>
+#include <clang/Tooling/CompilationDatabase.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <FGenIndex.hpp>
+
+class FGenIndexAction : public clang::ASTFrontendAction {
+public:
+    FGenIndexAction(const clang::tooling::CompilationDatabase &Database,
+                    std::shared_ptr<FGenIndex> Index,
+                    llvm::StringRef Root);
+
+    virtual std::unique_ptr<clang::ASTConsumer>
+    CreateASTConsumer(clang::CompilerInstance &CI,
+                      llvm::StringRef File) override;
+
+private:
+    const clang::tooling::CompilationDatabase &Database_;
+    std::shared_ptr<FGenIndex> Index_;
+    llvm::StringRef Root_;
+};
+
+class FGenIndexActionFactory : public clang::tooling::FrontendActionFactory {
+public:
+    FGenIndexActionFactory(const clang::tooling::CompilationDatabase &Database,
+                           std::shared_ptr<FGenIndex> Index,
+                           std::string Root);
+
+    virtual clang::FrontendAction *create() override;
+
+private:
+    const clang::tooling::CompilationDatabase &Database_;
+    std::shared_ptr<FGenIndex> Index_;
+    std::string Root_;
+};
+
+#endif /* FGEN_FGENINDEXACTION_HPP_ */
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <array>
+#include <memory>
+#include <mutex>
+
+#include <llvm/Support/raw_ostream.h>
+
+#include <FGenLibrary.hpp>
+#include <FGenVisitor.hpp>
+
+namespace fgen {
+
+static std::mutex &getMutex(const clang::ASTContext &Context)
+{
+    /*
+     * Contexts are mapped onto a fixed set of locks. Unrelated contexts
+     * rarely share one and no lock has to be created or destroyed along
+     * with a context.
+     */
+    static std::array<std::mutex, 64> Mutexes;
+
+    auto Hash = std::hash<const void *>()(&Context);
+
+    return Mutexes[(Hash >> 4) % Mutexes.size()];
+}
+
+std::string generate(clang::ASTContext &Context,
+                     const FGenConfiguration &Configuration,
+                     const DeclFilter &Filter)
+{
+    auto Visitor = FGenVisitor();
+
+    /* The caller keeps ownership of its configuration */
+    auto Copy = std::make_shared<FGenConfiguration>(Configuration);
+    Visitor.setConfiguration(std::move(Copy));
+
+    if (Filter)
+        Visitor.setFilter(Filter);
+
+    /* Only one visitor may traverse a context at a time */
+    {
+        std::lock_guard<std::mutex> Lock(getMutex(Context));
+
+        Visitor.TraverseDecl(Context.getTranslationUnitDecl());
+    }
+
+    /* The generated text does not refer to the context anymore */
+    std::string Output;
+    llvm::raw_string_ostream OS(Output);
+
+    Visitor.dump(OS);
+    OS.flush();
+
+    return Output;
+}
+
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FGEN_FGENLIBRARY_HPP_
+#define FGEN_FGENLIBRARY_HPP_
+
+#include <functional>
+#include <string>
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Decl.h>
+
+#include <FGenConfiguration.hpp>
+
+/*
+ * Interface of "libfgen" for programs which already hold an AST in
+ * memory, e.g. an indexing service. The functions are generated from
+ * the given context directly, neither a compile command nor a parse is
+ * needed.
+ *
+ * The interface may be used by any number of threads at once. Calls on
+ * the same context are serialized, as traversing the context and
+ * analyzing its records may fill caches of the context (see
+ * "FGenVisitor.hpp"). Calls on different contexts run in parallel.
+ */
+
+namespace fgen {
+
+using DeclFilter = std::function<bool(const clang::FunctionDecl *)>;
+
+/*
+ * Returns the definitions of all functions declared in the main file of
+ * the context which match the targets of the configuration. If a filter
+ * is given, it selects the functions instead of the main file.
+ */
+std::string generate(clang::ASTContext &Context,
+                     const FGenConfiguration &Configuration,
+                     const DeclFilter &Filter = nullptr);
+
+}
+
+#endif /* FGEN_FGENLIBRARY_HPP_ */
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <FGenOutputCache.hpp>
+
+std::vector<std::string>
+FGenOutputCache::dependencies(const std::string &File) const
+{
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    auto It = Entries_.find(File);
+    if (It == Entries_.end())
+        return {};
+
+    return It->second.Dependencies;
+}
+
+std::string FGenOutputCache::output(const std::string &File) const
+{
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    auto It = Entries_.find(File);
+    if (It == Entries_.end())
+        return {};
+
+    return It->second.Output;
+}
+
+void FGenOutputCache::dump(llvm::ArrayRef<std::string> Files,
+                           llvm::raw_ostream &OStream) const
+{
+    /*
+     * The order of 'Files' determines the order of the output. This
+     * way the assembled output does not depend on the order in which
+     * the input files were (re-)generated.
+     */
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    for (const auto &File : Files) {
+        auto It = Entries_.find(File);
+        if (It != Entries_.end())
+            OStream << It->second.Output;
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FGEN_FGENOUTPUTCACHE_HPP_
+#define FGEN_FGENOUTPUTCACHE_HPP_
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/Support/raw_ostream.h>
+
+/*
+ * Keeps the generated output of every processed input file together
+ * with the files the input depended on while it was parsed. This allows
+ * to regenerate single input files and to assemble the complete output
+ * afterwards without parsing the other files again. Files may be
+ * inserted concurrently from multiple threads.
+ */
+
+class FGenOutputCache {
+public:
+    FGenOutputCache() = default;
+
+    /*
+     * Defined here, as the AST consumer is the only caller. This keeps
+     * the compiler plugin, which uses the consumer but never a cache,
+     * free of the cache's object file.
+     */
+    void insert(std::string File,
+                std::string Output,
+                std::vector<std::string> Dependencies)
+    {
+        std::lock_guard<std::mutex> Lock(Mutex_);
+
+        auto &Entry = Entries_[std::move(File)];
+
+        Entry.Output = std::move(Output);
+        Entry.Dependencies = std::move(Dependencies);
+    }
+
+    std::vector<std::string> dependencies(const std::string &File) const;
+    std::string output(const std::string &File) const;
+
+    void dump(llvm::ArrayRef<std::string> Files,
+              llvm::raw_ostream &OStream = llvm::outs()) const;
+
+private:
+    struct Entry {
+        std::string Output;
+        std::vector<std::string> Dependencies;
+    };
+
+    mutable std::mutex Mutex_;
+    std::unordered_map<std::string, Entry> Entries_;
+};
+
+#endif /* FGEN_FGENOUTPUTCACHE_HPP_ */
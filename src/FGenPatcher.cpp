@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include <clang/AST/DeclCXX.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <util/Decl.hpp>
+#include <util/File.hpp>
+#include <util/Statistics.hpp>
+
+#include <FGenPatcher.hpp>
+#include <FunctionGenerator.hpp>
+
+static util::stats::Counter NumDefinitionsInserted(
+    "definitions-inserted", "Number of definitions inserted by -patch");
+
+static void getNamespaces(const clang::FunctionDecl *FunctionDecl,
+                          std::vector<const clang::NamespaceDecl *> &Vec)
+{
+    llvm::SmallVector<const clang::DeclContext *, 8> ContextVec;
+
+    util::decl::getFullContext(FunctionDecl, ContextVec);
+
+    Vec.clear();
+
+    for (auto Context : ContextVec) {
+        auto NamespaceDecl = clang::dyn_cast<clang::NamespaceDecl>(Context);
+        if (NamespaceDecl)
+            Vec.push_back(NamespaceDecl->getCanonicalDecl());
+    }
+}
+
+FGenPatcher::FGenPatcher(clang::ASTContext &Context)
+    : Context_(Context), Blocks_(), Configuration_(nullptr)
+{}
+
+void FGenPatcher::setConfiguration(
+    std::shared_ptr<FGenConfiguration> Configuration)
+{
+    Configuration_ = std::move(Configuration);
+}
+
+bool FGenPatcher::patch(llvm::ArrayRef<const clang::FunctionDecl *> Functions,
+                        std::string &ErrMsg)
+{
+    struct Insertion {
+        clang::SourceLocation Loc;
+        FunctionGenerator Generator;
+    };
+
+    auto &SM = Context_.getSourceManager();
+    auto MainFileID = SM.getMainFileID();
+
+    std::vector<const clang::NamespaceDecl *> Namespaces;
+
+    Blocks_.clear();
+    collectBlocks(Context_.getTranslationUnitDecl(), Namespaces);
+
+    /*
+     * All definitions which go into the same namespace block are
+     * generated together. This way the namespaces which are missing
+     * in the main file only get opened once for each block. The map is
+     * ordered by file offset, which keeps the insertions in the order
+     * in which they appear in the patched file.
+     */
+    std::map<unsigned int, Insertion> Insertions;
+
+    auto EndOfFile = SM.getLocForEndOfFile(MainFileID);
+
+    for (auto FunctionDecl : Functions) {
+        const Block *Match = nullptr;
+
+        if (Configuration_->namespaceDefinitions()) {
+            getNamespaces(FunctionDecl, Namespaces);
+            Match = findBlock(Namespaces);
+        }
+
+        /*
+         * Without a matching namespace block the definition is appended
+         * to the end of the file and opens all of its namespaces itself.
+         */
+        auto Loc = (Match) ? Match->RBraceLoc : EndOfFile;
+        auto Offset = SM.getFileOffset(Loc);
+
+        auto Result = Insertions.try_emplace(Offset);
+        auto &Insertion = Result.first->second;
+
+        if (Result.second) {
+            Insertion.Loc = Loc;
+            Insertion.Generator.setConfiguration(Configuration_);
+
+            if (Match)
+                Insertion.Generator.setEnclosingNamespaces(Match->Namespaces);
+        }
+
+        Insertion.Generator.add(FunctionDecl);
+        ++NumDefinitionsInserted;
+    }
+
+    if (Insertions.empty())
+        return true;
+
+    clang::Rewriter Rewriter(SM, Context_.getLangOpts());
+    std::set<std::string> Includes;
+
+    for (const auto &Entry : Insertions) {
+        const auto &Insertion = Entry.second;
+
+        std::string Text;
+        llvm::raw_string_ostream OS(Text);
+
+        if (Insertion.Loc == EndOfFile)
+            OS << "\n";
+
+        Insertion.Generator.dumpDefinitions(OS);
+        OS.flush();
+
+        Rewriter.InsertTextBefore(Insertion.Loc, Text);
+
+        for (auto Include : Insertion.Generator.includes())
+            Includes.insert(Include.str());
+    }
+
+    /* Only add the includes which are not already present */
+    auto Buffer = SM.getBufferData(MainFileID);
+
+    std::string IncludeText;
+
+    for (const auto &Include : Includes) {
+        if (!Buffer.contains(Include))
+            IncludeText += Include + "\n";
+    }
+
+    if (!IncludeText.empty()) {
+        auto Offset = getIncludeOffset();
+
+        if (Offset && Buffer[Offset - 1] != '\n')
+            IncludeText.insert(0, "\n");
+        auto Loc = SM.getLocForStartOfFile(MainFileID).getLocWithOffset(Offset);
+
+        Rewriter.InsertTextAfter(Loc, IncludeText);
+    }
+
+    auto RewriteBuffer = Rewriter.getRewriteBufferFor(MainFileID);
+    if (!RewriteBuffer)
+        return true;
+
+    std::string Content;
+    llvm::raw_string_ostream OS(Content);
+
+    RewriteBuffer->write(OS);
+    OS.flush();
+
+    auto FileEntry = SM.getFileEntryForID(MainFileID);
+
+    llvm::SmallString<256> Path(FileEntry->tryGetRealPathName());
+    if (Path.empty()) {
+        Path = FileEntry->getName();
+        SM.getFileManager().makeAbsolutePath(Path);
+    }
+
+    /*
+     * The rewrite buffer only contains the inserted text on top of the
+     * original file. Replace the file atomically with the result, so a
+     * concurrently running build never sees a partially written file.
+     */
+    return util::file::writeAtomic(Path, Content, ErrMsg);
+}
+
+void FGenPatcher::collectBlocks(
+    const clang::DeclContext *DeclContext,
+    std::vector<const clang::NamespaceDecl *> &Namespaces)
+{
+    auto &SM = Context_.getSourceManager();
+
+    for (auto Decl : DeclContext->decls()) {
+        /* Namespaces may also be nested in 'extern "C++" { ... }' blocks */
+        auto LinkageSpecDecl = clang::dyn_cast<clang::LinkageSpecDecl>(Decl);
+        if (LinkageSpecDecl) {
+            if (SM.isInMainFile(LinkageSpecDecl->getLocation()))
+                collectBlocks(LinkageSpecDecl, Namespaces);
+
+            continue;
+        }
+
+        auto NamespaceDecl = clang::dyn_cast<clang::NamespaceDecl>(Decl);
+        if (!NamespaceDecl || !SM.isInMainFile(NamespaceDecl->getLocation()))
+            continue;
+
+        Namespaces.push_back(NamespaceDecl->getCanonicalDecl());
+
+        /*
+         * Blocks which are closed by a macro have no well-defined
+         * insertion point. They are still traversed as they may contain
+         * other blocks.
+         */
+        auto RBraceLoc = NamespaceDecl->getRBraceLoc();
+        if (RBraceLoc.isFileID())
+            Blocks_.push_back({Namespaces, RBraceLoc});
+
+        collectBlocks(NamespaceDecl, Namespaces);
+
+        Namespaces.pop_back();
+    }
+}
+
+const FGenPatcher::Block *FGenPatcher::findBlock(
+    llvm::ArrayRef<const clang::NamespaceDecl *> Namespaces) const
+{
+    const Block *Match = nullptr;
+    std::size_t MatchSize = 0;
+
+    /*
+     * Choose the most deeply nested block whose namespaces are a prefix
+     * of 'Namespaces'. Of equally deep blocks the last one in the file
+     * is chosen, so that new definitions appear after the existing ones.
+     */
+    for (const auto &Block : Blocks_) {
+        auto Size = Block.Namespaces.size();
+
+        if (Size < MatchSize || Size > Namespaces.size())
+            continue;
+
+        if (!std::equal(Block.Namespaces.begin(), Block.Namespaces.end(),
+                        Namespaces.begin()))
+            continue;
+
+        Match = &Block;
+        MatchSize = Size;
+    }
+
+    return Match;
+}
+
+unsigned int FGenPatcher::getIncludeOffset() const
+{
+    auto &SM = Context_.getSourceManager();
+    auto Buffer = SM.getBufferData(SM.getMainFileID());
+
+    unsigned int Offset = 0;
+    std::size_t Begin = 0;
+
+    /*
+     * New includes are placed right after the last include directive
+     * of the main file or at the very beginning if there is none.
+     */
+    while (Begin < Buffer.size()) {
+        auto End = Buffer.find('\n', Begin);
+        auto Line = Buffer.slice(Begin, End).ltrim();
+
+        if (Line.consume_front("#") && Line.ltrim().startswith("include"))
+            Offset = (End == llvm::StringRef::npos) ? Buffer.size() : End + 1;
+
+        if (End == llvm::StringRef::npos)
+            break;
+
+        Begin = End + 1;
+    }
+
+    return Offset;
+}
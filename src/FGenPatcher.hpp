@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FGEN_FGENPATCHER_HPP_
+#define FGEN_FGENPATCHER_HPP_
+
+#include <string>
+#include <vector>
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Decl.h>
+#include <llvm/ADT/ArrayRef.h>
+
+#include <FGenConfiguration.hpp>
+
+/*
+ * Inserts the generated definitions of declarations lacking a definition
+ * directly into the main file of a translation unit. Each definition
+ * goes into the last namespace block of the main file which matches the
+ * namespaces of the declaration best. Only namespaces which are not
+ * present in the main file get opened by the generated code.
+ */
+
+class FGenPatcher {
+public:
+    explicit FGenPatcher(clang::ASTContext &Context);
+
+    void setConfiguration(std::shared_ptr<FGenConfiguration> Configuration);
+
+    bool patch(llvm::ArrayRef<const clang::FunctionDecl *> Functions,
+               std::string &ErrMsg);
+
+private:
+    struct Block {
+        std::vector<const clang::NamespaceDecl *> Namespaces;
+        clang::SourceLocation RBraceLoc;
+    };
+
+    void collectBlocks(const clang::DeclContext *DeclContext,
+                       std::vector<const clang::NamespaceDecl *> &Namespaces);
+    const Block *findBlock(
+        llvm::ArrayRef<const clang::NamespaceDecl *> Namespaces) const;
+    unsigned int getIncludeOffset() const;
+
+    clang::ASTContext &Context_;
+    std::vector<Block> Blocks_;
+
+    std::shared_ptr<FGenConfiguration> Configuration_;
+};
+
+#endif /* FGEN_FGENPATCHER_HPP_ */
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <clang/Basic/LangOptions.h>
+#include <clang/Lex/Lexer.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <util/Statistics.hpp>
+
+#include <FGenPrefilter.hpp>
+
+static util::stats::Counter NumParsesAvoided(
+    "parses-avoided", "Number of input files skipped by the prefilter");
+
+/*
+ * Words which are part of qualified names without being written in the
+ * file, e.g. "(anonymous namespace)::f".
+ */
+static const char *const ImplicitWords[] = {
+    "anonymous", "namespace", "class", "struct", "union", "enum",
+};
+
+static bool isIdentifierChar(char Char)
+{
+    return llvm::isAlnum(Char) || Char == '_';
+}
+
+static bool isMacroName(llvm::StringRef Name)
+{
+    /* Macros are usually written in upper case */
+    const auto IsUpper = [](char Char) {
+        return (Char >= 'A' && Char <= 'Z') || llvm::isDigit(Char) ||
+               Char == '_';
+    };
+
+    return Name.size() > 1 && llvm::all_of(Name, IsUpper) &&
+           llvm::any_of(Name, llvm::isAlpha);
+}
+
+FGenPrefilter::FGenPrefilter(llvm::ArrayRef<std::string> Targets)
+{
+    /*
+     * A target is a substring of the qualified name. Each of its runs of
+     * identifier characters must therefore be part of a single name,
+     * as names are separated by "::" or punctuation.
+     */
+    for (const auto &Target : Targets) {
+        std::vector<std::string> Fragments;
+        llvm::StringRef Rest(Target);
+
+        while (!Rest.empty()) {
+            Rest = Rest.drop_until(isIdentifierChar);
+
+            auto Fragment = Rest.take_while(isIdentifierChar);
+            if (!Fragment.empty())
+                Fragments.push_back(Fragment.lower());
+
+            Rest = Rest.drop_front(Fragment.size());
+        }
+
+        Targets_.push_back(std::move(Fragments));
+    }
+}
+
+bool FGenPrefilter::mayMatch(llvm::StringRef File) const
+{
+    auto Buffer = llvm::MemoryBuffer::getFile(File);
+
+    /* Let the parser report unreadable files */
+    if (!Buffer)
+        return true;
+
+    clang::LangOptions LangOpts;
+    LangOpts.CPlusPlus = true;
+    LangOpts.CPlusPlus11 = true;
+    LangOpts.LineComment = true;
+
+    auto Content = (*Buffer)->getBuffer();
+
+    clang::Lexer Lexer(clang::SourceLocation(), LangOpts, Content.begin(),
+                       Content.begin(), Content.end());
+
+    llvm::StringSet<> Names;
+    llvm::StringSet<> Defines;
+    llvm::StringSet<> Uses;
+    clang::Token Token;
+    bool InDirective = false;
+    bool PrevIsHash = false;
+    bool PrevIsDefine = false;
+
+    while (!Lexer.LexFromRawLexer(Token)) {
+        if (Token.isAtStartOfLine())
+            InDirective = Token.is(clang::tok::hash);
+
+        /* Names created by token pasting are unknown */
+        if (Token.is(clang::tok::hashhash))
+            return true;
+
+        if (Token.is(clang::tok::raw_identifier)) {
+            auto Name = Token.getRawIdentifier();
+
+            /*
+             * Any name outside of a directive may be a macro expanding to
+             * names which do not appear in the file at all. Macros
+             * defined in this file are known by name, macros from other
+             * files are only recognized by the usual upper case spelling.
+             */
+            if (PrevIsDefine)
+                Defines.insert(Name);
+            else if (!InDirective && isMacroName(Name))
+                return true;
+            else if (!InDirective)
+                Uses.insert(Name);
+
+            PrevIsDefine = InDirective && PrevIsHash && Name == "define";
+            Names.insert(Name.lower());
+        } else {
+            PrevIsDefine = false;
+
+            if (Token.is(clang::tok::numeric_constant)) {
+                Names.insert(llvm::StringRef(Token.getLiteralData(),
+                                             Token.getLength()).lower());
+            }
+        }
+
+        PrevIsHash = Token.isAtStartOfLine() && Token.is(clang::tok::hash);
+    }
+
+    for (const auto &Entry : Defines) {
+        if (Uses.count(Entry.getKey()))
+            return true;
+    }
+
+    for (const auto Word : ImplicitWords)
+        Names.insert(Word);
+
+    /*
+     * Join all names with a separator which is not part of any target
+     * fragment. A fragment found in the result is part of a single name.
+     */
+    std::string Identifiers;
+
+    for (const auto &Entry : Names) {
+        Identifiers += Entry.getKey();
+        Identifiers += '\0';
+    }
+
+    for (const auto &Fragments : Targets_) {
+        if (mayMatch(Identifiers, Fragments))
+            return true;
+    }
+
+    ++NumParsesAvoided;
+
+    return false;
+}
+
+bool FGenPrefilter::mayMatch(llvm::StringRef Identifiers,
+                             const std::vector<std::string> &Fragments) const
+{
+    const auto Contains = [Identifiers](const std::string &Fragment) {
+        return Identifiers.contains(Fragment);
+    };
+
+    return llvm::all_of(Fragments, Contains);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FGEN_FGENPREFILTER_HPP_
+#define FGEN_FGENPREFILTER_HPP_
+
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+
+/*
+ * Decides without parsing whether a file may declare a function matching
+ * one of the "-fcontains" targets. The file is only lexed in raw mode,
+ * i.e. without preprocessing, and a file is only rejected if none of its
+ * tokens can be part of a matching qualified name. Files which could
+ * produce names through macros, i.e. which use a name defined as a macro
+ * in the file or written like one, are always accepted.
+ */
+
+class FGenPrefilter {
+public:
+    explicit FGenPrefilter(llvm::ArrayRef<std::string> Targets);
+
+    bool mayMatch(llvm::StringRef File) const;
+
+private:
+    bool mayMatch(llvm::StringRef Identifiers,
+                  const std::vector<std::string> &Fragments) const;
+
+    std::vector<std::vector<std::string>> Targets_;
+};
+
+#endif /* FGEN_FGENPREFILTER_HPP_ */
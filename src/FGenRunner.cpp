@@ -0,0 +1,435 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+#include <thread>
+
+#include <clang/Tooling/Tooling.h>
+#include <llvm/Support/FileSystem.h>
+
+#include <util/File.hpp>
+#include <util/Statistics.hpp>
+
+#include <FGenRunner.hpp>
+
+static util::stats::Counter MakespanUs(
+    "makespan-us", "Wall time of parallel runs (microseconds)");
+static util::stats::Counter NumTimingsKnown(
+    "scheduler-timings-history", "Number of run times from history");
+static util::stats::Counter NumTimingsGuessed(
+    "scheduler-timings-size", "Number of run times predicted by file size");
+static util::stats::Counter NumJobsAdmitted(
+    "scheduler-jobs-admitted", "Number of jobs started without waiting");
+static util::stats::Counter NumJobsDelayed(
+    "scheduler-jobs-delayed", "Number of jobs delayed by the memory budget");
+static util::stats::Counter NumJobsOverBudget(
+    "scheduler-jobs-over-budget",
+    "Number of jobs started alone despite exceeding the memory budget");
+static util::stats::Counter SchedulerWaitUs(
+    "scheduler-wait-us", "Time jobs waited for memory (microseconds)");
+static util::stats::Counter NumEstimatesKnown(
+    "scheduler-estimates-history", "Number of memory estimates from history");
+static util::stats::Counter NumEstimatesGuessed(
+    "scheduler-estimates-fallback",
+    "Number of memory estimates without history");
+
+FGenRunner::FGenRunner(const clang::tooling::CompilationDatabase &Database,
+                       clang::tooling::FrontendActionFactory &Factory)
+    : Database_(Database),
+      Factory_(Factory),
+      Adjuster_(nullptr),
+      StatCache_(nullptr),
+      Jobs_(1),
+      MaxMemory_(0),
+      History_(nullptr),
+      MemoryInUse_(0),
+      NumRunning_(0)
+{}
+
+void FGenRunner::setArgumentsAdjuster(
+    clang::tooling::ArgumentsAdjuster Adjuster)
+{
+    Adjuster_ = std::move(Adjuster);
+}
+
+void FGenRunner::setStatCache(
+    llvm::IntrusiveRefCntPtr<FGenStatCache> StatCache)
+{
+    StatCache_ = std::move(StatCache);
+}
+
+void FGenRunner::setJobs(unsigned int Jobs)
+{
+    Jobs_ = (Jobs) ? Jobs : std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+unsigned int FGenRunner::jobs() const
+{
+    return Jobs_;
+}
+
+void FGenRunner::setMaxMemory(uint64_t Bytes)
+{
+    MaxMemory_ = Bytes;
+}
+
+uint64_t FGenRunner::maxMemory() const
+{
+    return MaxMemory_;
+}
+
+void FGenRunner::setHistory(std::shared_ptr<const FGenHistory> History)
+{
+    History_ = std::move(History);
+}
+
+std::shared_ptr<const FGenHistory> FGenRunner::history() const
+{
+    return History_;
+}
+
+int FGenRunner::run(llvm::ArrayRef<std::string> Files)
+{
+    auto Jobs = std::min<size_t>(Jobs_, Files.size());
+
+    if (Jobs <= 1)
+        return runFiles(Files, StatCache_);
+
+    std::vector<std::string> Keys;
+    std::vector<uint64_t> Estimates;
+
+    if (History_) {
+        Keys.reserve(Files.size());
+
+        for (const auto &File : Files)
+            Keys.push_back(util::file::getRealPath(File));
+    }
+
+    if (MaxMemory_)
+        Estimates = estimateMemory(Files, Keys, Jobs);
+
+    auto Order = schedule(Files, Keys);
+
+    std::atomic<size_t> Next(0);
+    std::atomic<int> Result(0);
+
+    const auto Work = [this, Files, &Order, &Estimates, &Next, &Result]() {
+        auto StatCache = createThreadStatCache();
+
+        while (true) {
+            auto Position = Next.fetch_add(1);
+            if (Position >= Order.size())
+                break;
+
+            auto Index = Order[Position];
+
+            if (!Estimates.empty())
+                acquireMemory(Estimates[Index]);
+
+            auto Ret = runFiles(Files[Index], StatCache);
+            if (Ret)
+                Result.store(Ret);
+
+            if (!Estimates.empty())
+                releaseMemory(Estimates[Index]);
+        }
+    };
+
+    auto Start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> Threads;
+    Threads.reserve(Jobs);
+
+    for (size_t i = 0; i < Jobs; ++i)
+        Threads.emplace_back(Work);
+
+    for (auto &Thread : Threads)
+        Thread.join();
+
+    auto Duration = std::chrono::steady_clock::now() - Start;
+    auto Us = std::chrono::duration_cast<std::chrono::microseconds>(Duration);
+
+    MakespanUs += Us.count();
+
+    return Result.load();
+}
+
+int FGenRunner::run(const std::function<bool(std::string &)> &NextFile)
+{
+    std::mutex Mutex;
+    std::atomic<int> Result(0);
+
+    /*
+     * The input files become known one after another, e.g. while their
+     * names are read from a pipe, and each of them is started right
+     * away. Without the complete list, there is no order to be derived
+     * from the history. A memory budget still applies to every file.
+     */
+    const auto Work = [this, &NextFile, &Mutex, &Result](
+                          llvm::IntrusiveRefCntPtr<FGenStatCache> StatCache) {
+        std::string File;
+
+        while (true) {
+            {
+                std::lock_guard<std::mutex> Lock(Mutex);
+
+                if (!NextFile(File))
+                    break;
+            }
+
+            uint64_t Estimate = 0;
+
+            if (MaxMemory_) {
+                std::vector<std::string> Keys;
+
+                if (History_)
+                    Keys.push_back(util::file::getRealPath(File));
+
+                Estimate = estimateMemory(File, Keys, Jobs_).front();
+                acquireMemory(Estimate);
+            }
+
+            auto Ret = runFiles(File, StatCache);
+            if (Ret)
+                Result.store(Ret);
+
+            if (MaxMemory_)
+                releaseMemory(Estimate);
+        }
+    };
+
+    if (Jobs_ == 1) {
+        auto StatCache = StatCache_;
+
+        if (!StatCache) {
+            StatCache = llvm::makeIntrusiveRefCnt<FGenStatCache>(
+                llvm::vfs::getRealFileSystem());
+        }
+
+        Work(StatCache);
+
+        return Result.load();
+    }
+
+    auto Start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> Threads;
+    Threads.reserve(Jobs_);
+
+    for (size_t i = 0; i < Jobs_; ++i)
+        Threads.emplace_back(Work, createThreadStatCache());
+
+    for (auto &Thread : Threads)
+        Thread.join();
+
+    auto Duration = std::chrono::steady_clock::now() - Start;
+    auto Us = std::chrono::duration_cast<std::chrono::microseconds>(Duration);
+
+    MakespanUs += Us.count();
+
+    return Result.load();
+}
+
+llvm::IntrusiveRefCntPtr<FGenStatCache>
+FGenRunner::createThreadStatCache() const
+{
+    /*
+     * Every thread needs its own view of the file system. The process
+     * wide working directory of the real file system would otherwise be
+     * changed concurrently by the tools.
+     */
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FileSystem(
+        llvm::vfs::createPhysicalFileSystem().release());
+
+    if (StatCache_)
+        return llvm::makeIntrusiveRefCnt<FGenStatCache>(FileSystem,
+                                                        *StatCache_);
+
+    return llvm::makeIntrusiveRefCnt<FGenStatCache>(FileSystem);
+}
+
+int FGenRunner::runFiles(llvm::ArrayRef<std::string> Files,
+                         llvm::IntrusiveRefCntPtr<FGenStatCache> StatCache)
+{
+    if (!StatCache) {
+        StatCache = llvm::makeIntrusiveRefCnt<FGenStatCache>(
+            llvm::vfs::getRealFileSystem());
+    }
+
+    /*
+     * All translation units of this tool share a single file manager
+     * which is backed by the stat cache. Thus, every include path gets
+     * probed only once for a specific header.
+     */
+    clang::tooling::ClangTool Tool(
+        Database_,
+        Files,
+        std::make_shared<clang::PCHContainerOperations>(),
+        StatCache);
+
+    if (Adjuster_)
+        Tool.appendArgumentsAdjuster(Adjuster_);
+
+    return Tool.run(&Factory_);
+}
+
+std::vector<uint64_t>
+FGenRunner::estimateMemory(llvm::ArrayRef<std::string> Files,
+                           llvm::ArrayRef<std::string> Keys,
+                           size_t Jobs) const
+{
+    std::vector<uint64_t> Estimates;
+    Estimates.reserve(Files.size());
+
+    uint64_t Sum = 0;
+    uint64_t Count = 0;
+
+    for (size_t i = 0; i < Files.size(); ++i) {
+        auto Bytes = (Keys.empty()) ? 0 : History_->memory(Keys[i]);
+
+        Estimates.push_back(Bytes);
+
+        if (Bytes) {
+            Sum += Bytes;
+            ++Count;
+        }
+    }
+
+    /*
+     * Files which were never processed before are assumed to be as
+     * expensive as an average known file. Without any history the
+     * budget is split evenly among the jobs.
+     */
+    auto Fallback = (Count) ? Sum / Count : MaxMemory_ / Jobs;
+
+    for (auto &Bytes : Estimates) {
+        if (Bytes) {
+            ++NumEstimatesKnown;
+        } else {
+            ++NumEstimatesGuessed;
+            Bytes = Fallback;
+        }
+    }
+
+    return Estimates;
+}
+
+std::vector<size_t>
+FGenRunner::schedule(llvm::ArrayRef<std::string> Files,
+                     llvm::ArrayRef<std::string> Keys) const
+{
+    std::vector<size_t> Order(Files.size());
+    std::iota(Order.begin(), Order.end(), 0);
+
+    if (Keys.empty())
+        return Order;
+
+    std::vector<uint64_t> Durations(Files.size(), 0);
+    std::vector<uint64_t> Sizes(Files.size(), 0);
+
+    uint64_t KnownDuration = 0;
+    uint64_t KnownSize = 0;
+
+    for (size_t i = 0; i < Files.size(); ++i) {
+        Durations[i] = History_->duration(Keys[i]);
+        llvm::sys::fs::file_size(Keys[i], Sizes[i]);
+
+        if (Durations[i] && Sizes[i]) {
+            KnownDuration += Durations[i];
+            KnownSize += Sizes[i];
+        }
+    }
+
+    /*
+     * Files which were never processed before are predicted from their
+     * size, scaled by the average time per byte of the known files.
+     * Without any timings the size alone decides the order.
+     */
+    auto PerByte = (KnownSize) ? static_cast<double>(KnownDuration) / KnownSize
+                               : 1.0;
+
+    for (size_t i = 0; i < Files.size(); ++i) {
+        if (Durations[i]) {
+            ++NumTimingsKnown;
+        } else {
+            ++NumTimingsGuessed;
+            Durations[i] = static_cast<uint64_t>(Sizes[i] * PerByte);
+        }
+    }
+
+    /*
+     * Longest processing time first: the files predicted to take the
+     * longest are started first, so the run does not end with a single
+     * thread working on a large file which was queued last.
+     */
+    const auto Compare = [&Durations](size_t A, size_t B) {
+        return Durations[A] > Durations[B];
+    };
+
+    std::stable_sort(Order.begin(), Order.end(), Compare);
+
+    return Order;
+}
+
+void FGenRunner::acquireMemory(uint64_t Bytes)
+{
+    std::unique_lock<std::mutex> Lock(Mutex_);
+
+    /*
+     * A job which exceeds the budget on its own is started as soon as
+     * no other job is running. Otherwise it would never be started.
+     */
+    const auto Fits = [this, Bytes]() {
+        return !NumRunning_ || MemoryInUse_ + Bytes <= MaxMemory_;
+    };
+
+    if (Fits()) {
+        ++NumJobsAdmitted;
+    } else {
+        auto Start = std::chrono::steady_clock::now();
+
+        ++NumJobsDelayed;
+        Condition_.wait(Lock, Fits);
+
+        auto Duration = std::chrono::steady_clock::now() - Start;
+        auto Us = std::chrono::duration_cast<std::chrono::microseconds>(
+            Duration);
+
+        SchedulerWaitUs += Us.count();
+    }
+
+    if (Bytes > MaxMemory_)
+        ++NumJobsOverBudget;
+
+    MemoryInUse_ += Bytes;
+    ++NumRunning_;
+}
+
+void FGenRunner::releaseMemory(uint64_t Bytes)
+{
+    {
+        std::lock_guard<std::mutex> Lock(Mutex_);
+
+        MemoryInUse_ -= Bytes;
+        --NumRunning_;
+    }
+
+    Condition_.notify_all();
+}
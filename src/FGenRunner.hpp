@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FGEN_FGENRUNNER_HPP_
+#define FGEN_FGENRUNNER_HPP_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <clang/Tooling/ArgumentsAdjusters.h>
+#include <clang/Tooling/CompilationDatabase.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <FGenHistory.hpp>
+#include <FGenStatCache.hpp>
+
+/*
+ * Runs a 'FrontendActionFactory' on a list of input files or on files
+ * which are handed over one at a time by a callback. If more than
+ * one job is requested, the files are distributed over a set of worker
+ * threads, each of them running its own 'ClangTool' for a single file
+ * at a time. With a history of previous runs, the files predicted to
+ * take the longest are started first. With a memory budget, a file is
+ * only started if its predicted footprint fits into the memory left by
+ * the running files.
+ */
+
+class FGenRunner {
+public:
+    FGenRunner(const clang::tooling::CompilationDatabase &Database,
+               clang::tooling::FrontendActionFactory &Factory);
+
+    void setArgumentsAdjuster(clang::tooling::ArgumentsAdjuster Adjuster);
+    void setStatCache(llvm::IntrusiveRefCntPtr<FGenStatCache> StatCache);
+    void setJobs(unsigned int Jobs);
+    unsigned int jobs() const;
+
+    void setMaxMemory(uint64_t Bytes);
+    uint64_t maxMemory() const;
+
+    void setHistory(std::shared_ptr<const FGenHistory> History);
+    std::shared_ptr<const FGenHistory> history() const;
+
+    int run(llvm::ArrayRef<std::string> Files);
+    int run(const std::function<bool(std::string &)> &NextFile);
+
+private:
+    llvm::IntrusiveRefCntPtr<FGenStatCache> createThreadStatCache() const;
+
+    int runFiles(llvm::ArrayRef<std::string> Files,
+                 llvm::IntrusiveRefCntPtr<FGenStatCache> StatCache);
+
+    std::vector<uint64_t> estimateMemory(llvm::ArrayRef<std::string> Files,
+                                         llvm::ArrayRef<std::string> Keys,
+                                         size_t Jobs) const;
+    std::vector<size_t> schedule(llvm::ArrayRef<std::string> Files,
+                                 llvm::ArrayRef<std::string> Keys) const;
+    void acquireMemory(uint64_t Bytes);
+    void releaseMemory(uint64_t Bytes);
+
+    const clang::tooling::CompilationDatabase &Database_;
+    clang::tooling::FrontendActionFactory &Factory_;
+
+    clang::tooling::ArgumentsAdjuster Adjuster_;
+    llvm::IntrusiveRefCntPtr<FGenStatCache> StatCache_;
+    unsigned int Jobs_;
+
+    uint64_t MaxMemory_;
+    std::shared_ptr<const FGenHistory> History_;
+
+    std::mutex Mutex_;
+    std::condition_variable Condition_;
+    uint64_t MemoryInUse_;
+    unsigned int NumRunning_;
+};
+
+#endif /* FGEN_FGENRUNNER_HPP_ */
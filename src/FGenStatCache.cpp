@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <util/File.hpp>
+#include <util/Statistics.hpp>
+
+#include <FGenStatCache.hpp>
+
+static util::stats::Counter NumStatCacheHits(
+    "stat-cache-hits", "Number of file status lookups served by the cache");
+static util::stats::Counter NumStatCacheMisses(
+    "stat-cache-misses", "Number of file status lookups passed to the system");
+static util::stats::Counter NumStatCacheOutdated(
+    "stat-cache-outdated", "Number of stored failed lookups found outdated");
+
+static const llvm::StringRef StatCacheMagic = "fgen-stat-cache 2";
+
+static std::string getDirectoryStamp(llvm::StringRef Directory)
+{
+    /*
+     * Creating a file changes the modification time of its directory.
+     * A directory which does not exist gets the stamp "-" instead, as
+     * creating it changes the time of its parent only.
+     */
+    llvm::sys::fs::file_status Status;
+
+    if (llvm::sys::fs::status(Directory, Status))
+        return "-";
+
+    auto MTime = Status.getLastModificationTime().time_since_epoch();
+
+    return std::to_string(MTime.count());
+}
+
+static llvm::StringRef
+getCachedDirectoryStamp(llvm::StringMap<std::string> &Stamps,
+                        llvm::StringRef Path)
+{
+    auto Directory = llvm::sys::path::parent_path(Path);
+
+    auto Result = Stamps.try_emplace(Directory);
+    if (Result.second)
+        Result.first->getValue() = getDirectoryStamp(Directory);
+
+    return Result.first->getValue();
+}
+
+FGenStatCache::FGenStatCache(
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FileSystem)
+    : llvm::vfs::ProxyFileSystem(std::move(FileSystem)),
+      Storage_(std::make_shared<Storage>()),
+      Mutex_(),
+      WorkingDirectory_()
+{
+    auto WorkingDirectory = ProxyFileSystem::getCurrentWorkingDirectory();
+    if (WorkingDirectory)
+        WorkingDirectory_ = std::move(*WorkingDirectory);
+}
+
+FGenStatCache::FGenStatCache(
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FileSystem,
+    const FGenStatCache &Other)
+    : llvm::vfs::ProxyFileSystem(std::move(FileSystem)),
+      Storage_(Other.Storage_),
+      Mutex_(),
+      WorkingDirectory_()
+{
+    auto WorkingDirectory = ProxyFileSystem::getCurrentWorkingDirectory();
+    if (WorkingDirectory)
+        WorkingDirectory_ = std::move(*WorkingDirectory);
+}
+
+bool FGenStatCache::load(llvm::StringRef File, std::string &ErrMsg)
+{
+    auto Buffer = llvm::MemoryBuffer::getFile(File);
+    if (!Buffer) {
+        /* There is nothing to warm up from on the very first run. */
+        if (Buffer.getError() == std::errc::no_such_file_or_directory)
+            return true;
+
+        ErrMsg = Buffer.getError().message();
+        return false;
+    }
+
+    llvm::SmallVector<llvm::StringRef, 0> Lines;
+    (*Buffer)->getBuffer().split(Lines, '\n', -1, false);
+
+    if (Lines.empty() || Lines[0] != StatCacheMagic) {
+        ErrMsg = "invalid stat cache file";
+        return false;
+    }
+
+    /*
+     * Every failed lookup was stored along with the stamp of its
+     * directory. If the stamp changed, the file may exist by now.
+     */
+    llvm::StringMap<std::string> Stamps;
+    std::vector<llvm::StringRef> Missing;
+
+    for (auto It = std::next(Lines.begin()); It != Lines.end(); ++It) {
+        llvm::StringRef Stamp, Path;
+        std::tie(Stamp, Path) = It->split(' ');
+
+        if (Stamp.empty() || Path.empty()) {
+            ErrMsg = "invalid stat cache file";
+            return false;
+        }
+
+        if (getCachedDirectoryStamp(Stamps, Path) != Stamp) {
+            ++NumStatCacheOutdated;
+            continue;
+        }
+
+        Missing.push_back(Path);
+    }
+
+    std::lock_guard<std::mutex> Lock(Storage_->Mutex);
+
+    for (auto Path : Missing)
+        Storage_->Entries[Path] = llvm::None;
+
+    return true;
+}
+
+bool FGenStatCache::save(llvm::StringRef File, std::string &ErrMsg) const
+{
+    std::string Content;
+    llvm::raw_string_ostream OS(Content);
+
+    std::vector<std::string> Missing;
+
+    {
+        std::lock_guard<std::mutex> Lock(Storage_->Mutex);
+
+        for (const auto &Entry : Storage_->Entries) {
+            if (!Entry.getValue())
+                Missing.push_back(Entry.getKey().str());
+        }
+    }
+
+    OS << StatCacheMagic << "\n";
+
+    llvm::StringMap<std::string> Stamps;
+
+    for (const auto &Path : Missing) {
+        /* The file may have been created since it was looked up */
+        if (llvm::sys::fs::exists(Path))
+            continue;
+
+        OS << getCachedDirectoryStamp(Stamps, Path) << " " << Path << "\n";
+    }
+
+    OS.flush();
+
+    return util::file::writeAtomic(File, Content, ErrMsg);
+}
+
+llvm::ErrorOr<llvm::vfs::Status>
+FGenStatCache::status(const llvm::Twine &Path)
+{
+    auto Key = getKey(Path);
+
+    {
+        std::lock_guard<std::mutex> Lock(Storage_->Mutex);
+
+        auto It = Storage_->Entries.find(Key);
+        if (It != Storage_->Entries.end()) {
+            ++NumStatCacheHits;
+
+            auto &Status = It->getValue();
+            if (!Status)
+                return std::make_error_code(std::errc::no_such_file_or_directory);
+
+            /* Callers expect the status to carry the name they asked for */
+            return llvm::vfs::Status::copyWithNewName(*Status, Path);
+        }
+    }
+
+    ++NumStatCacheMisses;
+
+    auto Result = ProxyFileSystem::status(Path);
+
+    std::lock_guard<std::mutex> Lock(Storage_->Mutex);
+
+    if (Result)
+        Storage_->Entries[Key] = *Result;
+    else if (Result.getError() == std::errc::no_such_file_or_directory)
+        Storage_->Entries[Key] = llvm::None;
+
+    return Result;
+}
+
+llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+FGenStatCache::openFileForRead(const llvm::Twine &Path)
+{
+    /*
+     * The file manager tries to open header files directly instead of
+     * calling 'status()' first. Answer these attempts from the cache,
+     * too, if the file is known to be missing.
+     */
+    if (isKnownMissing(getKey(Path))) {
+        ++NumStatCacheHits;
+        return std::make_error_code(std::errc::no_such_file_or_directory);
+    }
+
+    auto Result = ProxyFileSystem::openFileForRead(Path);
+    if (!Result && Result.getError() == std::errc::no_such_file_or_directory) {
+        auto Key = getKey(Path);
+
+        std::lock_guard<std::mutex> Lock(Storage_->Mutex);
+        Storage_->Entries[Key] = llvm::None;
+    }
+
+    return Result;
+}
+
+llvm::ErrorOr<std::string> FGenStatCache::getCurrentWorkingDirectory() const
+{
+    std::lock_guard<std::mutex> Lock(Mutex_);
+
+    return WorkingDirectory_;
+}
+
+std::error_code
+FGenStatCache::setCurrentWorkingDirectory(const llvm::Twine &Path)
+{
+    auto Error = ProxyFileSystem::setCurrentWorkingDirectory(Path);
+    if (Error)
+        return Error;
+
+    auto WorkingDirectory = ProxyFileSystem::getCurrentWorkingDirectory();
+    if (!WorkingDirectory)
+        return WorkingDirectory.getError();
+
+    std::lock_guard<std::mutex> Lock(Mutex_);
+    WorkingDirectory_ = std::move(*WorkingDirectory);
+
+    return std::error_code();
+}
+
+std::string FGenStatCache::getKey(const llvm::Twine &Path) const
+{
+    llvm::SmallString<256> Key;
+
+    Path.toVector(Key);
+
+    /*
+     * Relative paths are resolved against the working directory which
+     * changes with every compile command. Use the working directory
+     * known to this object instead of asking the system every time.
+     */
+    if (llvm::sys::path::is_relative(Key)) {
+        llvm::SmallString<256> Absolute;
+
+        {
+            std::lock_guard<std::mutex> Lock(Mutex_);
+            Absolute = WorkingDirectory_;
+        }
+
+        llvm::sys::path::append(Absolute, Key);
+        Key = std::move(Absolute);
+    }
+
+    llvm::sys::path::remove_dots(Key, false);
+
+    return Key.str().str();
+}
+
+bool FGenStatCache::isKnownMissing(const std::string &Key)
+{
+    std::lock_guard<std::mutex> Lock(Storage_->Mutex);
+
+    auto It = Storage_->Entries.find(Key);
+
+    return It != Storage_->Entries.end() && !It->getValue();
+}
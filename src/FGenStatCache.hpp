@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FGEN_FGENSTATCACHE_HPP_
+#define FGEN_FGENSTATCACHE_HPP_
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/VirtualFileSystem.h>
+
+/*
+ * File system which remembers the result of every 'stat()' call
+ * issued by the translation units of a run. The header search of
+ * every translation unit probes the same include directories for the
+ * same headers, so most of these calls only need to be performed once.
+ *
+ * Multiple instances may share their entries, e.g. one instance per
+ * thread, where each thread works with its own working directory.
+ *
+ * Failed lookups can be stored in a file and be used to warm up the
+ * cache of later runs. Each one is stored with the modification time of
+ * its directory and is dropped once that time changes. Successful
+ * lookups are never persisted as the file sizes and modification times
+ * they carry may be outdated by then.
+ */
+
+class FGenStatCache : public llvm::vfs::ProxyFileSystem {
+public:
+    explicit FGenStatCache(
+        llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FileSystem);
+    FGenStatCache(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FileSystem,
+                  const FGenStatCache &Other);
+
+    bool load(llvm::StringRef File, std::string &ErrMsg);
+    bool save(llvm::StringRef File, std::string &ErrMsg) const;
+
+    virtual llvm::ErrorOr<llvm::vfs::Status>
+    status(const llvm::Twine &Path) override;
+
+    virtual llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+    openFileForRead(const llvm::Twine &Path) override;
+
+    virtual llvm::ErrorOr<std::string>
+    getCurrentWorkingDirectory() const override;
+
+    virtual std::error_code
+    setCurrentWorkingDirectory(const llvm::Twine &Path) override;
+
+private:
+    struct Storage {
+        std::mutex Mutex;
+        llvm::StringMap<llvm::Optional<llvm::vfs::Status>> Entries;
+    };
+
+    std::string getKey(const llvm::Twine &Path) const;
+    bool isKnownMissing(const std::string &Key);
+
+    std::shared_ptr<Storage> Storage_;
+
+    mutable std::mutex Mutex_;
+    std::string WorkingDirectory_;
+};
+
+#endif /* FGEN_FGENSTATCACHE_HPP_ */
@@ -15,8 +15,60 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <thread>
+
+#include <clang/AST/ExternalASTSource.h>
+#include <clang/Lex/Lexer.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+
 #include <FGenVisitor.hpp>
 #include <util/Decl.hpp>
+#include <util/Statistics.hpp>
+
+static util::stats::Counter NumDeclsTraversed(
+    "decls-traversed", "Number of declarations entered by the visitor");
+static util::stats::Counter NumDeclsPruned(
+    "decls-pruned", "Number of declarations skipped with their children");
+static util::stats::Counter NumStmtsSkipped(
+    "stmts-skipped", "Number of statements not entered by the visitor");
+static util::stats::Counter NumChunksGenerated(
+    "chunks-generated", "Number of function chunks generated in parallel");
+
+/*
+ * Every thread gets at least this many functions. Translation units
+ * with fewer than two chunks are generated by a single thread. The
+ * value is a conservative choice and has not been tuned.
+ */
+static constexpr size_t MinChunkSize = 1024;
+
+static clang::SourceRange getRange(const clang::Decl *Decl)
+{
+    auto &Context = Decl->getASTContext();
+    auto &SM = Context.getSourceManager();
+    auto Range = Decl->getSourceRange();
+
+    /* A function template starts with its template parameter list */
+    auto FunctionDecl = clang::dyn_cast<clang::FunctionDecl>(Decl);
+    if (FunctionDecl && FunctionDecl->getDescribedFunctionTemplate())
+        Range = FunctionDecl->getDescribedFunctionTemplate()->getSourceRange();
+
+    auto Begin = SM.getExpansionLoc(Range.getBegin());
+    auto End = SM.getExpansionRange(Range.getEnd()).getEnd();
+
+    /*
+     * The end of a declaration's range is the beginning of its last
+     * token. Make it point past the token, so a location on the last
+     * token is inside of the range.
+     */
+    auto EndOfToken = clang::Lexer::getLocForEndOfToken(End, 0, SM,
+                                                        Context.getLangOpts());
+    if (EndOfToken.isValid())
+        End = EndOfToken;
+
+    return {Begin, End};
+}
 
 static bool isUserProvided(const clang::FunctionDecl *FunctionDecl)
 {
@@ -25,15 +77,77 @@ static bool isUserProvided(const clang::FunctionDecl *FunctionDecl)
     return !MethodDecl || MethodDecl->isUserProvided();
 }
 
+static void
+generateFunctions(FunctionGenerator &Generator,
+                  llvm::ArrayRef<const clang::FunctionDecl *> Functions)
+{
+    llvm::SmallVector<const clang::CXXMethodDecl *, 16> Methods;
+
+    /*
+     * Hand the methods of a record over to the generator all at once.
+     * The batch ends with the first function which does not belong to
+     * the record, e.g. a method of a nested record. This keeps the
+     * output in declaration order.
+     */
+    for (auto FunctionDecl : Functions) {
+        auto MethodDecl = clang::dyn_cast<clang::CXXMethodDecl>(FunctionDecl);
+
+        if (!Methods.empty()) {
+            bool SameRecord = MethodDecl &&
+                              MethodDecl->getParent() ==
+                                  Methods.front()->getParent();
+
+            if (!SameRecord) {
+                Generator.add(Methods);
+                Methods.clear();
+            }
+        }
+
+        if (MethodDecl)
+            Methods.push_back(MethodDecl);
+        else
+            Generator.add(FunctionDecl);
+    }
+
+    Generator.add(Methods);
+}
+
 FGenVisitor::FGenVisitor()
-    : VisitedDecls_(),
+    : InputFiles_(),
+      InputFileIDs_(),
+      GenerateInputFiles_(false),
+      Functions_(),
+      Candidates_(),
+      USRs_(nullptr),
+      Filter_(nullptr),
+      Range_(),
+      RangeRecord_(nullptr),
+      RangeFunctions_(),
+      RecordFunctions_(),
+      Allocator_(),
+      Saver_(Allocator_),
+      VisitedDecls_(),
+      USRBuffer_(),
       QualifiedNameBuffer_(),
+      NumTraversed_(0),
+      NumPruned_(0),
+      NumBodiesSkipped_(0),
       FunctionGenerator_(),
+      Generators_(),
+      IR_(nullptr),
       Configuration_(nullptr)
 {
     QualifiedNameBuffer_.reserve(1024);
 }
 
+FGenVisitor::~FGenVisitor()
+{
+    /* Avoid contention on the shared counters while traversing */
+    NumDeclsTraversed += NumTraversed_;
+    NumDeclsPruned += NumPruned_;
+    NumStmtsSkipped += NumBodiesSkipped_;
+}
+
 void FGenVisitor::setConfiguration(
     std::shared_ptr<FGenConfiguration> Configuration)
 {
@@ -42,6 +156,121 @@ void FGenVisitor::setConfiguration(
     FunctionGenerator_.setConfiguration(Configuration_);
 }
 
+void FGenVisitor::addConfiguration(
+    std::shared_ptr<FGenConfiguration> Configuration)
+{
+    /*
+     * Only the generation options of an additional configuration are
+     * used. Which functions get generated is decided by the main one.
+     */
+    auto Generator = llvm::make_unique<FunctionGenerator>();
+    Generator->setConfiguration(std::move(Configuration));
+
+    Generators_.push_back(std::move(Generator));
+}
+
+void FGenVisitor::setInputFiles(llvm::ArrayRef<std::string> Files)
+{
+    /*
+     * If input files are set, the main file is not the file of interest
+     * and the matching declarations are only collected. This is used to
+     * find the declarations of the input files which lack a definition
+     * in the main file.
+     */
+    InputFiles_.clear();
+    InputFileIDs_.clear();
+
+    for (const auto &File : Files)
+        InputFiles_.insert(File);
+
+    GenerateInputFiles_ = false;
+}
+
+void FGenVisitor::setTargetFiles(llvm::ArrayRef<std::string> Files)
+{
+    /*
+     * The functions declared in these files are generated instead of
+     * the ones declared in the main file, e.g. the functions of the
+     * header belonging to the main file of a compiler invocation.
+     */
+    setInputFiles(Files);
+
+    GenerateInputFiles_ = true;
+}
+
+bool FGenVisitor::shouldVisitTemplateInstantiations() const
+{
+    return false;
+}
+
+bool FGenVisitor::shouldVisitImplicitCode() const
+{
+    return false;
+}
+
+bool FGenVisitor::TraverseDecl(clang::Decl *Decl)
+{
+    if (!Decl)
+        return true;
+
+    /*
+     * A declaration outside of the files of interest cannot contain
+     * a declaration inside of them. Skip it with all of its children,
+     * e.g. whole namespaces of included library headers.
+     */
+    if (!clang::isa<clang::TranslationUnitDecl>(Decl)) {
+        auto &SM = Decl->getASTContext().getSourceManager();
+
+        if (Range_.isValid())
+            return TraverseDeclInRange(Decl);
+
+        if (!isInTargetFile(SM, Decl->getLocation())) {
+            ++NumPruned_;
+            return true;
+        }
+
+        ++NumTraversed_;
+
+        return RecursiveASTVisitor::TraverseDecl(Decl);
+    }
+
+    ++NumTraversed_;
+
+    auto Result = RecursiveASTVisitor::TraverseDecl(Decl);
+
+    if (Range_.isValid())
+        addRangeFunctions();
+
+    generate();
+
+    return Result;
+}
+
+bool FGenVisitor::TraverseStmt(clang::Stmt *Stmt, DataRecursionQueue *Queue)
+{
+    (void) Queue;
+
+    /*
+     * Function bodies, default arguments, initializers and lambdas are
+     * never needed to generate a function. Do not enter them at all.
+     */
+    if (Stmt)
+        ++NumBodiesSkipped_;
+
+    return true;
+}
+
+bool FGenVisitor::TraverseTypeLoc(clang::TypeLoc TypeLoc)
+{
+    /*
+     * Type locations lead to parameter declarations and their default
+     * arguments, none of which are of any interest.
+     */
+    (void) TypeLoc;
+
+    return true;
+}
+
 bool FGenVisitor::VisitFunctionDecl(clang::FunctionDecl *FunctionDecl)
 {
     /*
@@ -60,11 +289,67 @@ void FGenVisitor::dump(llvm::raw_ostream &OStream) const
     FunctionGenerator_.dump(OStream);
 }
 
+void FGenVisitor::dump(size_t Output, llvm::raw_ostream &OStream) const
+{
+    if (!Output)
+        FunctionGenerator_.dump(OStream);
+    else
+        Generators_[Output - 1]->dump(OStream);
+}
+
+void FGenVisitor::setDeclCache(size_t Output,
+                               std::shared_ptr<FGenDeclCache> DeclCache)
+{
+    if (!Output)
+        FunctionGenerator_.setDeclCache(std::move(DeclCache));
+    else
+        Generators_[Output - 1]->setDeclCache(std::move(DeclCache));
+}
+
+void FGenVisitor::setIR(std::shared_ptr<FGenIR> IR)
+{
+    IR_ = std::move(IR);
+}
+
+void FGenVisitor::setRange(clang::SourceRange Range)
+{
+    /*
+     * The range consists of file locations. Its end is the location of
+     * its last character, which is equal to its beginning for a single
+     * location.
+     */
+    Range_ = Range;
+}
+
+void FGenVisitor::setUSRs(const llvm::StringSet<> *USRs)
+{
+    /*
+     * If a set of USRs is given, exactly these functions are generated,
+     * regardless of the file they are declared in.
+     */
+    USRs_ = USRs;
+}
+
+void FGenVisitor::setFilter(
+    std::function<bool(const clang::FunctionDecl *)> Filter)
+{
+    /*
+     * A filter decides on its own which functions are of interest. They
+     * may be declared in any file of the translation unit.
+     */
+    Filter_ = std::move(Filter);
+}
+
+const std::vector<const clang::FunctionDecl *> &FGenVisitor::functions() const
+{
+    return Functions_;
+}
+
 void FGenVisitor::VisitFunctionDeclImpl(const clang::FunctionDecl *FunctionDecl)
 {
     auto &SM = FunctionDecl->getASTContext().getSourceManager();
 
-    if (!SM.isInMainFile(FunctionDecl->getLocation()))
+    if (!isInTargetFile(SM, FunctionDecl->getLocation()))
         return;
 
     if (!isUserProvided(FunctionDecl))
@@ -73,23 +358,346 @@ void FGenVisitor::VisitFunctionDeclImpl(const clang::FunctionDecl *FunctionDecl)
     if (!isTarget(FunctionDecl))
         return;
 
+    if (Filter_ && !Filter_(FunctionDecl))
+        return;
+
     /* Header files may contain function definitions. Skip them. */
     if (FunctionDecl->hasBody())
         return;
 
+    bool Overlaps = false;
+
+    if (Range_.isValid()) {
+        Overlaps = overlapsRange(SM, getRange(FunctionDecl));
+
+        if (!Overlaps && !isInRangeRecord(FunctionDecl))
+            return;
+    }
+
     /*
      * Not sure if this is really necessary:
      * The idea is to avoid to print the same function skeleton
      * multiple times.
      */
-    auto USR = util::decl::generateUSR(FunctionDecl);
+    util::decl::generateUSR(FunctionDecl, USRBuffer_);
+
+    llvm::StringRef USR(USRBuffer_);
+
+    if (USRs_ && !USRs_->count(USR))
+        return;
 
     if (VisitedDecls_.count(USR))
         return;
 
-    VisitedDecls_.insert(std::move(USR));
+    VisitedDecls_.insert(Saver_.save(USR));
+
+    if (!InputFiles_.empty() && !GenerateInputFiles_) {
+        Functions_.push_back(FunctionDecl);
+        return;
+    }
+
+    /* Which of them get generated is known once the range is passed */
+    if (Range_.isValid()) {
+        auto &Functions = (Overlaps) ? RangeFunctions_ : RecordFunctions_;
+
+        Functions.push_back(FunctionDecl);
+        return;
+    }
+
+    addFunction(FunctionDecl);
+}
+
+void FGenVisitor::addFunction(const clang::FunctionDecl *FunctionDecl)
+{
+    /* The functions are generated once the traversal is done */
+    Candidates_.push_back(FunctionDecl);
+}
+
+void FGenVisitor::generate()
+{
+    size_t NumChunks = 1;
+
+    /*
+     * Generating a function only reads the AST, once the records it
+     * refers to are analyzed. This does not hold for an AST backed by
+     * an external source, e.g. a serialized AST or modules, which
+     * deserializes declarations on first access.
+     */
+    if (Configuration_ && Candidates_.size() >= 2 * MinChunkSize) {
+        auto &Context = Candidates_.front()->getASTContext();
+
+        if (!Context.getExternalSource() && !usesDeclCache()) {
+            NumChunks = std::min<size_t>(Configuration_->generatorJobs(),
+                                         Candidates_.size() / MinChunkSize);
+        }
+    }
+
+    if (NumChunks > 1) {
+        generateChunks(NumChunks);
+    } else {
+        generateFunctions(FunctionGenerator_, Candidates_);
+
+        for (auto &Generator : Generators_)
+            generateFunctions(*Generator, Candidates_);
+    }
+
+    if (IR_)
+        capture();
+
+    Candidates_.clear();
+}
+
+bool FGenVisitor::usesDeclCache() const
+{
+    /*
+     * A chunk starts with the namespaces around the last function of
+     * the previous chunk. With a declaration cache, that function may
+     * have been skipped without opening its namespaces, so chunks are
+     * not used at all.
+     */
+    const auto UsesCache = [](const FunctionGenerator &Generator) {
+        return Generator.declCache() ||
+               Generator.configuration()->changedOnly();
+    };
+
+    if (UsesCache(FunctionGenerator_))
+        return true;
+
+    for (const auto &Generator : Generators_) {
+        if (UsesCache(*Generator))
+            return true;
+    }
+
+    return false;
+}
+
+void FGenVisitor::capture()
+{
+    /*
+     * The capturing generator changes its configuration while it works,
+     * so it gets a copy of its own.
+     */
+    auto Configuration = std::make_shared<FGenConfiguration>(*Configuration_);
+
+    FunctionGenerator Generator;
+    Generator.setConfiguration(std::move(Configuration));
+
+    for (auto FunctionDecl : Candidates_)
+        Generator.capture(FunctionDecl, *IR_);
+}
+
+void FGenVisitor::generateChunks(size_t NumChunks)
+{
+    llvm::SmallVector<FunctionGenerator *, 4> Outputs;
+    Outputs.push_back(&FunctionGenerator_);
+
+    for (auto &Generator : Generators_)
+        Outputs.push_back(Generator.get());
+
+    /*
+     * Every chunk is a contiguous range of functions with a private
+     * generator for each output. A chunk's generator starts with the
+     * namespaces left open by the previous chunk, so appending the
+     * chunks in order yields exactly the output of a single generator.
+     * The first chunk is written by the generators of the outputs.
+     */
+    llvm::ArrayRef<const clang::FunctionDecl *> Functions = Candidates_;
+    std::vector<llvm::ArrayRef<const clang::FunctionDecl *>> Chunks;
+    std::vector<std::unique_ptr<FunctionGenerator>> ChunkGenerators;
+
+    auto NumOutputs = Outputs.size();
+
+    /*
+     * Analyzing a record may fill caches of the context, e.g. when the
+     * width of a bit-field is evaluated. Analyze all records up front,
+     * so the threads below only read the context.
+     */
+    FunctionGenerator Analysis;
+
+    for (auto FunctionDecl : Functions)
+        Analysis.analyze(FunctionDecl);
+
+    for (auto Output : Outputs)
+        Output->setAnalysis(&Analysis);
+
+    for (size_t i = 0; i < NumChunks; ++i) {
+        auto Begin = Functions.size() * i / NumChunks;
+        auto End = Functions.size() * (i + 1) / NumChunks;
+
+        Chunks.push_back(Functions.slice(Begin, End - Begin));
+
+        if (i == 0)
+            continue;
+
+        for (auto Output : Outputs) {
+            auto Generator = llvm::make_unique<FunctionGenerator>();
+            Generator->setConfiguration(Output->configuration());
+            Generator->setDeclCache(Output->declCache());
+            Generator->setAnalysis(&Analysis);
+            Generator->resumeAfter(Functions[Begin - 1]);
+
+            ChunkGenerators.push_back(std::move(Generator));
+        }
+    }
+
+    const auto Work = [&](size_t Index) {
+        for (size_t j = 0; j < NumOutputs; ++j) {
+            auto Generator = Outputs[j];
+
+            if (Index)
+                Generator = ChunkGenerators[(Index - 1) * NumOutputs + j].get();
+
+            generateFunctions(*Generator, Chunks[Index]);
+        }
+    };
+
+    std::vector<std::thread> Threads;
+    Threads.reserve(NumChunks - 1);
+
+    for (size_t i = 1; i < NumChunks; ++i)
+        Threads.emplace_back(Work, i);
+
+    Work(0);
+
+    for (auto &Thread : Threads)
+        Thread.join();
+
+    for (auto Output : Outputs)
+        Output->setAnalysis(nullptr);
+
+    for (size_t i = 0; i < ChunkGenerators.size(); ++i)
+        Outputs[i % NumOutputs]->append(*ChunkGenerators[i]);
+
+    NumChunksGenerated += NumChunks;
+}
+
+bool FGenVisitor::TraverseDeclInRange(clang::Decl *Decl)
+{
+    /*
+     * Implicit declarations, e.g. the builtin typedefs of the translation
+     * unit, have no location which could be compared with the range.
+     */
+    if (Decl->isImplicit())
+        return RecursiveASTVisitor::TraverseDecl(Decl);
+
+    auto &SM = Decl->getASTContext().getSourceManager();
+    auto Range = getRange(Decl);
+
+    if (Range.isInvalid())
+        return RecursiveASTVisitor::TraverseDecl(Decl);
+
+    /* The declaration ends before the range */
+    if (!SM.isBeforeInTranslationUnit(Range_.getBegin(), Range.getEnd())) {
+        ++NumPruned_;
+        return true;
+    }
+
+    /*
+     * Declarations are traversed in the order of the translation unit.
+     * Once a declaration starts behind the range, no later declaration
+     * can overlap it and the traversal stops. Only the members of the
+     * record around the range are still needed.
+     */
+    if (SM.isBeforeInTranslationUnit(Range_.getEnd(), Range.getBegin())) {
+        if (!isInRangeRecord(Decl)) {
+            ++NumPruned_;
+            return false;
+        }
+    } else if (coversRange(SM, Range)) {
+        auto RecordDecl = clang::dyn_cast<clang::CXXRecordDecl>(Decl);
+        if (RecordDecl)
+            RangeRecord_ = RecordDecl;
+    }
+
+    ++NumTraversed_;
+
+    return RecursiveASTVisitor::TraverseDecl(Decl);
+}
+
+void FGenVisitor::addRangeFunctions()
+{
+    /*
+     * Functions overlapping the range take precedence. Otherwise the
+     * range lies within a record, e.g. on its name, and all of its
+     * methods are generated.
+     */
+    if (!RangeFunctions_.empty()) {
+        for (auto FunctionDecl : RangeFunctions_)
+            addFunction(FunctionDecl);
+    } else {
+        for (auto FunctionDecl : RecordFunctions_) {
+            /* Methods of an outer record were collected as well */
+            if (isInRangeRecord(FunctionDecl))
+                addFunction(FunctionDecl);
+        }
+    }
+
+    RangeFunctions_.clear();
+    RecordFunctions_.clear();
+}
+
+bool FGenVisitor::overlapsRange(const clang::SourceManager &SM,
+                                clang::SourceRange Range) const
+{
+    /* 'Range' ends past its last character, 'Range_' does not */
+    return !SM.isBeforeInTranslationUnit(Range_.getEnd(), Range.getBegin()) &&
+           SM.isBeforeInTranslationUnit(Range_.getBegin(), Range.getEnd());
+}
+
+bool FGenVisitor::coversRange(const clang::SourceManager &SM,
+                              clang::SourceRange Range) const
+{
+    return !SM.isBeforeInTranslationUnit(Range_.getBegin(), Range.getBegin()) &&
+           SM.isBeforeInTranslationUnit(Range_.getEnd(), Range.getEnd());
+}
+
+bool FGenVisitor::isInRangeRecord(const clang::Decl *Decl) const
+{
+    if (!RangeRecord_)
+        return false;
+
+    return RangeRecord_->Encloses(Decl->getLexicalDeclContext());
+}
+
+bool FGenVisitor::isInTargetFile(const clang::SourceManager &SM,
+                                 clang::SourceLocation Loc)
+{
+    /*
+     * The functions of a project may be declared in any file and a
+     * range may be located in any file of the translation unit. The
+     * same applies to the functions accepted by a filter.
+     */
+    if (USRs_ || Range_.isValid() || Filter_)
+        return true;
+
+    if (!InputFiles_.empty())
+        return isInputFile(SM, Loc);
+
+    return SM.isInMainFile(Loc);
+}
+
+bool FGenVisitor::isInputFile(const clang::SourceManager &SM,
+                              clang::SourceLocation Loc)
+{
+    auto FileID = SM.getFileID(SM.getExpansionLoc(Loc));
+
+    /* Resolving the real path is expensive, so do it once per file */
+    auto Result = InputFileIDs_.insert({FileID, false});
+    if (!Result.second)
+        return Result.first->second;
+
+    auto FileEntry = SM.getFileEntryForID(FileID);
+    if (!FileEntry)
+        return false;
+
+    llvm::SmallString<256> Path(FileEntry->tryGetRealPathName());
+
+    if (Path.empty() && llvm::sys::fs::real_path(FileEntry->getName(), Path))
+        return false;
+
+    Result.first->second = InputFiles_.count(Path) != 0;
 
-    FunctionGenerator_.add(FunctionDecl);
+    return Result.first->second;
 }
 
 bool FGenVisitor::isTarget(const clang::FunctionDecl *FunctionDecl)
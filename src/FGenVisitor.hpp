@@ -18,32 +18,124 @@
 #ifndef FGEN_FGENVISITOR_HPP_
 #define FGEN_FGENVISITOR_HPP_
 
-#include <unordered_set>
+#include <functional>
+#include <memory>
+#include <vector>
 
 #include <clang/AST/RecursiveASTVisitor.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/Allocator.h>
+#include <llvm/Support/StringSaver.h>
 
 #include <FunctionGenerator.hpp>
 
+/*
+ * Threading contract: a visitor is used by a single thread. Traversing
+ * a context and analyzing its records may fill caches of the context,
+ * so at most one visitor may traverse a context at any time. Generating
+ * the definitions afterwards only reads the context. Large translation
+ * units are therefore split into chunks, which are generated by threads
+ * of their own, once all records are analyzed by the visitor's thread.
+ */
+
 class FGenVisitor : public clang::RecursiveASTVisitor<FGenVisitor> {
 public:
     FGenVisitor();
+    ~FGenVisitor();
 
     void setConfiguration(std::shared_ptr<FGenConfiguration> Configuration);
+    void addConfiguration(std::shared_ptr<FGenConfiguration> Configuration);
+    void setInputFiles(llvm::ArrayRef<std::string> Files);
+    void setTargetFiles(llvm::ArrayRef<std::string> Files);
+    void setUSRs(const llvm::StringSet<> *USRs);
+    void setFilter(std::function<bool(const clang::FunctionDecl *)> Filter);
+    void setRange(clang::SourceRange Range);
+    void setDeclCache(size_t Output, std::shared_ptr<FGenDeclCache> DeclCache);
+    void setIR(std::shared_ptr<FGenIR> IR);
+
+    bool shouldVisitTemplateInstantiations() const;
+    bool shouldVisitImplicitCode() const;
+
+    bool TraverseDecl(clang::Decl *Decl);
+    bool TraverseStmt(clang::Stmt *Stmt, DataRecursionQueue *Queue = nullptr);
+    bool TraverseTypeLoc(clang::TypeLoc TypeLoc);
 
     bool VisitFunctionDecl(clang::FunctionDecl *FunctionDecl);
 
     void dump(llvm::raw_ostream &OStream = llvm::outs()) const;
+    void dump(size_t Output, llvm::raw_ostream &OStream) const;
+
+    const std::vector<const clang::FunctionDecl *> &functions() const;
 
 private:
     void VisitFunctionDeclImpl(const clang::FunctionDecl *FunctionDecl);
+    void addFunction(const clang::FunctionDecl *FunctionDecl);
+    void generate();
+    void generateChunks(size_t NumChunks);
+    bool usesDeclCache() const;
+    void capture();
+
+    bool TraverseDeclInRange(clang::Decl *Decl);
+    void addRangeFunctions();
+    bool overlapsRange(const clang::SourceManager &SM,
+                       clang::SourceRange Range) const;
+    bool coversRange(const clang::SourceManager &SM,
+                     clang::SourceRange Range) const;
+    bool isInRangeRecord(const clang::Decl *Decl) const;
 
+    bool isInTargetFile(const clang::SourceManager &SM,
+                        clang::SourceLocation Loc);
+    bool isInputFile(const clang::SourceManager &SM, clang::SourceLocation Loc);
     bool isTarget(const clang::FunctionDecl *Decl);
 
-    std::unordered_set<std::string> VisitedDecls_;
+    llvm::StringSet<> InputFiles_;
+    llvm::DenseMap<clang::FileID, bool> InputFileIDs_;
+    bool GenerateInputFiles_;
+    std::vector<const clang::FunctionDecl *> Functions_;
+    std::vector<const clang::FunctionDecl *> Candidates_;
+    const llvm::StringSet<> *USRs_;
+    std::function<bool(const clang::FunctionDecl *)> Filter_;
+
+    /*
+     * Only the functions overlapping 'Range_' are generated. If there
+     * are none, the methods of the innermost record around the range
+     * are generated instead.
+     */
+    clang::SourceRange Range_;
+    const clang::CXXRecordDecl *RangeRecord_;
+    std::vector<const clang::FunctionDecl *> RangeFunctions_;
+    std::vector<const clang::FunctionDecl *> RecordFunctions_;
+
+    /*
+     * The visitor lives for a single translation unit. The USRs of all
+     * visited declarations are kept in an arena which is released as a
+     * whole once the visitor is destroyed.
+     */
+    llvm::BumpPtrAllocator Allocator_;
+    llvm::StringSaver Saver_;
+
+    llvm::DenseSet<llvm::StringRef> VisitedDecls_;
+    llvm::SmallString<128> USRBuffer_;
     std::string QualifiedNameBuffer_;
 
+    uint64_t NumTraversed_;
+    uint64_t NumPruned_;
+    uint64_t NumBodiesSkipped_;
+
     FunctionGenerator FunctionGenerator_;
 
+    /*
+     * Generators of additional outputs. They get the same functions
+     * as the main generator, but may generate different definitions.
+     */
+    std::vector<std::unique_ptr<FunctionGenerator>> Generators_;
+
+    /* Receives the generated functions, if present */
+    std::shared_ptr<FGenIR> IR_;
+
     std::shared_ptr<FGenConfiguration> Configuration_;
 };
 
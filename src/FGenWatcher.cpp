@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/Path.h>
+
+#include <FGenWatcher.hpp>
+
+/*
+ * Editors tend to produce a burst of events when saving a file,
+ * e.g. by writing a backup file, truncating and writing the file and
+ * updating its attributes. Events which arrive within this time span
+ * of each other get coalesced into a single regeneration.
+ */
+static constexpr int DebounceTimeoutMs = 20;
+
+static constexpr uint32_t WatchMask =
+    IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE;
+
+FGenWatcher::FGenWatcher()
+    : Fd_(-1),
+      Directories_(),
+      WatchDescriptors_(),
+      Dependencies_(),
+      Dependents_()
+{}
+
+FGenWatcher::~FGenWatcher()
+{
+    if (Fd_ >= 0)
+        close(Fd_);
+}
+
+bool FGenWatcher::init(std::string &ErrMsg)
+{
+    Fd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (Fd_ < 0) {
+        ErrMsg = std::strerror(errno);
+        return false;
+    }
+
+    return true;
+}
+
+bool FGenWatcher::watch(const std::string &Input,
+                        llvm::ArrayRef<std::string> Dependencies,
+                        std::string &ErrMsg)
+{
+    /*
+     * The include closure of an input file may change with every
+     * regeneration, so forget about the previously known dependencies.
+     * Watched directories are kept as they are cheap and are likely
+     * to be needed again.
+     */
+    auto &OldDependencies = Dependencies_[Input];
+
+    for (const auto &File : OldDependencies)
+        Dependents_[File].erase(Input);
+
+    OldDependencies.assign(Dependencies.begin(), Dependencies.end());
+
+    /* Make sure that changes to the input file itself are always noticed */
+    if (llvm::find(OldDependencies, Input) == OldDependencies.end())
+        OldDependencies.push_back(Input);
+
+    for (const auto &File : OldDependencies) {
+        Dependents_[File].insert(Input);
+
+        auto Directory = llvm::sys::path::parent_path(File);
+        if (!watchDirectory(Directory, ErrMsg))
+            return false;
+    }
+
+    return true;
+}
+
+bool FGenWatcher::wait(std::set<std::string> &Inputs, std::string &ErrMsg)
+{
+    struct pollfd PollFd = {Fd_, POLLIN, 0};
+
+    Inputs.clear();
+
+    /*
+     * Block until some event concerning a watched file arrives. After
+     * that, keep on reading until no new events arrive within the
+     * debounce interval.
+     */
+    auto Timeout = -1;
+
+    while (true) {
+        auto Ready = poll(&PollFd, 1, Timeout);
+        if (Ready < 0) {
+            if (errno == EINTR)
+                continue;
+
+            ErrMsg = std::strerror(errno);
+            return false;
+        }
+
+        if (Ready == 0) {
+            if (!Inputs.empty())
+                return true;
+
+            Timeout = -1;
+            continue;
+        }
+
+        if (!readEvents(Inputs, ErrMsg))
+            return false;
+
+        /* Only start the debounce interval once a relevant event arrived */
+        if (!Inputs.empty())
+            Timeout = DebounceTimeoutMs;
+    }
+}
+
+bool FGenWatcher::watchDirectory(llvm::StringRef Directory,
+                                 std::string &ErrMsg)
+{
+    if (Directory.empty())
+        Directory = ".";
+
+    auto Path = Directory.str();
+
+    if (WatchDescriptors_.count(Path))
+        return true;
+
+    auto Wd = inotify_add_watch(Fd_, Path.c_str(), WatchMask);
+    if (Wd < 0) {
+        ErrMsg = "failed to watch \"" + Path + "\": " + std::strerror(errno);
+        return false;
+    }
+
+    Directories_[Wd] = Path;
+    WatchDescriptors_[std::move(Path)] = Wd;
+
+    return true;
+}
+
+bool FGenWatcher::readEvents(std::set<std::string> &Inputs,
+                             std::string &ErrMsg)
+{
+    alignas(struct inotify_event) char Buffer[4096];
+
+    while (true) {
+        auto Size = read(Fd_, Buffer, sizeof(Buffer));
+        if (Size < 0) {
+            if (errno == EAGAIN)
+                return true;
+
+            if (errno == EINTR)
+                continue;
+
+            ErrMsg = std::strerror(errno);
+            return false;
+        }
+
+        auto Ptr = Buffer;
+        auto End = Buffer + Size;
+
+        while (Ptr < End) {
+            auto Event = reinterpret_cast<const struct inotify_event *>(Ptr);
+
+            Ptr += sizeof(*Event) + Event->len;
+
+            if (!Event->len)
+                continue;
+
+            auto It = Directories_.find(Event->wd);
+            if (It == Directories_.end())
+                continue;
+
+            llvm::SmallString<256> File(It->second);
+            llvm::sys::path::append(File, Event->name);
+
+            auto DependentIt = Dependents_.find(File.str().str());
+            if (DependentIt == Dependents_.end())
+                continue;
+
+            auto &Dependents = DependentIt->second;
+            Inputs.insert(Dependents.begin(), Dependents.end());
+        }
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FGEN_FGENWATCHER_HPP_
+#define FGEN_FGENWATCHER_HPP_
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+
+/*
+ * Uses 'inotify' to watch the input files and their include closures.
+ * Directories are watched instead of the files themselves, as a lot of
+ * editors save a file by writing a temporary file and renaming it,
+ * which would silently invalidate a watch on the file.
+ */
+
+class FGenWatcher {
+public:
+    FGenWatcher();
+    ~FGenWatcher();
+
+    FGenWatcher(const FGenWatcher &Other) = delete;
+    FGenWatcher &operator=(const FGenWatcher &Other) = delete;
+
+    bool init(std::string &ErrMsg);
+
+    bool watch(const std::string &Input,
+               llvm::ArrayRef<std::string> Dependencies,
+               std::string &ErrMsg);
+
+    bool wait(std::set<std::string> &Inputs, std::string &ErrMsg);
+
+private:
+    bool watchDirectory(llvm::StringRef Directory, std::string &ErrMsg);
+    bool readEvents(std::set<std::string> &Inputs, std::string &ErrMsg);
+
+    int Fd_;
+
+    std::unordered_map<int, std::string> Directories_;
+    std::unordered_map<std::string, int> WatchDescriptors_;
+
+    std::unordered_map<std::string, std::vector<std::string>> Dependencies_;
+    std::unordered_map<std::string, std::set<std::string>> Dependents_;
+};
+
+#endif /* FGEN_FGENWATCHER_HPP_ */
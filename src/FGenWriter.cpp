@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <util/File.hpp>
+#include <util/Statistics.hpp>
+
+#include <FGenWriter.hpp>
+
+static util::stats::Counter NumFilesWritten(
+    "writer-files", "Number of output files written asynchronously");
+static util::stats::Counter WriterStallUs(
+    "writer-stall-us", "Time spent waiting for pending writes (microseconds)");
+
+FGenWriter::FGenWriter(uint64_t MaxPendingBytes)
+    : Mutex_(),
+      Condition_(),
+      Jobs_(),
+      PendingBytes_(0),
+      MaxPendingBytes_(MaxPendingBytes),
+      Busy_(false),
+      Stop_(false),
+      Errors_(),
+      Thread_()
+{
+    Thread_ = std::thread(&FGenWriter::run, this);
+}
+
+FGenWriter::~FGenWriter()
+{
+    {
+        std::lock_guard<std::mutex> Lock(Mutex_);
+        Stop_ = true;
+    }
+
+    Condition_.notify_all();
+
+    /* Pending files are still written before the thread exits */
+    Thread_.join();
+}
+
+void FGenWriter::write(std::string Path,
+                       std::string Content,
+                       llvm::sys::fs::OpenFlags Flags)
+{
+    push({std::move(Path), std::move(Content), Flags, false});
+}
+
+void FGenWriter::writeIfChanged(std::string Path, std::string Content)
+{
+    push({std::move(Path), std::move(Content), llvm::sys::fs::F_None, true});
+}
+
+bool FGenWriter::wait(std::vector<std::string> &Errors)
+{
+    std::unique_lock<std::mutex> Lock(Mutex_);
+
+    Condition_.wait(Lock, [this]() { return Jobs_.empty() && !Busy_; });
+
+    Errors = std::move(Errors_);
+    Errors_.clear();
+
+    return Errors.empty();
+}
+
+void FGenWriter::push(Job Job)
+{
+    std::unique_lock<std::mutex> Lock(Mutex_);
+
+    /*
+     * If the file system cannot keep up, the generated outputs pile up
+     * in memory. Let the frontend actions wait once too many of them
+     * are pending.
+     */
+    if (PendingBytes_ > MaxPendingBytes_) {
+        auto Start = std::chrono::steady_clock::now();
+
+        Condition_.wait(Lock, [this]() {
+            return PendingBytes_ <= MaxPendingBytes_;
+        });
+
+        auto Duration = std::chrono::steady_clock::now() - Start;
+        auto Us = std::chrono::duration_cast<std::chrono::microseconds>(
+            Duration);
+
+        WriterStallUs += Us.count();
+    }
+
+    PendingBytes_ += Job.Content.size();
+    Jobs_.push_back(std::move(Job));
+
+    Lock.unlock();
+    Condition_.notify_all();
+}
+
+void FGenWriter::run()
+{
+    std::unique_lock<std::mutex> Lock(Mutex_);
+
+    while (true) {
+        Condition_.wait(Lock, [this]() { return !Jobs_.empty() || Stop_; });
+
+        if (Jobs_.empty())
+            break;
+
+        auto Job = std::move(Jobs_.front());
+        Jobs_.pop_front();
+        Busy_ = true;
+
+        Lock.unlock();
+
+        std::string ErrMsg;
+        bool Ok = writeFile(Job, ErrMsg);
+
+        Lock.lock();
+
+        if (!Ok)
+            Errors_.push_back(std::move(ErrMsg));
+
+        PendingBytes_ -= Job.Content.size();
+        Busy_ = false;
+
+        ++NumFilesWritten;
+
+        Condition_.notify_all();
+    }
+}
+
+bool FGenWriter::writeFile(const Job &Job, std::string &ErrMsg) const
+{
+    auto Directory = llvm::sys::path::parent_path(Job.Path);
+
+    if (!Directory.empty())
+        llvm::sys::fs::create_directories(Directory);
+
+    if (Job.IfChanged) {
+        if (!util::file::writeIfChanged(Job.Path, Job.Content, ErrMsg)) {
+            ErrMsg = "failed to write file \"" + Job.Path + "\" - " + ErrMsg;
+            return false;
+        }
+
+        return true;
+    }
+
+    std::error_code Error;
+
+    llvm::raw_fd_ostream OS(Job.Path, Error, Job.Flags);
+    if (Error) {
+        ErrMsg = "failed to open file \"" + Job.Path + "\" for writing - " +
+                 Error.message();
+        return false;
+    }
+
+    OS << Job.Content;
+    OS.close();
+
+    if (OS.has_error()) {
+        ErrMsg = "failed to write file \"" + Job.Path + "\" - " +
+                 OS.error().message();
+        OS.clear_error();
+        return false;
+    }
+
+    return true;
+}
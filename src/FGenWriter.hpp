@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FGEN_FGENWRITER_HPP_
+#define FGEN_FGENWRITER_HPP_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <llvm/Support/FileSystem.h>
+
+/*
+ * Writes output files on a dedicated thread. The frontend actions hand
+ * over the generated output of a translation unit and continue with the
+ * next one while the output is written. This hides the latency of slow
+ * file systems, e.g. network file systems, behind the parsing. Files
+ * are written in the order in which they were handed over, so several
+ * outputs may be appended to the same file.
+ *
+ * Failed writes do not stop the run. The writer's thread only records
+ * them, the caller receives the error messages from 'wait()'.
+ */
+
+class FGenWriter {
+public:
+    explicit FGenWriter(uint64_t MaxPendingBytes = 64 << 20);
+    ~FGenWriter();
+
+    FGenWriter(const FGenWriter &Other) = delete;
+    FGenWriter &operator=(const FGenWriter &Other) = delete;
+
+    void write(std::string Path,
+               std::string Content,
+               llvm::sys::fs::OpenFlags Flags);
+    void writeIfChanged(std::string Path, std::string Content);
+
+    bool wait(std::vector<std::string> &Errors);
+
+private:
+    struct Job {
+        std::string Path;
+        std::string Content;
+        llvm::sys::fs::OpenFlags Flags;
+        bool IfChanged;
+    };
+
+    void push(Job Job);
+    void run();
+    bool writeFile(const Job &Job, std::string &ErrMsg) const;
+
+    std::mutex Mutex_;
+    std::condition_variable Condition_;
+    std::deque<Job> Jobs_;
+    uint64_t PendingBytes_;
+    uint64_t MaxPendingBytes_;
+    bool Busy_;
+    bool Stop_;
+    std::vector<std::string> Errors_;
+
+    std::thread Thread_;
+};
+
+#endif /* FGEN_FGENWRITER_HPP_ */
@@ -17,12 +17,22 @@
 
 #include <cctype>
 
+#include <llvm/ADT/STLExtras.h>
 #include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/xxhash.h>
 
 #include <FunctionGenerator.hpp>
 #include <util/Decl.hpp>
+#include <util/Statistics.hpp>
 #include <util/Type.hpp>
 
+static util::stats::Counter NumRecordsAnalyzed(
+    "records-analyzed", "Number of records analyzed by the generator");
+static util::stats::Counter NumDefinitionsCached(
+    "definitions-cached", "Number of definitions taken from the cache");
+static util::stats::Counter NumDefinitionsRendered(
+    "definitions-rendered", "Number of definitions rendered for the cache");
+
 static llvm::StringRef extractRelevantSection(llvm::StringRef Name)
 {
     /*
@@ -67,29 +77,22 @@ static llvm::StringRef extractRelevantSection(llvm::StringRef Name)
     return TrimmedName;
 }
 
-template <typename Pred>
-static const clang::FieldDecl *bestFieldDeclMatch(
-    const clang::RecordDecl *RecordDecl, llvm::StringRef Name, Pred &&PredFunc)
+template <typename Range, typename Pred>
+static const clang::FieldDecl *
+bestFieldDeclMatch(const Range &Fields, llvm::StringRef Name, Pred &&PredFunc)
 {
     /*
-     * This function tries to find a field inside of "RecordDecl" which
+     * This function tries to find a field inside of "Fields" which
      * matches fairly decently with "Name" and fullfills the type
      * predicate defined in "PredFunc".
      */
-    if (RecordDecl->field_empty())
+    if (Fields.empty())
         return nullptr;
 
     if (Name.startswith_lower("set")) {
-        auto Range = RecordDecl->fields();
-
-        if (std::distance(Range.begin(), Range.end()) == 1) {
-            auto FieldType = (*Range.begin())->getType();
-
-            if (util::decl::isSingleBit(*Range.begin()))
-                FieldType = (*Range.begin())->getASTContext().BoolTy;
-
-            if (PredFunc(FieldType))
-                return *Range.begin();
+        if (Fields.size() == 1) {
+            if (PredFunc(Fields.front().Type))
+                return Fields.front().Decl;
             else
                 return nullptr;
         }
@@ -101,16 +104,11 @@ static const clang::FieldDecl *bestFieldDeclMatch(
     const clang::FieldDecl *BestMatch = nullptr;
     auto BestEditDistance = NameSize;
 
-    for (const auto &FieldDecl : RecordDecl->fields()) {
-        auto FieldType = FieldDecl->getType();
-
-        if (util::decl::isSingleBit(FieldDecl))
-            FieldType = FieldDecl->getASTContext().BoolTy;
-
-        if (!PredFunc(FieldType))
+    for (const auto &Field : Fields) {
+        if (!PredFunc(Field.Type))
             continue;
 
-        auto FieldName = extractRelevantSection(FieldDecl->getName());
+        auto FieldName = Field.Section;
         auto FieldNameSize = static_cast<int>(FieldName.size());
 
         /*
@@ -127,7 +125,7 @@ static const clang::FieldDecl *bestFieldDeclMatch(
         auto Distance = Name.edit_distance(FieldName, true, BestEditDistance);
 
         if (Distance < BestEditDistance) {
-            BestMatch = FieldDecl;
+            BestMatch = Field.Decl;
             BestEditDistance = Distance;
         }
     }
@@ -135,38 +133,92 @@ static const clang::FieldDecl *bestFieldDeclMatch(
     return BestMatch;
 }
 
-template<typename Pred>
-static const clang::FieldDecl *
-bestFieldDeclMatch(const clang::RecordDecl *RecordDecl, Pred &&PredFunc)
+template <typename Range, typename Pred>
+static const clang::FieldDecl *bestFieldDeclMatch(const Range &Fields,
+                                                  Pred &&PredFunc)
 {
     /*
-     * If there is exactly one field declaration in "RecordDecl" which
+     * If there is exactly one field declaration in "Fields" which
      * fullfills the type predicate, we will return it.
      */
     const clang::FieldDecl *Match = nullptr;
 
-    for (const auto &FieldDecl : RecordDecl->fields()) {
-        auto FieldType = FieldDecl->getType();
-
-        if (util::decl::isSingleBit(FieldDecl))
-            FieldType = FieldDecl->getASTContext().BoolTy;
-
-        if (PredFunc(FieldType)) {
+    for (const auto &Field : Fields) {
+        if (PredFunc(Field.Type)) {
             if (Match)
                 return nullptr;
 
-            Match = FieldDecl;
+            Match = Field.Decl;
         }
     }
 
     return Match;
 }
 
+static void writeTemplateParameterList(llvm::raw_ostream &OStream,
+                                       const clang::TemplateParameterList *List)
+{
+    OStream << "template <";
+
+    auto Begin = List->begin();
+    auto End = List->end();
+
+    for (auto It = Begin; It != End; ++It) {
+        auto TTPDecl = clang::dyn_cast<clang::TemplateTypeParmDecl>(*It);
+        auto NonTTPDecl = clang::dyn_cast<clang::NonTypeTemplateParmDecl>(*It);
+
+        if (It != Begin)
+            OStream << ", ";
+
+        if (TTPDecl) {
+            OStream << "typename ";
+
+            if (TTPDecl->isParameterPack())
+                OStream << "... ";
+
+        } else if (NonTTPDecl) {
+            auto Policy = NonTTPDecl->getASTContext().getPrintingPolicy();
+            OStream << NonTTPDecl->getType().getAsString(Policy) << " ";
+        }
+
+        OStream << (*It)->getName();
+    }
+
+    OStream << "> ";
+}
+
+static void
+writeRecordTemplateParameters(llvm::raw_ostream &OStream,
+                              llvm::ArrayRef<const clang::DeclContext *> Vec)
+{
+    for (const auto DeclContext : Vec) {
+        auto CXXRecordDecl = clang::dyn_cast<clang::CXXRecordDecl>(DeclContext);
+        if (!CXXRecordDecl)
+            continue;
+
+        auto ClassTemplateDecl = CXXRecordDecl->getDescribedClassTemplate();
+        if (!ClassTemplateDecl)
+            continue;
+
+        auto TemplateParams = ClassTemplateDecl->getTemplateParameters();
+        writeTemplateParameterList(OStream, TemplateParams);
+    }
+}
+
 FunctionGenerator::FunctionGenerator()
     : ActiveNamespaces_(),
+      NumEnclosing_(0),
+      Allocator_(),
+      Saver_(Allocator_),
       Includes_(),
+      UsedIncludes_(),
+      Records_(),
+      Analysis_(nullptr),
+      TypeBuffer_(),
+      USRBuffer_(),
       StrStream_(true),
-      Configuration_(nullptr)
+      Configuration_(nullptr),
+      DeclCache_(nullptr)
 {}
 
 void FunctionGenerator::setConfiguration(
@@ -175,14 +227,332 @@ void FunctionGenerator::setConfiguration(
     Configuration_ = std::move(Configuration);
 }
 
+const std::shared_ptr<FGenConfiguration> &
+FunctionGenerator::configuration() const
+{
+    return Configuration_;
+}
+
+void FunctionGenerator::setDeclCache(std::shared_ptr<FGenDeclCache> DeclCache)
+{
+    DeclCache_ = std::move(DeclCache);
+}
+
+const std::shared_ptr<FGenDeclCache> &FunctionGenerator::declCache() const
+{
+    return DeclCache_;
+}
+
+void FunctionGenerator::setEnclosingNamespaces(
+    llvm::ArrayRef<const clang::NamespaceDecl *> Namespaces)
+{
+    /*
+     * The generated definitions get inserted into already existing
+     * namespace blocks. These namespaces count as opened, but must never
+     * be closed by the generator.
+     */
+    ActiveNamespaces_.clear();
+
+    for (auto NamespaceDecl : Namespaces)
+        ActiveNamespaces_.push_back(NamespaceDecl->getCanonicalDecl());
+
+    NumEnclosing_ = ActiveNamespaces_.size();
+}
+
+void FunctionGenerator::analyze(const clang::FunctionDecl *FunctionDecl)
+{
+    /*
+     * Analyze every record the definition of 'FunctionDecl' may refer
+     * to: the record of a method and the records which are passed to
+     * or returned by the function.
+     */
+    auto MethodDecl = clang::dyn_cast<clang::CXXMethodDecl>(FunctionDecl);
+    if (MethodDecl)
+        analyzeRecord(MethodDecl->getParent());
+
+    analyzeType(FunctionDecl->getReturnType());
+
+    for (const auto ParmDecl : FunctionDecl->parameters())
+        analyzeType(ParmDecl->getType());
+}
+
+void FunctionGenerator::setAnalysis(const FunctionGenerator *Generator)
+{
+    Analysis_ = Generator;
+}
+
 void FunctionGenerator::add(const clang::FunctionDecl *FunctionDecl)
 {
-    llvm::SmallVector<const clang::DeclContext *, 8> ContextVec;
+    const RecordInfo *Record = nullptr;
 
+    auto MethodDecl = clang::dyn_cast<clang::CXXMethodDecl>(FunctionDecl);
+    if (MethodDecl)
+        Record = &getRecordInfo(MethodDecl->getParent());
+
+    add(FunctionDecl, Record);
+}
+
+void FunctionGenerator::add(
+    llvm::ArrayRef<const clang::CXXMethodDecl *> MethodDecls)
+{
+    if (MethodDecls.empty())
+        return;
+
+    /*
+     * All methods belong to the same record. Analyze it once and
+     * generate the methods in the order in which they were declared.
+     */
+    const auto &Record = getRecordInfo(MethodDecls.front()->getParent());
+
+    for (auto MethodDecl : MethodDecls)
+        add(MethodDecl, &Record);
+}
+
+void FunctionGenerator::resumeAfter(const clang::FunctionDecl *FunctionDecl)
+{
+    if (!Configuration_->namespaceDefinitions())
+        return;
+
+    /*
+     * After a function is written, exactly the namespaces around it are
+     * open. Start in this state to continue the output of a generator
+     * whose last function was 'FunctionDecl', e.g. the one generating
+     * the preceding chunk of functions.
+     */
+    llvm::SmallVector<const clang::DeclContext *, 8> ContextVec;
     util::decl::getFullContext(FunctionDecl, ContextVec);
-    
+
+    ActiveNamespaces_.clear();
+
+    for (auto Context : ContextVec) {
+        auto NamespaceDecl = clang::dyn_cast<clang::NamespaceDecl>(Context);
+        if (NamespaceDecl)
+            ActiveNamespaces_.push_back(NamespaceDecl->getCanonicalDecl());
+    }
+}
+
+void FunctionGenerator::capture(const clang::FunctionDecl *FunctionDecl,
+                                FGenIR &IR)
+{
+    const RecordInfo *Record = nullptr;
+    llvm::SmallVector<const clang::DeclContext *, 8> ContextVec;
+
+    auto MethodDecl = clang::dyn_cast<clang::CXXMethodDecl>(FunctionDecl);
+    if (MethodDecl) {
+        Record = &getRecordInfo(MethodDecl->getParent());
+
+        ContextVec.append(Record->Context.begin(), Record->Context.end());
+        ContextVec.push_back(FunctionDecl);
+    } else {
+        util::decl::getFullContext(FunctionDecl, ContextVec);
+    }
+
+    /*
+     * Every piece is written to the stream as usual and cut out of it
+     * afterwards. A capturing generator owns its configuration and its
+     * output is of no use, so both may be changed at will.
+     */
+    StrStream_.clear();
+
+    llvm::SmallVector<FGenIR::ScopeKind, 8> Kinds;
+    llvm::SmallVector<size_t, 16> Offsets;
+
+    const auto Mark = [this, &Offsets]() {
+        Offsets.push_back(StrStream_.str().size());
+    };
+
+    auto &ASTContext = FunctionDecl->getASTContext();
+    auto PrintingPolicy = ASTContext.getPrintingPolicy();
+    PrintingPolicy.SuppressScope = true;
+
+    /* The same scopes as written by 'writeFullQualifiedName()' */
+    for (const auto &Context : ContextVec) {
+        auto NamespaceDecl = clang::dyn_cast<clang::NamespaceDecl>(Context);
+        if (NamespaceDecl) {
+            Kinds.push_back(FGenIR::SK_Namespace);
+            Mark();
+            StrStream_ << *NamespaceDecl;
+            continue;
+        }
+
+        auto RecordDecl = clang::dyn_cast<clang::RecordDecl>(Context);
+        if (RecordDecl) {
+            auto Type = clang::QualType(RecordDecl->getTypeForDecl(), 0);
+
+            Kinds.push_back(FGenIR::SK_Record);
+            Mark();
+            Type.print(StrStream_, PrintingPolicy);
+            continue;
+        }
+
+        auto CtorDecl = clang::dyn_cast<clang::CXXConstructorDecl>(Context);
+        if (CtorDecl) {
+            Kinds.push_back(FGenIR::SK_Name);
+            Mark();
+            StrStream_ << *CtorDecl->getParent();
+            continue;
+        }
+
+        auto DtorDecl = clang::dyn_cast<clang::CXXDestructorDecl>(Context);
+        if (DtorDecl) {
+            Kinds.push_back(FGenIR::SK_Name);
+            Mark();
+            StrStream_ << '~' << *DtorDecl->getParent();
+            continue;
+        }
+
+        auto FDecl = clang::dyn_cast<clang::FunctionDecl>(Context);
+        if (FDecl) {
+            Kinds.push_back(FGenIR::SK_Name);
+            Mark();
+            StrStream_ << *FDecl;
+            continue;
+        }
+    }
+
+    bool Trailing = util::decl::hasTrailingReturnType(FunctionDecl);
+
+    Mark();
+    writeTemplateParameters(FunctionDecl, Record);
+
+    if (Trailing)
+        writeTrailingFunctionStart();
+    else
+        writeReturnType(FunctionDecl);
+
+    Mark();
+    writeParameters(FunctionDecl);
+    writeQualifiers(FunctionDecl);
+
+    if (Trailing)
+        writeTrailingReturnType(FunctionDecl);
+
+    /* Accessors are the only bodies which depend on "-fmove" */
+    Mark();
+    Configuration_->setAllowMove(false);
+
+    if (!tryWriteGetAccessor(FunctionDecl))
+        tryWriteSetAccessor(FunctionDecl);
+
+    Mark();
+    Configuration_->setAllowMove(true);
+
+    if (!tryWriteGetAccessor(FunctionDecl))
+        tryWriteSetAccessor(FunctionDecl);
+
+    Mark();
+    tryWriteConversionStatement(FunctionDecl);
+
+    Mark();
+    tryWriteReturnStatement(FunctionDecl);
+
+    Mark();
+
+    llvm::StringRef Output(StrStream_.str());
+    llvm::SmallVector<llvm::StringRef, 16> Strings;
+
+    for (size_t i = 0; i + 1 < Offsets.size(); ++i)
+        Strings.push_back(Output.slice(Offsets[i], Offsets[i + 1]));
+
+    llvm::SmallVector<FGenIR::Scope, 8> Scopes;
+
+    for (size_t i = 0; i < Kinds.size(); ++i)
+        Scopes.push_back({Kinds[i], Strings[i]});
+
+    auto Pieces = llvm::makeArrayRef(Strings).drop_front(Kinds.size());
+
+    FGenIR::Function Function;
+    Function.Head = Pieces[0];
+    Function.Tail = Pieces[1];
+    Function.Accessor = Pieces[2];
+    Function.Conversion = Pieces[4];
+    Function.Stub = Pieces[5];
+
+    /* Only keep a second accessor if it actually moves its value */
+    if (Pieces[3] != Pieces[2])
+        Function.MoveAccessor = Pieces[3];
+
+    IR.add(Scopes, Function);
+
+    StrStream_.clear();
+}
+
+void FunctionGenerator::append(const FunctionGenerator &Other)
+{
+    /*
+     * 'Other' resumed where this generator stopped. Its definitions and
+     * its state directly continue the output of this generator.
+     */
+    for (const auto &Include : Other.Includes_)
+        addInclude(Include);
+
+    StrStream_ << Other.StrStream_.str();
+
+    ActiveNamespaces_ = Other.ActiveNamespaces_;
+}
+
+void FunctionGenerator::add(const clang::FunctionDecl *FunctionDecl,
+                            const RecordInfo *Record)
+{
+    llvm::SmallVector<const clang::DeclContext *, 8> ContextVec;
+
+    if (Record) {
+        ContextVec.append(Record->Context.begin(), Record->Context.end());
+        ContextVec.push_back(FunctionDecl);
+    } else {
+        util::decl::getFullContext(FunctionDecl, ContextVec);
+    }
+
+    if (!DeclCache_ || !util::decl::generateUSR(FunctionDecl, USRBuffer_)) {
+        writeNamespaceDefinitions(ContextVec);
+        render(FunctionDecl, Record, ContextVec);
+        return;
+    }
+
+    /*
+     * The namespaces around a definition depend on the functions
+     * written before it, so they are never taken from the cache.
+     */
+    auto USR = USRBuffer_.str().str();
+    auto Hash = getSignatureHash(FunctionDecl, Record);
+
+    FGenDeclCache::Entry Entry;
+
+    if (DeclCache_->lookup(USR, Hash, Entry)) {
+        ++NumDefinitionsCached;
+
+        /* Leave out the definitions which did not change */
+        if (Configuration_->changedOnly())
+            return;
+
+        writeNamespaceDefinitions(ContextVec);
+
+        for (const auto &Include : Entry.Includes)
+            addInclude(Include);
+
+        StrStream_ << Entry.Definition;
+        return;
+    }
+
     writeNamespaceDefinitions(ContextVec);
-    writeTemplateParameters(FunctionDecl);
+
+    auto Begin = StrStream_.str().size();
+    UsedIncludes_.clear();
+
+    render(FunctionDecl, Record, ContextVec);
+
+    llvm::StringRef Definition(StrStream_.str());
+    DeclCache_->insert(USR, Hash, Definition.substr(Begin), UsedIncludes_);
+
+    ++NumDefinitionsRendered;
+}
+
+void FunctionGenerator::render(
+    const clang::FunctionDecl *FunctionDecl,
+    const RecordInfo *Record,
+    const llvm::SmallVector<const clang::DeclContext *, 8> &ContextVec)
+{
+    writeTemplateParameters(FunctionDecl, Record);
 
     if (util::decl::hasTrailingReturnType(FunctionDecl)) {
         writeTrailingFunctionStart();
@@ -206,12 +576,19 @@ void FunctionGenerator::dump(llvm::raw_ostream &OStream) const
     for (const auto &Include : Includes_)
         OStream << Include << "\n";
 
-    OStream << "\n" << StrStream_.str() << "\n";
+    OStream << "\n";
+
+    dumpDefinitions(OStream);
+}
+
+void FunctionGenerator::dumpDefinitions(llvm::raw_ostream &OStream) const
+{
+    OStream << StrStream_.str() << "\n";
 
     /* Close namespaces which are still open */
     auto Size = ActiveNamespaces_.size();
-    if (Size) {
-        while (Size--)
+    if (Size > NumEnclosing_) {
+        while (Size-- > NumEnclosing_)
             OStream << "}\n";
 
         if (!Configuration_->trimOutput())
@@ -222,8 +599,18 @@ void FunctionGenerator::dump(llvm::raw_ostream &OStream) const
 void FunctionGenerator::clear()
 {
     ActiveNamespaces_.clear();
+    NumEnclosing_ = 0;
     Includes_.clear();
+    UsedIncludes_.clear();
+    Records_.clear();
     StrStream_.clear();
+
+    Allocator_.Reset();
+}
+
+llvm::ArrayRef<llvm::StringRef> FunctionGenerator::includes() const
+{
+    return Includes_;
 }
 
 void FunctionGenerator::writeNamespaceDefinitions(
@@ -309,23 +696,15 @@ void FunctionGenerator::writeNamespaceDefinitions(
 }
 
 void FunctionGenerator::writeTemplateParameters(
-    const clang::FunctionDecl *FunctionDecl)
+    const clang::FunctionDecl *FunctionDecl, const RecordInfo *Record)
 {
-    llvm::SmallVector<const clang::DeclContext *, 8> DeclContextVec;
-
-    util::decl::getFullContext(FunctionDecl, DeclContextVec);
-
-    for (const auto DeclContext : DeclContextVec) {
-        auto CXXRecordDecl = clang::dyn_cast<clang::CXXRecordDecl>(DeclContext);
-        if (!CXXRecordDecl)
-            continue;
-
-        auto ClassTemplateDecl = CXXRecordDecl->getDescribedClassTemplate();
-        if (!ClassTemplateDecl)
-            continue;
+    if (Record) {
+        StrStream_ << Record->TemplateParameters;
+    } else {
+        llvm::SmallVector<const clang::DeclContext *, 8> DeclContextVec;
 
-        auto TemplateParams = ClassTemplateDecl->getTemplateParameters();
-        writeTemplateParameters(TemplateParams);
+        util::decl::getFullContext(FunctionDecl, DeclContextVec);
+        writeRecordTemplateParameters(StrStream_, DeclContextVec);
     }
 
     auto FunctionTemplateDecl = FunctionDecl->getDescribedFunctionTemplate();
@@ -333,39 +712,7 @@ void FunctionGenerator::writeTemplateParameters(
         return;
 
     auto TemplateParams = FunctionTemplateDecl->getTemplateParameters();
-    writeTemplateParameters(TemplateParams);
-}
-
-void FunctionGenerator::writeTemplateParameters(
-    const clang::TemplateParameterList *List)
-{
-    StrStream_ << "template <";
-
-    auto Begin = List->begin();
-    auto End = List->end();
-
-    for (auto It = Begin; It != End; ++It) {
-        auto TTPDecl = clang::dyn_cast<clang::TemplateTypeParmDecl>(*It);
-        auto NonTTPDecl = clang::dyn_cast<clang::NonTypeTemplateParmDecl>(*It);
-
-        if (It != Begin)
-            StrStream_ << ", ";
-
-        if (TTPDecl) {
-            StrStream_ << "typename ";
-
-            if (TTPDecl->isParameterPack())
-                StrStream_ << "... ";
-
-        } else if (NonTTPDecl) {
-            auto Policy = NonTTPDecl->getASTContext().getPrintingPolicy();
-            StrStream_ << NonTTPDecl->getType().getAsString(Policy) << " ";
-        }
-
-        StrStream_ << (*It)->getName();
-    }
-
-    StrStream_ << "> ";
+    writeTemplateParameterList(StrStream_, TemplateParams);
 }
 
 void FunctionGenerator::writeReturnType(const clang::FunctionDecl *FunctionDecl)
@@ -465,8 +812,11 @@ void FunctionGenerator::writeParameters(const clang::FunctionDecl *FunctionDecl)
     auto Parameters = FunctionDecl->parameters();
     auto Size = Parameters.size();
 
+    /* Reuse the buffer to avoid a heap allocation for long type names */
+    auto &Buffer = TypeBuffer_;
+
     for (size_t i = 0; i < Size; ++i) {
-        llvm::SmallString<64> Buffer;
+        Buffer.clear();
         llvm::raw_svector_ostream BufferStream(Buffer);
 
         auto Name = Parameters[i]->getName();
@@ -601,7 +951,9 @@ bool FunctionGenerator::tryWriteConversionStatement(
         return util::type::returnAssignmentOk(ReturnType, FieldType);
     };
 
-    auto TypeDecl = bestFieldDeclMatch(RecordDecl, TypePred);
+    const auto &Fields = getRecordInfo(RecordDecl).Fields;
+
+    auto TypeDecl = bestFieldDeclMatch(Fields, TypePred);
     if (!TypeDecl)
         return false;
 
@@ -633,7 +985,7 @@ bool FunctionGenerator::tryWriteReturnStatement(
         return true;
     }
 
-    if (util::type::hasDefaultConstructor(ReturnType)) {
+    if (isDefaultConstructible(ReturnType)) {
         auto &Policy = FunctionDecl->getASTContext().getPrintingPolicy();
 
         StrStream_ << "{ return ";
@@ -646,8 +998,15 @@ bool FunctionGenerator::tryWriteReturnStatement(
         auto MethodDecl = clang::dyn_cast<clang::CXXMethodDecl>(FunctionDecl);
 
         if (MethodDecl && !MethodDecl->isStatic()) {
-            auto ThisType = MethodDecl->getThisType();
-            auto RecordType = ThisType->getPointeeType();
+            /*
+             * The type '*this' refers to. Unlike 'getThisType()', this
+             * does not create a new type within the context and is
+             * safe while other threads generate functions.
+             */
+            auto Quals = MethodDecl->getMethodQualifiers().getFastQualifiers();
+            auto RecordDecl = MethodDecl->getParent();
+            auto RecordType = clang::QualType(RecordDecl->getTypeForDecl(),
+                                              Quals);
 
             if (util::type::returnAssignmentOk(ReturnType, RecordType)) {
                 StrStream_ << "{ return *this; }";
@@ -658,7 +1017,7 @@ bool FunctionGenerator::tryWriteReturnStatement(
         auto NonRefType = ReturnType.getNonReferenceType();
 
         bool IsBuiltIn = NonRefType->isBuiltinType();
-        if (IsBuiltIn || util::type::hasDefaultConstructor(NonRefType)) {
+        if (IsBuiltIn || isDefaultConstructible(NonRefType)) {
             auto &Policy = FunctionDecl->getASTContext().getPrintingPolicy();
             /*
              * Declare a static variable and return it, if the type
@@ -721,7 +1080,9 @@ bool FunctionGenerator::tryWriteCGetAccessor(
         return util::type::returnAssignmentOk(ReturnType, FieldType);
     };
 
-    auto FieldDecl = bestFieldDeclMatch(RecordDecl, Name, TypePred);
+    const auto &Fields = getRecordInfo(RecordDecl).Fields;
+
+    auto FieldDecl = bestFieldDeclMatch(Fields, Name, TypePred);
     if (!FieldDecl)
         return false;
 
@@ -797,7 +1158,9 @@ bool FunctionGenerator::tryWriteCXXGetAccessor(
         return util::type::returnAssignmentOk(ReturnType, FieldType);
     };
 
-    auto FieldDecl = bestFieldDeclMatch(RecordDecl, Name, TypePred);
+    const auto &Fields = getRecordInfo(RecordDecl).Fields;
+
+    auto FieldDecl = bestFieldDeclMatch(Fields, Name, TypePred);
     if (!FieldDecl)
         return false;
 
@@ -854,7 +1217,9 @@ bool FunctionGenerator::tryWriteCSetAccessor(
         return util::type::variableAssignmentOk(FieldType, RHSType);
     };
 
-    auto FieldDecl = bestFieldDeclMatch(RecordDecl, Name, TypePred);
+    const auto &Fields = getRecordInfo(RecordDecl).Fields;
+
+    auto FieldDecl = bestFieldDeclMatch(Fields, Name, TypePred);
     if (!FieldDecl)
         return false;
 
@@ -910,7 +1275,9 @@ bool FunctionGenerator::tryWriteCXXSetAccessor(
         return util::type::variableAssignmentOk(LHSType, RHSType);
     };
 
-    auto FieldDecl = bestFieldDeclMatch(RecordDecl, Name, TypePred);
+    const auto &Fields = getRecordInfo(RecordDecl).Fields;
+
+    auto FieldDecl = bestFieldDeclMatch(Fields, Name, TypePred);
     if (!FieldDecl)
         return false;
 
@@ -953,15 +1320,192 @@ bool FunctionGenerator::useMoveAssignment(clang::QualType Type)
     if (Type->isPointerType() || Type->isReferenceType())
         return false;
 
-    if (!Type->isTemplateTypeParmType() && !util::type::hasMoveAssignment(Type))
+    if (!Type->isTemplateTypeParmType() && !isMoveAssignable(Type))
         return false;
 
     return addInclude("#include <utility>");
 }
 
-bool FunctionGenerator::addInclude(std::string Include)
+bool FunctionGenerator::isMoveAssignable(clang::QualType Type)
+{
+    auto RecordType = Type->getAs<clang::RecordType>();
+    if (!RecordType)
+        return false;
+
+    return getRecordInfo(RecordType->getDecl()).MoveAssignable;
+}
+
+bool FunctionGenerator::isDefaultConstructible(clang::QualType Type)
+{
+    auto RecordType = Type->getAs<clang::RecordType>();
+    if (!RecordType)
+        return false;
+
+    return getRecordInfo(RecordType->getDecl()).DefaultConstructible;
+}
+
+void FunctionGenerator::analyzeType(clang::QualType Type)
+{
+    Type = Type.getNonReferenceType();
+
+    /* C accessors refer to the fields of a record behind a pointer */
+    if (Type->isPointerType())
+        Type = Type->getPointeeType();
+
+    auto RecordType = Type->getAs<clang::RecordType>();
+    if (RecordType)
+        analyzeRecord(RecordType->getDecl());
+}
+
+void FunctionGenerator::analyzeRecord(const clang::RecordDecl *RecordDecl)
+{
+    /* Accessors check whether the type of a field is move assignable */
+    for (const auto &Field : getRecordInfo(RecordDecl).Fields) {
+        auto FieldType = Field.Decl->getType().getNonReferenceType();
+
+        auto RecordType = FieldType->getAs<clang::RecordType>();
+        if (RecordType)
+            getRecordInfo(RecordType->getDecl());
+    }
+}
+
+const FunctionGenerator::RecordInfo &
+FunctionGenerator::getRecordInfo(const clang::RecordDecl *RecordDecl)
+{
+    if (Analysis_) {
+        auto It = Analysis_->Records_.find(RecordDecl);
+        if (It != Analysis_->Records_.end())
+            return *It->second;
+    }
+
+    auto &Record = Records_[RecordDecl];
+    if (Record)
+        return *Record;
+
+    ++NumRecordsAnalyzed;
+
+    Record = llvm::make_unique<RecordInfo>();
+
+    util::decl::getFullContext(RecordDecl, Record->Context);
+
+    /*
+     * The template parameters of all enclosing class templates are the
+     * same for every method of the record, so render them only once.
+     */
+    llvm::SmallString<64> Buffer;
+    llvm::raw_svector_ostream OS(Buffer);
+
+    writeRecordTemplateParameters(OS, Record->Context);
+    Record->TemplateParameters = Saver_.save(Buffer.str());
+
+    for (const auto &FieldDecl : RecordDecl->fields()) {
+        auto FieldType = FieldDecl->getType();
+
+        if (util::decl::isSingleBit(FieldDecl))
+            FieldType = FieldDecl->getASTContext().BoolTy;
+
+        auto Section = extractRelevantSection(FieldDecl->getName());
+
+        Record->Fields.push_back({FieldDecl, FieldType, Section});
+    }
+
+    auto Type = clang::QualType(RecordDecl->getTypeForDecl(), 0);
+
+    Record->MoveAssignable = util::type::hasMoveAssignment(Type);
+    Record->DefaultConstructible = util::type::hasDefaultConstructor(Type);
+
+    return *Record;
+}
+
+bool FunctionGenerator::addInclude(llvm::StringRef Include)
 {
-    const auto &[It, Ok] = Includes_.insert(std::move(Include));
+    /* There are only a handful of includes, a linear search is fine. */
+    auto It = llvm::find(Includes_, Include);
+    if (It == Includes_.end())
+        It = Includes_.insert(It, Saver_.save(Include));
+
+    /* A cached definition must bring along the includes it needs */
+    if (DeclCache_ && !llvm::is_contained(UsedIncludes_, *It))
+        UsedIncludes_.push_back(*It);
+
+    return true;
+}
+
+uint64_t
+FunctionGenerator::getSignatureHash(const clang::FunctionDecl *FunctionDecl,
+                                    const RecordInfo *Record)
+{
+    auto &Policy = FunctionDecl->getASTContext().getPrintingPolicy();
+
+    llvm::SmallString<512> Buffer;
+    llvm::raw_svector_ostream OS(Buffer);
+
+    /*
+     * Everything a definition is rendered from: the type of the
+     * function, the names of its parameters, the template parameters
+     * and the fields an accessor or a conversion may refer to. The
+     * types are hashed as written and as resolved, so a changed typedef
+     * yields a new hash, too.
+     */
+    hashType(OS, FunctionDecl->getType(), Policy);
+    hashType(OS, FunctionDecl->getReturnType(), Policy);
+
+    for (const auto ParmDecl : FunctionDecl->parameters()) {
+        OS << ParmDecl->getName() << '\0';
+        hashType(OS, ParmDecl->getType(), Policy);
+    }
+
+    OS << util::decl::hasTrailingReturnType(FunctionDecl) << '\0';
+
+    const auto HashFields = [&](const RecordInfo &Info) {
+        for (const auto &Field : Info.Fields) {
+            OS << Field.Decl->getName() << '\0';
+            hashType(OS, Field.Type, Policy);
+        }
+    };
+
+    if (Record) {
+        OS << Record->TemplateParameters << '\0';
+        HashFields(*Record);
+    } else {
+        llvm::SmallVector<const clang::DeclContext *, 8> DeclContextVec;
+
+        util::decl::getFullContext(FunctionDecl, DeclContextVec);
+        writeRecordTemplateParameters(OS, DeclContextVec);
+
+        /* C accessors refer to the fields of a record behind a pointer */
+        for (const auto ParmDecl : FunctionDecl->parameters()) {
+            auto Type = ParmDecl->getType()->getPointeeType();
+            if (Type.isNull())
+                continue;
+
+            auto RecordType = Type->getAs<clang::RecordType>();
+            if (RecordType)
+                HashFields(getRecordInfo(RecordType->getDecl()));
+        }
+    }
+
+    auto FunctionTemplateDecl = FunctionDecl->getDescribedFunctionTemplate();
+    if (FunctionTemplateDecl) {
+        auto TemplateParams = FunctionTemplateDecl->getTemplateParameters();
+        writeTemplateParameterList(OS, TemplateParams);
+    }
+
+    return llvm::xxHash64(Buffer);
+}
+
+void FunctionGenerator::hashType(llvm::raw_ostream &OStream,
+                                 clang::QualType Type,
+                                 const clang::PrintingPolicy &Policy)
+{
+    Type.print(OStream, Policy);
+    OStream << '\0';
+    Type.getCanonicalType().print(OStream, Policy);
+    OStream << '\0';
+
+    /* Stubs and setters depend on the traits of record types */
+    auto NonRefType = Type.getNonReferenceType();
 
-    return Ok || It != Includes_.end();
+    OStream << isMoveAssignable(NonRefType)
+            << isDefaultConstructible(NonRefType) << '\0';
 }
@@ -18,14 +18,20 @@
 #ifndef FGEN_FUNCTIONGENERATOR_HPP_
 #define FGEN_FUNCTIONGENERATOR_HPP_
 
-#include <unordered_set>
-
 #include <clang/AST/Decl.h>
 #include <clang/AST/DeclCXX.h>
 #include <clang/AST/DeclTemplate.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/Allocator.h>
+#include <llvm/Support/StringSaver.h>
 #include <llvm/Support/raw_ostream.h>
 
 #include <FGenConfiguration.hpp>
+#include <FGenDeclCache.hpp>
+#include <FGenIR.hpp>
 #include <StringStream.hpp>
 
 /*
@@ -40,16 +46,63 @@ public:
     FunctionGenerator();
 
     void setConfiguration(std::shared_ptr<FGenConfiguration> Configuration);
+    const std::shared_ptr<FGenConfiguration> &configuration() const;
+
+    void setDeclCache(std::shared_ptr<FGenDeclCache> DeclCache);
+    const std::shared_ptr<FGenDeclCache> &declCache() const;
+
+    void setEnclosingNamespaces(
+        llvm::ArrayRef<const clang::NamespaceDecl *> Namespaces);
+
+    void analyze(const clang::FunctionDecl *FunctionDecl);
+    void setAnalysis(const FunctionGenerator *Generator);
 
     void add(const clang::FunctionDecl *FunctionDecl);
+    void add(llvm::ArrayRef<const clang::CXXMethodDecl *> MethodDecls);
+    void resumeAfter(const clang::FunctionDecl *FunctionDecl);
+    void capture(const clang::FunctionDecl *FunctionDecl, FGenIR &IR);
+    void append(const FunctionGenerator &Other);
     void dump(llvm::raw_ostream &OStream = llvm::outs()) const;
+    void dumpDefinitions(llvm::raw_ostream &OStream) const;
     void clear();
 
+    llvm::ArrayRef<llvm::StringRef> includes() const;
+
 private:
+    struct FieldInfo {
+        const clang::FieldDecl *Decl;
+        clang::QualType Type;
+        llvm::StringRef Section;
+    };
+
+    /*
+     * Everything the generator needs to know about a record. Methods of
+     * the same record and accessors referring to it share this analysis
+     * instead of examining the record again for every function.
+     */
+    struct RecordInfo {
+        llvm::SmallVector<const clang::DeclContext *, 8> Context;
+        llvm::StringRef TemplateParameters;
+        llvm::SmallVector<FieldInfo, 8> Fields;
+        bool MoveAssignable;
+        bool DefaultConstructible;
+    };
+
+    void add(const clang::FunctionDecl *FunctionDecl, const RecordInfo *Record);
+    void render(const clang::FunctionDecl *FunctionDecl,
+                const RecordInfo *Record,
+                const llvm::SmallVector<const clang::DeclContext *, 8> &Vec);
+
+    uint64_t getSignatureHash(const clang::FunctionDecl *FunctionDecl,
+                              const RecordInfo *Record);
+    void hashType(llvm::raw_ostream &OStream,
+                  clang::QualType Type,
+                  const clang::PrintingPolicy &Policy);
+
     void writeNamespaceDefinitions(
         const llvm::SmallVector<const clang::DeclContext *, 8> &ContextVec);
-    void writeTemplateParameters(const clang::FunctionDecl *FunctionDecl);
-    void writeTemplateParameters(const clang::TemplateParameterList *List);
+    void writeTemplateParameters(const clang::FunctionDecl *FunctionDecl,
+                                 const RecordInfo *Record);
     void writeReturnType(const clang::FunctionDecl *FunctionDecl);
     void writeTrailingFunctionStart();
     void writeTrailingReturnType(const clang::FunctionDecl *FunctionDecl);
@@ -72,13 +125,41 @@ private:
     bool tryWriteCXXSetAccessor(const clang::CXXMethodDecl *MethodDecl);
 
     bool useMoveAssignment(clang::QualType Type);
-    bool addInclude(std::string Include);
+    bool isMoveAssignable(clang::QualType Type);
+    bool isDefaultConstructible(clang::QualType Type);
+    bool addInclude(llvm::StringRef Include);
+
+    void analyzeType(clang::QualType Type);
+    void analyzeRecord(const clang::RecordDecl *RecordDecl);
+    const RecordInfo &getRecordInfo(const clang::RecordDecl *RecordDecl);
 
     std::vector<const clang::NamespaceDecl *> ActiveNamespaces_;
-    std::unordered_set<std::string> Includes_;
+    std::vector<const clang::NamespaceDecl *>::size_type NumEnclosing_;
+
+    /*
+     * Strings which live as long as the generated output are kept in
+     * an arena. It gets released as a whole by 'clear()'.
+     */
+    llvm::BumpPtrAllocator Allocator_;
+    llvm::StringSaver Saver_;
+
+    llvm::SmallVector<llvm::StringRef, 4> Includes_;
+    llvm::SmallVector<llvm::StringRef, 4> UsedIncludes_;
+    llvm::DenseMap<const clang::RecordDecl *, std::unique_ptr<RecordInfo>>
+        Records_;
+
+    /*
+     * Records analyzed in advance by another generator. It must not
+     * change while this generator uses it.
+     */
+    const FunctionGenerator *Analysis_;
+
+    llvm::SmallString<256> TypeBuffer_;
+    llvm::SmallString<128> USRBuffer_;
     StringStream StrStream_;
 
     std::shared_ptr<FGenConfiguration> Configuration_;
+    std::shared_ptr<FGenDeclCache> DeclCache_;
 };
 
 #endif /* FGEN_FUNCTIONGENERATOR_HPP_ */
@@ -15,18 +15,54 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <set>
+#include <tuple>
+
+#include <clang/Basic/DiagnosticOptions.h>
+#include <clang/Basic/FileSystemOptions.h>
+#include <clang/Frontend/ASTUnit.h>
+#include <clang/Frontend/CompilerInstance.h>
 #include <clang/Frontend/FrontendActions.h>
+#include <clang/Serialization/PCHContainerOperations.h>
+#include <clang/Tooling/ArgumentsAdjusters.h>
 #include <clang/Tooling/CommonOptionsParser.h>
 #include <clang/Tooling/Tooling.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/Path.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
 
 #include <util/CommandLine.hpp>
+#include <util/File.hpp>
+#include <util/Path.hpp>
+#include <util/Statistics.hpp>
 
 #include <FGenCompilationDatabase.hpp>
 #include <FGenAction.hpp>
+#include <FGenDepFile.hpp>
+#include <FGenFastCRunner.hpp>
+#include <FGenFileList.hpp>
+#include <FGenHistory.hpp>
+#include <FGenIR.hpp>
+#include <FGenIndex.hpp>
+#include <FGenIndexAction.hpp>
+#include <FGenOutputCache.hpp>
+#include <FGenPrefilter.hpp>
+#include <FGenRunner.hpp>
+#include <FGenStatCache.hpp>
 #include <FGenVisitor.hpp>
+#include <FGenWatcher.hpp>
+#include <FGenWriter.hpp>
+
+/* The defaults of the options are the defaults of the generator */
+static const FGenConfiguration Defaults;
 
 /* clang-format off */
 
@@ -51,7 +87,7 @@ static llvm::cl::opt<bool> FlagAccessors(
     ),
     llvm::cl::cat(GeneratorOptions),
     llvm::cl::ValueOptional,
-    llvm::cl::init(true)
+    llvm::cl::init(Defaults.implementAccessors())
 );
 
 static llvm::cl::opt<bool> FlagTrimOutput(
@@ -63,7 +99,7 @@ static llvm::cl::opt<bool> FlagTrimOutput(
     ),
     llvm::cl::cat(GeneratorOptions),
     llvm::cl::ValueOptional,
-    llvm::cl::init(false)
+    llvm::cl::init(Defaults.trimOutput())
 );
 
 static llvm::cl::opt<bool> FlagConversions(
@@ -73,7 +109,7 @@ static llvm::cl::opt<bool> FlagConversions(
     ),
     llvm::cl::cat(GeneratorOptions),
     llvm::cl::ValueOptional,
-    llvm::cl::init(true)
+    llvm::cl::init(Defaults.implementConversions())
 );
 
 static llvm::cl::opt<bool> FlagAllowMove(
@@ -83,7 +119,7 @@ static llvm::cl::opt<bool> FlagAllowMove(
     ),
     llvm::cl::cat(GeneratorOptions),
     llvm::cl::ValueOptional,
-    llvm::cl::init(true)
+    llvm::cl::init(Defaults.allowMove())
 );
 
 static llvm::cl::opt<bool> FlagStubs(
@@ -92,7 +128,7 @@ static llvm::cl::opt<bool> FlagStubs(
         "Try to automatically implement function stubs."
     ),
     llvm::cl::cat(GeneratorOptions),
-    llvm::cl::init(true)
+    llvm::cl::init(Defaults.implementStubs())
 );
 
 static llvm::cl::opt<bool> FlagNamespaces(
@@ -102,8 +138,23 @@ static llvm::cl::opt<bool> FlagNamespaces(
         "namespace names in the function qualifiers."
     ),
     llvm::cl::cat(GeneratorOptions),
-    llvm::cl::ValueOptional,                    
-    llvm::cl::init(true)
+    llvm::cl::ValueOptional,
+    llvm::cl::init(Defaults.namespaceDefinitions())
+);
+
+static llvm::cl::list<std::string> Outputs(
+    "emit",
+    llvm::cl::desc(
+        "Write an additional output to <file> from the same\n"
+        "parse. <flags> is a comma separated list of the\n"
+        "implementations to generate (accessors, conversions,\n"
+        "stubs), optionally followed by style overrides (move,\n"
+        "namespace-definitions, trim, each with a \"no-\" prefix\n"
+        "to disable it). The default output is only written\n"
+        "if \"-o\" is given, too."
+    ),
+    llvm::cl::value_desc("file:flags"),
+    llvm::cl::cat(GeneratorOptions)
 );
 
 static llvm::cl::opt<std::string> DatabasePath(
@@ -121,12 +172,256 @@ static llvm::cl::opt<std::string> OutputFile(
     "o",
     llvm::cl::desc(
         "Specifies the file to which the generated functions "
-        "will be written to."
+        "will be written to.\n"
+        "The placeholders %{dir}, %{name}, %{stem} and %{ext}\n"
+        "are replaced with the respective part of the input\n"
+        "file's path, e.g. \"%{dir}/%{stem}.cpp\". This writes\n"
+        "a separate output file for each input file."
+    ),
+    llvm::cl::value_desc("file"),
+    llvm::cl::cat(GeneralOptions)
+);
+
+static llvm::cl::opt<std::string> PatchFile(
+    "patch",
+    llvm::cl::desc(
+        "Insert the missing definitions of the functions declared\n"
+        "in the input files directly into <file>. The definitions\n"
+        "are placed into the matching namespace blocks of <file>."
+    ),
+    llvm::cl::value_desc("file"),
+    llvm::cl::cat(GeneralOptions)
+);
+
+static llvm::cl::opt<std::string> CursorLocation(
+    "at",
+    llvm::cl::desc(
+        "Only generate the function declared at the given location.\n"
+        "If the location is inside of a class, but not on one of\n"
+        "its functions, all functions of the class are generated.\n"
+        "If no input files are given, <file> is used."
+    ),
+    llvm::cl::value_desc("file:line:col"),
+    llvm::cl::cat(GeneralOptions)
+);
+
+static llvm::cl::opt<std::string> CursorRange(
+    "range",
+    llvm::cl::desc(
+        "Like \"-at\", but generate all functions whose declarations\n"
+        "overlap the given range."
+    ),
+    llvm::cl::value_desc("file:line:col-line:col"),
+    llvm::cl::cat(GeneralOptions)
+);
+
+static llvm::cl::opt<bool> FlagProject(
+    "project",
+    llvm::cl::desc(
+        "Index all translation units of the compilation database\n"
+        "and generate the functions which are declared but not\n"
+        "defined anywhere in the project. Only translation units\n"
+        "affected by a change get indexed again."
+    ),
+    llvm::cl::cat(GeneralOptions),
+    llvm::cl::init(false)
+);
+
+static llvm::cl::opt<std::string> IndexFile(
+    "index",
+    llvm::cl::desc(
+        "Specifies the file which holds the project index.\n"
+        "Defaults to a file in the user's cache directory."
+    ),
+    llvm::cl::value_desc("file"),
+    llvm::cl::cat(GeneralOptions)
+);
+
+static llvm::cl::opt<bool> FlagWriteIfChanged(
+    "write-if-changed",
+    llvm::cl::desc(
+        "Only replace output files whose content changed. Unchanged\n"
+        "files keep their modification time, which avoids needless\n"
+        "rebuilds. The output file holds the output of the current\n"
+        "run only and is never appended to."
+    ),
+    llvm::cl::cat(GeneralOptions),
+    llvm::cl::init(Defaults.writeIfChanged())
+);
+
+static llvm::cl::opt<bool> FlagMD(
+    "MD",
+    llvm::cl::desc(
+        "Write a Makefile style dependency file next to the\n"
+        "output file, i.e. to \"<file>.d\"."
+    ),
+    llvm::cl::cat(GeneralOptions),
+    llvm::cl::init(false)
+);
+
+static llvm::cl::opt<std::string> DepFileName(
+    "MF",
+    llvm::cl::desc(
+        "Write the dependency file to <file>. Implies \"-MD\"."
+    ),
+    llvm::cl::value_desc("file"),
+    llvm::cl::cat(GeneralOptions)
+);
+
+static llvm::cl::opt<bool> FlagSkipUpToDate(
+    "skip-if-up-to-date",
+    llvm::cl::desc(
+        "Skip the run if the dependency file of a previous run\n"
+        "shows that the output files are newer than all files\n"
+        "their input files depend on."
+    ),
+    llvm::cl::cat(GeneralOptions),
+    llvm::cl::init(false)
+);
+
+static llvm::cl::opt<unsigned int> Jobs(
+    "j",
+    llvm::cl::desc(
+        "Process up to <N> input files in parallel. If <N> is 0,\n"
+        "the number of available hardware threads is used. A\n"
+        "single large input file is generated in <N> chunks."
+    ),
+    llvm::cl::value_desc("N"),
+    llvm::cl::cat(GeneralOptions),
+    llvm::cl::init(1)
+);
+
+static llvm::cl::opt<unsigned int> MaxMemory(
+    "max-memory",
+    llvm::cl::desc(
+        "Limit the memory used by parallel jobs to about <MB>\n"
+        "megabytes. The footprint of an input file is predicted\n"
+        "from previous runs. Implies \"-j 0\" unless \"-j\" is given."
+    ),
+    llvm::cl::value_desc("MB"),
+    llvm::cl::cat(GeneralOptions),
+    llvm::cl::init(0)
+);
+
+static llvm::cl::opt<bool> FlagWatch(
+    "watch",
+    llvm::cl::desc(
+        "Keep running and regenerate the output whenever one of\n"
+        "the input files or one of their included files changes."
+    ),
+    llvm::cl::cat(GeneralOptions),
+    llvm::cl::init(false)
+);
+
+static llvm::cl::opt<bool> FlagModules(
+    "use-modules",
+    llvm::cl::desc(
+        "Enable implicit clang modules. Headers which provide a\n"
+        "module map are imported as prebuilt modules instead of\n"
+        "being parsed textually again."
+    ),
+    llvm::cl::cat(GeneralOptions),
+    llvm::cl::init(false)
+);
+
+static llvm::cl::opt<std::string> ModuleCachePath(
+    "module-cache-path",
+    llvm::cl::desc(
+        "Specifies the directory which holds the prebuilt modules.\n"
+        "Defaults to a directory in the user's cache directory."
+    ),
+    llvm::cl::value_desc("directory"),
+    llvm::cl::cat(GeneralOptions)
+);
+
+static llvm::cl::opt<std::string> StatCacheFile(
+    "stat-cache",
+    llvm::cl::desc(
+        "Remember failed file lookups in <file> and use them to\n"
+        "speed up the header search of later runs. A lookup is\n"
+        "repeated once its directory was modified."
+    ),
+    llvm::cl::value_desc("file"),
+    llvm::cl::cat(GeneralOptions)
+);
+
+static llvm::cl::opt<bool> FlagDeclCache(
+    "decl-cache",
+    llvm::cl::desc(
+        "Remember the generated definition of every declaration\n"
+        "and reuse it in later runs if the declaration's signature\n"
+        "did not change. Macros used by a definition are not\n"
+        "tracked."
+    ),
+    llvm::cl::cat(GeneralOptions),
+    llvm::cl::init(false)
+);
+
+static llvm::cl::opt<bool> FlagChangedOnly(
+    "changed-only",
+    llvm::cl::desc(
+        "Only generate definitions for declarations which are new\n"
+        "or changed since the last run. Implies \"-decl-cache\"."
+    ),
+    llvm::cl::cat(GeneralOptions),
+    llvm::cl::init(false)
+);
+
+static llvm::cl::opt<bool> FlagIRCache(
+    "ir-cache",
+    llvm::cl::desc(
+        "Keep the parsed functions of every input file and reuse\n"
+        "them while none of the file's dependencies changed.\n"
+        "Changing the generator options needs no parse then.\n"
+        "Changes to the compile commands are not detected."
+    ),
+    llvm::cl::cat(GeneralOptions),
+    llvm::cl::init(false)
+);
+
+static llvm::cl::opt<bool> FlagPrefilter(
+    "prefilter",
+    llvm::cl::desc(
+        "Skip input files which cannot declare any of the\n"
+        "\"-fcontains\" targets. The files are only lexed, not\n"
+        "parsed, and files using macros are never skipped."
+    ),
+    llvm::cl::cat(GeneralOptions),
+    llvm::cl::ValueOptional,
+    llvm::cl::init(true)
+);
+
+static llvm::cl::opt<bool> FlagFastC(
+    "fast-c",
+    llvm::cl::desc(
+        "Parse C input files without includes and without a\n"
+        "compile command. Unknown types are treated as opaque.\n"
+        "Declarations hidden behind macros may be missed."
+    ),
+    llvm::cl::cat(GeneralOptions),
+    llvm::cl::init(false)
+);
+
+static llvm::cl::opt<std::string> FilesFrom(
+    "files-from",
+    llvm::cl::desc(
+        "Read the input files from <file>, one per line, or from\n"
+        "stdin if <file> is \"-\". Files are processed while the\n"
+        "list is still being read."
     ),
     llvm::cl::value_desc("file"),
     llvm::cl::cat(GeneralOptions)
 );
 
+static llvm::cl::opt<bool> FlagPrintStats(
+    "print-stats",
+    llvm::cl::desc(
+        "Print statistics about the run to stderr."
+    ),
+    llvm::cl::cat(GeneralOptions),
+    llvm::cl::init(false)
+);
+
 static llvm::cl::list<std::string> InputFiles(
     llvm::cl::desc("[<file> ...]"),
     llvm::cl::Positional,
@@ -150,75 +445,1493 @@ static llvm::cl::list<std::string> InputFiles(
     "This is free software: you are free to change and redistribute it.\n"     \
     "There is NO WARRANTY, to the extent permitted by law.\n"
 
-int main(int argc, const char *argv[])
+static util::stats::Counter NumModulesBuilt(
+    "modules-built", "Number of implicit modules built during the run");
+static util::stats::Counter NumASTFilesLoaded(
+    "ast-files-loaded", "Number of serialized ASTs used as input");
+static util::stats::Counter ASTLoadTimeUs(
+    "ast-time-us", "Time spent loading ASTs and generating (microseconds)");
+static util::stats::Counter NumIRFilesLoaded(
+    "ir-files-loaded", "Number of input files generated from their IR");
+static util::stats::Counter NumProjectOutputsReused(
+    "project-outputs-reused", "Number of outputs taken from the project index");
+
+static bool
+getCachePath(llvm::StringRef Name, std::string &Path, std::string &ErrMsg)
 {
-    FGenCompilationDatabase FGenDb;
+    /* Everything fgen caches lives in "<cache directory>/fgen" */
+    llvm::SmallString<256> Buffer;
+
+    if (!llvm::sys::path::cache_directory(Buffer)) {
+        ErrMsg = "unable to determine the user's cache directory";
+        return false;
+    }
+
+    llvm::sys::path::append(Buffer, "fgen");
+
+    auto Error = llvm::sys::fs::create_directories(Buffer);
+    if (Error) {
+        ErrMsg = Error.message();
+        return false;
+    }
+
+    llvm::sys::path::append(Buffer, Name);
+
+    Path = Buffer.str().str();
+
+    return true;
+}
+
+static bool createDirectory(const std::string &Path, std::string &ErrMsg)
+{
+    auto Error = llvm::sys::fs::create_directories(Path);
+    if (Error) {
+        ErrMsg = Error.message();
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+getCacheDirectory(llvm::StringRef Name, std::string &Path, std::string &ErrMsg)
+{
+    return getCachePath(Name, Path, ErrMsg) && createDirectory(Path, ErrMsg);
+}
+
+static bool getModuleCachePath(std::string &Path, std::string &ErrMsg)
+{
+    if (ModuleCachePath.empty())
+        return getCacheDirectory("modules", Path, ErrMsg);
+
+    Path = ModuleCachePath;
+
+    return createDirectory(Path, ErrMsg);
+}
+
+static unsigned int countModules(llvm::StringRef Directory)
+{
+    std::error_code Error;
+    unsigned int Count = 0;
+
+    llvm::sys::fs::recursive_directory_iterator It(Directory, Error), End;
+
+    while (!Error && It != End) {
+        if (llvm::sys::path::extension(It->path()) == ".pcm")
+            ++Count;
+
+        It.increment(Error);
+    }
+
+    return Count;
+}
+
+static clang::tooling::ArgumentsAdjuster
+getArgumentsAdjuster(const std::string &ModuleCache)
+{
+    std::vector<std::string> Args;
+
+    if (!ModuleCache.empty()) {
+        Args.push_back("-fmodules");
+        Args.push_back("-fimplicit-module-maps");
+        Args.push_back("-fmodules-cache-path=" + ModuleCache);
+    }
+
+    auto Pos = clang::tooling::ArgumentInsertPosition::END;
+
+    return clang::tooling::getInsertArgumentAdjuster(Args, Pos);
+}
+
+static std::string getDatabaseKey()
+{
+    /* Without "-p" the database is looked up from the current directory */
+    llvm::SmallString<256> Database(DatabasePath);
+    llvm::sys::fs::make_absolute(Database);
+    llvm::sys::path::remove_dots(Database, true);
+
+    return llvm::utohexstr(llvm::xxHash64(Database));
+}
+
+static bool getIndexPath(std::string &Path, std::string &ErrMsg)
+{
+    if (!IndexFile.empty()) {
+        Path = IndexFile;
+        return true;
+    }
+
+    std::string Directory;
+
+    if (!getCacheDirectory("index", Directory, ErrMsg))
+        return false;
+
+    /* Every compilation database gets an index of its own */
+    llvm::SmallString<256> Buffer(Directory);
+    llvm::sys::path::append(Buffer, getDatabaseKey() + ".index");
+
+    Path = Buffer.str().str();
+
+    return true;
+}
+
+static bool getHistoryPath(std::string &Path, std::string &ErrMsg)
+{
+    std::string Directory;
+
+    if (!getCacheDirectory("histories", Directory, ErrMsg))
+        return false;
+
+    /* The same file may take a different time in another project */
+    llvm::SmallString<256> Buffer(Directory);
+    llvm::sys::path::append(Buffer, getDatabaseKey() + ".history");
+
+    Path = Buffer.str().str();
+
+    return true;
+}
+
+static void saveHistory(const FGenRunner &Runner, const std::string &Path)
+{
+    auto History = Runner.history();
     std::string ErrMsg;
 
-    llvm::cl::HideUnrelatedOptions({&GeneralOptions, &GeneratorOptions});
+    if (!History || Path.empty())
+        return;
 
-    const auto print_version = [](llvm::raw_ostream &OS) {
-        OS << "fgen [v" << FGEN_VERSION_INFO << "] - " << FGEN_HOMEPAGE_URL
-           << "\n"
-           << FGEN_LICENSE_INFO << "\n";
-    };
+    if (!History->save(Path, ErrMsg)) {
+        util::cl::warning() << "fgen: failed to save history \"" << Path
+                            << "\" - " << ErrMsg << "\n";
+    }
+}
 
-    llvm::cl::SetVersionPrinter(print_version);
+static bool parsePosition(llvm::StringRef Value,
+                          FGenConfiguration::Location &Location)
+{
+    llvm::StringRef Line, Column;
+    std::tie(Line, Column) = Value.split(':');
 
-    llvm::cl::ParseCommandLineOptions(argc, argv);
+    if (Line.getAsInteger(10, Location.Line))
+        return false;
+
+    if (Column.getAsInteger(10, Location.Column))
+        return false;
+
+    /* Lines and columns start at 1 */
+    return Location.Line && Location.Column;
+}
+
+static bool parseLocation(llvm::StringRef Value,
+                          std::string &File,
+                          FGenConfiguration::Location &Location)
+{
+    /* The file name itself may contain colons */
+    auto Index = Value.rfind(':');
+    if (Index == llvm::StringRef::npos || !Index)
+        return false;
+
+    Index = Value.rfind(':', Index);
+    if (Index == llvm::StringRef::npos || !Index)
+        return false;
+
+    File = Value.take_front(Index).str();
+
+    return parsePosition(Value.drop_front(Index + 1), Location);
+}
+
+static bool parseRange(llvm::StringRef Value,
+                       std::string &File,
+                       FGenConfiguration::Location &Begin,
+                       FGenConfiguration::Location &End)
+{
+    llvm::StringRef Head, Tail;
+    std::tie(Head, Tail) = Value.rsplit('-');
+
+    if (!parseLocation(Head, File, Begin) || !parsePosition(Tail, End))
+        return false;
+
+    if (End.Line != Begin.Line)
+        return End.Line > Begin.Line;
+
+    return End.Column >= Begin.Column;
+}
+
+static bool parseOutput(llvm::StringRef Value,
+                        FGenConfiguration &Configuration,
+                        std::string &ErrMsg)
+{
+    /* The file name itself may contain colons */
+    auto Index = Value.rfind(':');
+    if (Index == llvm::StringRef::npos || !Index) {
+        ErrMsg = "expected \"<file>:<flags>\"";
+        return false;
+    }
+
+    llvm::SmallVector<llvm::StringRef, 8> Flags;
+    Value.drop_front(Index + 1).split(Flags, ',', -1, false);
 
     /*
-     * Seems like 'ParseCommandLineOptions' has to be called before
-     * running this. Otherwise 'PrintHelpMessage' will cause a
-     * segmentation fault.
+     * Only the listed implementations are generated. The style of
+     * the output follows the main configuration unless overridden.
      */
-    if (argc <= 1) {
-        /* Show no hidden options, show categorized options */
-        llvm::cl::PrintHelpMessage(false, true);
-        std::exit(EXIT_FAILURE);
-    }
+    Configuration.setImplementAccessors(false);
+    Configuration.setImplemenConversions(false);
+    Configuration.setImplementStubs(false);
 
-    auto &Files = InputFiles;
-    if (Files.empty()) {
-        util::cl::error() << "fgen: no source files specified - done.\n";
-        std::exit(EXIT_FAILURE);
-    }
+    for (auto Flag : Flags) {
+        bool Enable = !Flag.consume_front("no-");
 
-    if (!DatabasePath.empty()) {
-        bool Ok = FGenDb.autoDetect(DatabasePath, ErrMsg);
-        if (!Ok) {
-            util::cl::error() << "fgen: failed to load compilation database \"" 
-                              << DatabasePath << "\" - " << ErrMsg << "\n";
-            std::exit(EXIT_FAILURE);
-        }
-    } else {
-        /* Use user provided source file for auto detection */
-        bool Ok = FGenDb.autoDetect(Files[0], ErrMsg);
-        if (!Ok) {
-            util::cl::error() << "fgen: failed to find and load a compilation "
-                              << "database - " << ErrMsg << "\n";
-            std::exit(EXIT_FAILURE);
+        if (!Configuration.setGeneratorOption(Flag, Enable)) {
+            ErrMsg = "unknown flag \"" + Flag.str() + "\"";
+            return false;
         }
     }
 
-    auto Factory = FGenActionFactory();
-    auto &Configuration = Factory.configuration();
+    Configuration.setOutputFile(Value.take_front(Index).str());
 
-    auto Begin = std::make_move_iterator(TargetVec.begin());
-    auto End = std::make_move_iterator(TargetVec.end());
+    return true;
+}
 
-    Configuration.setAllowMove(FlagAllowMove);
-    Configuration.setTrimOutput(FlagTrimOutput);
-    Configuration.setImplementAccessors(FlagAccessors);
-    Configuration.setImplemenConversions(FlagConversions);
-    Configuration.setImplementStubs(FlagStubs);
-    Configuration.setNamespaceDefinitions(FlagNamespaces);
-    Configuration.setOutputFile(std::move(OutputFile));
+static void printStatistics()
+{
+    util::stats::print(llvm::errs());
 
-    auto &Targets = Configuration.targets();
+    /*
+     * Every loaded module which did not have to be built first
+     * was served from the module cache.
+     */
+    auto Loaded = static_cast<double>(util::stats::get("modules-loaded"));
+    auto Built = static_cast<double>(NumModulesBuilt.value());
+
+    if (Loaded > 0.0) {
+        auto HitRate = 100.0 * std::max(Loaded - Built, 0.0) / Loaded;
+
+        llvm::errs() << llvm::format("%11.1f%%", HitRate)
+                     << "  module-cache-hit-rate\n";
+    }
+}
+
+static void writeFile(const std::string &Path, llvm::StringRef Content)
+{
+    std::string ErrMsg;
+    bool Ok;
+
+    /*
+     * The output file may be opened by an editor or a build tool at
+     * any time. Replace it atomically so they never see a partially
+     * written file.
+     */
+    if (FlagWriteIfChanged)
+        Ok = util::file::writeIfChanged(Path, Content, ErrMsg);
+    else
+        Ok = util::file::writeAtomic(Path, Content, ErrMsg);
+
+    if (!Ok) {
+        util::cl::error() << "fgen: failed to write file \"" << Path
+                          << "\":\n"
+                          << "    " << ErrMsg << "\n";
+    }
+}
+
+static void writeOutput(const FGenOutputCache &OutputCache,
+                        llvm::ArrayRef<std::string> Files,
+                        const std::string &OutputFile)
+{
+    if (util::path::isTemplate(OutputFile)) {
+        for (const auto &File : Files) {
+            auto Path = util::path::expandTemplate(OutputFile, File);
+
+            writeFile(Path, OutputCache.output(File));
+        }
+
+        return;
+    }
+
+    if (OutputFile.empty()) {
+        OutputCache.dump(Files, llvm::outs());
+        llvm::outs().flush();
+        return;
+    }
+
+    std::string Output;
+    llvm::raw_string_ostream OS(Output);
+
+    OutputCache.dump(Files, OS);
+    OS.flush();
+
+    writeFile(OutputFile, Output);
+}
+
+static bool hasOutputFiles(const FGenActionFactory &Factory)
+{
+    if (!Factory.configuration().outputFile().empty())
+        return true;
+
+    for (const auto &Output : Factory.outputs()) {
+        if (!Output.Configuration->outputFile().empty())
+            return true;
+    }
+
+    return false;
+}
+
+static std::string getAbsoluteOutputFile(const std::string &OutputFile)
+{
+    /*
+     * The tool runs in the directory of each compile command, but
+     * relative output files refer to the directory fgen was started in.
+     * A template starting with "%{dir}" expands to an absolute path, as
+     * it is expanded with the absolute path of the input file.
+     */
+    if (OutputFile.empty() || llvm::StringRef(OutputFile).startswith("%{dir}"))
+        return OutputFile;
+
+    llvm::SmallString<256> Path(OutputFile);
+    llvm::sys::fs::make_absolute(Path);
+
+    return Path.str().str();
+}
+
+static bool checkOutputFile(llvm::StringRef Template,
+                            const std::string &File,
+                            std::map<std::string, std::string> &OutputFiles)
+{
+    llvm::SmallString<256> Path(File);
+    llvm::sys::fs::make_absolute(Path);
+
+    auto Output = util::path::expandTemplate(Template, Path);
+
+    auto Result = OutputFiles.emplace(std::move(Output), File);
+    if (!Result.second) {
+        util::cl::error() << "fgen: input files \"" << Result.first->second
+                          << "\" and \"" << File
+                          << "\" both map to output file \""
+                          << Result.first->first << "\"\n";
+        return false;
+    }
+
+    return true;
+}
+
+static bool checkOutputFiles(llvm::StringRef Template,
+                             llvm::ArrayRef<std::string> Files)
+{
+    std::map<std::string, std::string> OutputFiles;
+
+    /*
+     * Output files are written independently of each other, so two
+     * input files must never map to the same output file.
+     */
+    for (const auto &File : Files) {
+        if (!checkOutputFile(Template, File, OutputFiles))
+            return false;
+    }
+
+    return true;
+}
+
+static void appendOutput(const FGenOutputCache &OutputCache,
+                         llvm::ArrayRef<std::string> Inputs,
+                         const std::string &OutputFile)
+{
+    std::vector<std::string> Files;
+    Files.reserve(Inputs.size());
+
+    for (const auto &File : Inputs)
+        Files.push_back(util::file::getRealPath(File));
+
+    if (OutputFile.empty()) {
+        OutputCache.dump(Files, llvm::outs());
+        return;
+    }
+
+    if (FlagWriteIfChanged) {
+        writeOutput(OutputCache, Files, OutputFile);
+        return;
+    }
+
+    std::error_code Error;
+
+    llvm::raw_fd_ostream OS(OutputFile, Error, llvm::sys::fs::F_Append);
+    if (Error) {
+        util::cl::error() << "fgen: failed to open file \"" << OutputFile
+                          << "\" for writing:\n"
+                          << "    " << Error.message() << "\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    OutputCache.dump(Files, OS);
+}
+
+static std::vector<std::string>
+getTargets(llvm::ArrayRef<std::string> OutputFiles, const std::string &File)
+{
+    llvm::SmallString<256> Path(File);
+    llvm::sys::fs::make_absolute(Path);
+
+    std::vector<std::string> Targets;
+
+    /* Targets are named as on the command line, just like "-o" of cc */
+    for (const auto &OutputFile : OutputFiles) {
+        if (OutputFile.empty())
+            continue;
+
+        if (util::path::isTemplate(OutputFile))
+            Targets.push_back(util::path::expandTemplate(OutputFile, Path));
+        else
+            Targets.push_back(OutputFile);
+    }
+
+    return Targets;
+}
+
+static int runASTFiles(FGenActionFactory &Factory,
+                       llvm::ArrayRef<std::string> Files)
+{
+    auto PCHContainerOps = std::make_shared<clang::PCHContainerOperations>();
+    int Result = EXIT_SUCCESS;
+
+    for (const auto &File : Files) {
+        auto Start = std::chrono::steady_clock::now();
+
+        auto Diagnostics = clang::CompilerInstance::createDiagnostics(
+            new clang::DiagnosticOptions());
+
+        /*
+         * Declarations are deserialized lazily, so only the parts of
+         * the AST which are visited by the generator are ever read.
+         * Neither a preprocessor nor semantic analysis is required.
+         */
+        auto Unit = clang::ASTUnit::LoadFromASTFile(
+            File,
+            PCHContainerOps->getRawReader(),
+            clang::ASTUnit::LoadASTOnly,
+            Diagnostics,
+            clang::FileSystemOptions());
+
+        if (!Unit) {
+            util::cl::error() << "fgen: failed to load serialized AST \""
+                              << File << "\"\n";
+            Result = EXIT_FAILURE;
+            continue;
+        }
+
+        auto Consumer = Factory.createASTConsumer(File);
+        Consumer->HandleTranslationUnit(Unit->getASTContext());
+
+        if (Consumer->failed())
+            Result = EXIT_FAILURE;
+
+        /* The serialized AST already contains all included headers */
+        if (auto DepFile = Factory.depFile()) {
+            auto Path = util::file::getRealPath(File);
+            DepFile->insert(Path, {Path});
+        }
+
+        auto Duration = std::chrono::steady_clock::now() - Start;
+        auto Us = std::chrono::duration_cast<std::chrono::microseconds>(
+            Duration);
+
+        ++NumASTFilesLoaded;
+        ASTLoadTimeUs += Us.count();
+
+        if (auto History = Factory.history())
+            History->setDuration(util::file::getRealPath(File), Us.count());
+    }
+
+    return Result;
+}
+
+static int runIRFiles(FGenActionFactory &Factory,
+                      std::vector<std::string> &Files)
+{
+    auto &Configuration = Factory.configuration();
+    auto &Directory = Configuration.irDirectory();
+
+    std::vector<std::string> Remaining;
+    int Result = EXIT_SUCCESS;
+
+    /*
+     * Input files whose dependencies are unchanged since their IR was
+     * captured are generated from it. Only the other files are left to
+     * be parsed.
+     */
+    for (auto &File : Files) {
+        auto Path = util::file::getRealPath(File);
+        FGenIR IR;
+        std::string ErrMsg;
+
+        if (!IR.load(FGenIR::getPath(Directory, Path, Configuration), ErrMsg)) {
+            util::cl::warning() << "fgen: failed to load IR of \"" << File
+                                << "\" - " << ErrMsg << "\n";
+        }
+
+        if (!IR.isUpToDate()) {
+            Remaining.push_back(std::move(File));
+            continue;
+        }
+
+        auto Consumer = Factory.createASTConsumer(File);
+        Consumer->HandleIR(IR);
+
+        if (Consumer->failed())
+            Result = EXIT_FAILURE;
+
+        if (auto DepFile = Factory.depFile())
+            DepFile->insert(Path, IR.dependencies());
+
+        ++NumIRFilesLoaded;
+    }
+
+    Files = std::move(Remaining);
+
+    return Result;
+}
+
+static int runFileList(FGenFileList &FileList,
+                       FGenRunner &Runner,
+                       FGenActionFactory &Factory)
+{
+    auto &Targets = Factory.configuration().targets();
+    auto Prefilter = FGenPrefilter(Targets);
+    bool Filter = FlagPrefilter && !Targets.empty();
+
+    std::vector<std::string> Templates;
+
+    if (util::path::isTemplate(Factory.configuration().outputFile()))
+        Templates.push_back(Factory.configuration().outputFile());
+
+    for (const auto &Output : Factory.outputs()) {
+        auto &File = Output.Configuration->outputFile();
+
+        if (util::path::isTemplate(File))
+            Templates.push_back(File);
+    }
+
+    std::vector<std::map<std::string, std::string>> OutputFiles(
+        Templates.size());
+    std::vector<std::string> ASTFiles;
+    bool Failed = false;
+
+    /*
+     * The runner asks for one file at a time, even with parallel jobs.
+     * Every file gets the checks which are otherwise applied to the
+     * complete list of input files before the run.
+     */
+    const auto NextFile = [&](std::string &File) {
+        while (!Failed && FileList.next(File)) {
+            for (size_t i = 0; i < Templates.size(); ++i) {
+                if (!checkOutputFile(Templates[i], File, OutputFiles[i])) {
+                    Failed = true;
+                    return false;
+                }
+            }
+
+            if (util::path::isASTFile(File)) {
+                ASTFiles.push_back(File);
+                continue;
+            }
+
+            if (Filter && !Prefilter.mayMatch(File))
+                continue;
+
+            return true;
+        }
+
+        return false;
+    };
+
+    int Result;
+
+    if (FlagFastC)
+        Result = FGenFastCRunner(Factory, Runner.jobs()).run(NextFile);
+    else
+        Result = Runner.run(NextFile);
+
+    if (!ASTFiles.empty()) {
+        auto Ret = runASTFiles(Factory, ASTFiles);
+        if (Ret)
+            Result = Ret;
+    }
+
+    return (Failed) ? EXIT_FAILURE : Result;
+}
+
+static int runWatchMode(FGenRunner &Runner,
+                        llvm::ArrayRef<std::string> Inputs,
+                        FGenActionFactory &Factory,
+                        llvm::StringRef ModuleCache,
+                        const std::string &HistoryPath)
+{
+    FGenWatcher Watcher;
+    std::string ErrMsg;
+
+    if (!Watcher.init(ErrMsg)) {
+        util::cl::error() << "fgen: failed to initialize file watcher - "
+                          << ErrMsg << "\n";
+        return EXIT_FAILURE;
+    }
+
+    /*
+     * The compilation database and the configuration stay alive for
+     * the whole session. Only the files affected by a change are parsed
+     * again, the output of all other files is taken from the cache.
+     */
+    auto OutputCache = std::make_shared<FGenOutputCache>();
+    Factory.setOutputCache(OutputCache);
+
+    std::vector<std::string> Files;
+    Files.reserve(Inputs.size());
+
+    for (const auto &File : Inputs)
+        Files.push_back(util::file::getRealPath(File));
+
+    const auto &OutputFile = Factory.configuration().outputFile();
+
+    std::vector<std::string> Pending(Files);
+    std::set<std::string> Changed;
+
+    while (true) {
+        /*
+         * A new tool (and thereby a new file manager and stat cache)
+         * is used for every iteration. Otherwise the stale contents of
+         * the changed files would be served again.
+         */
+        auto ModulesBefore = (FlagModules) ? countModules(ModuleCache) : 0;
+
+        Runner.run(Pending);
+
+        /* The session ends with a signal, record every iteration */
+        saveHistory(Runner, HistoryPath);
+
+        if (FlagModules)
+            NumModulesBuilt += countModules(ModuleCache) - ModulesBefore;
+
+        /* The statistics of every iteration are reported on their own */
+        if (FlagPrintStats)
+            printStatistics();
+
+        util::stats::reset();
+
+        for (const auto &File : Pending) {
+            auto Dependencies = OutputCache->dependencies(File);
+
+            if (!Watcher.watch(File, Dependencies, ErrMsg)) {
+                util::cl::error() << "fgen: " << ErrMsg << "\n";
+                return EXIT_FAILURE;
+            }
+        }
+
+        if (util::path::isTemplate(OutputFile))
+            writeOutput(*OutputCache, Pending, OutputFile);
+        else
+            writeOutput(*OutputCache, Files, OutputFile);
+
+        if (!Watcher.wait(Changed, ErrMsg)) {
+            util::cl::error() << "fgen: failed to wait for file changes - "
+                              << ErrMsg << "\n";
+            return EXIT_FAILURE;
+        }
+
+        /* Keep the order of the input files for the next iteration */
+        Pending.clear();
+
+        for (const auto &File : Files) {
+            if (Changed.count(File))
+                Pending.push_back(File);
+        }
+    }
+}
+
+static int runPatchMode(FGenRunner &Runner,
+                        llvm::ArrayRef<std::string> Inputs,
+                        FGenActionFactory &Factory)
+{
+    auto &Configuration = Factory.configuration();
+
+    if (!Configuration.outputFile().empty() || FlagWatch) {
+        util::cl::error() << "fgen: option \"-patch\" cannot be combined "
+                          << "with \"-o\" or \"-watch\"\n";
+        return EXIT_FAILURE;
+    }
+
+    auto &Headers = Configuration.patchHeaders();
+
+    for (const auto &File : Inputs)
+        Headers.push_back(util::file::getRealPath(File));
+
+    Configuration.setPatchFile(PatchFile);
+
+    /*
+     * The input files are not parsed on their own. Parsing the patched
+     * file once yields their declarations as well as all definitions
+     * which already exist.
+     */
+    auto Result = Runner.run(Configuration.patchFile());
+
+    if (FlagPrintStats)
+        printStatistics();
+
+    return Result;
+}
+
+static std::string getProjectRoot(llvm::ArrayRef<std::string> Files)
+{
+    if (Files.empty())
+        return {};
+
+    const auto Contains = [](llvm::StringRef Directory, llvm::StringRef File) {
+        auto Rest = File.drop_front(Directory.size());
+
+        return File.startswith(Directory) &&
+               (Directory.endswith("/") || Rest.startswith("/"));
+    };
+
+    /* The deepest directory containing all translation units */
+    auto Root = llvm::sys::path::parent_path(Files[0]);
+
+    for (const auto &File : Files) {
+        while (!Root.empty() && !Contains(Root, File))
+            Root = llvm::sys::path::parent_path(Root);
+    }
+
+    return (Root.endswith("/")) ? Root.str() : Root.str() + "/";
+}
+
+static uint64_t getGeneratorHash(const FGenActionFactory &Factory)
+{
+    auto Key = Factory.configuration().generatorKey();
+
+    for (const auto &Output : Factory.outputs()) {
+        Key += '\0';
+        Key += Output.Configuration->generatorKey();
+    }
+
+    return llvm::xxHash64(Key);
+}
+
+static int runProjectMode(const clang::tooling::CompilationDatabase &Database,
+                          FGenRunner &Runner,
+                          FGenActionFactory &Factory,
+                          const std::string &ModuleCache,
+                          llvm::IntrusiveRefCntPtr<FGenStatCache> StatCache,
+                          std::vector<std::string> &Sources)
+{
+    std::string IndexPath;
+    std::string ErrMsg;
+
+    if (!getIndexPath(IndexPath, ErrMsg)) {
+        util::cl::error() << "fgen: failed to set up project index - "
+                          << ErrMsg << "\n";
+        return EXIT_FAILURE;
+    }
+
+    auto Index = std::make_shared<FGenIndex>();
+
+    if (!Index->load(IndexPath, ErrMsg)) {
+        util::cl::warning() << "fgen: failed to load project index \""
+                            << IndexPath << "\" - " << ErrMsg << "\n";
+    }
+
+    auto Files = Database.getAllFiles();
+
+    std::vector<std::string> Keys;
+    Keys.reserve(Files.size());
+
+    for (const auto &File : Files)
+        Keys.push_back(util::file::getRealPath(File));
+
+    Index->retain(Keys);
+
+    /*
+     * Only translation units whose compile command or included files
+     * changed since they were indexed the last time are parsed again.
+     */
+    std::vector<std::string> Stale;
+    std::vector<bool> IsStale(Files.size());
+
+    for (size_t i = 0; i < Files.size(); ++i) {
+        auto Hash = FGenIndex::getCommandHash(Database, Files[i]);
+
+        IsStale[i] = !Index->isUpToDate(Keys[i], Hash);
+        if (IsStale[i])
+            Stale.push_back(Files[i]);
+    }
+
+    /* Functions declared outside of the project are defined elsewhere */
+    auto IndexFactory = FGenIndexActionFactory(Database, Index,
+                                               getProjectRoot(Keys));
+    auto IndexRunner = FGenRunner(Database, IndexFactory);
+
+    IndexRunner.setArgumentsAdjuster(getArgumentsAdjuster(ModuleCache));
+    IndexRunner.setStatCache(StatCache);
+    IndexRunner.setJobs(Runner.jobs());
+    IndexRunner.setMaxMemory(Runner.maxMemory());
+    IndexRunner.setHistory(Runner.history());
+
+    auto Result = IndexRunner.run(Stale);
+
+    /*
+     * Each translation unit which declares at least one unresolved
+     * function generates the functions assigned to it. The index keeps
+     * the output of the last run, so only translation units which
+     * changed or got other functions assigned are parsed again.
+     */
+    auto Unresolved = Index->unresolved();
+    auto GeneratorHash = getGeneratorHash(Factory);
+    auto &ProjectUSRs = Factory.configuration().projectUSRs();
+
+    std::vector<std::shared_ptr<FGenOutputCache>> Caches = {
+        Factory.outputCache()
+    };
+
+    for (const auto &Output : Factory.outputs())
+        Caches.push_back(Output.OutputCache);
+
+    std::vector<std::string> Parse;
+    std::vector<size_t> Parsed;
+
+    for (size_t i = 0; i < Files.size(); ++i) {
+        auto It = Unresolved.find(Keys[i]);
+        if (It == Unresolved.end())
+            continue;
+
+        Sources.push_back(Files[i]);
+
+        std::vector<std::string> Outputs;
+
+        if (!IsStale[i] &&
+            Index->outputs(Keys[i], GeneratorHash, It->second, Outputs) &&
+            Outputs.size() == Caches.size()) {
+            for (size_t j = 0; j < Caches.size(); ++j) {
+                if (Caches[j])
+                    Caches[j]->insert(Keys[i], std::move(Outputs[j]), {});
+            }
+
+            ++NumProjectOutputsReused;
+            continue;
+        }
+
+        auto &USRs = ProjectUSRs[Keys[i]];
+
+        for (const auto &USR : It->second)
+            USRs.insert(USR);
+
+        Parse.push_back(Files[i]);
+        Parsed.push_back(i);
+    }
+
+    auto Ret = Runner.run(Parse);
+
+    /* Outputs of failed runs may be incomplete and are not kept */
+    if (!Ret) {
+        for (auto i : Parsed) {
+            std::vector<std::string> Outputs;
+
+            for (const auto &Cache : Caches)
+                Outputs.push_back((Cache) ? Cache->output(Keys[i]) : "");
+
+            Index->setOutputs(Keys[i], GeneratorHash,
+                              std::move(Unresolved[Keys[i]]),
+                              std::move(Outputs));
+        }
+    }
+
+    if (!Index->save(IndexPath, ErrMsg)) {
+        util::cl::warning() << "fgen: failed to save project index \""
+                            << IndexPath << "\" - " << ErrMsg << "\n";
+    }
+
+    return (Result) ? Result : Ret;
+}
+
+int main(int argc, const char *argv[])
+{
+    FGenCompilationDatabase FGenDb;
+    std::string ErrMsg;
+
+    llvm::cl::HideUnrelatedOptions({&GeneralOptions, &GeneratorOptions});
+
+    const auto print_version = [](llvm::raw_ostream &OS) {
+        OS << "fgen [v" << FGEN_VERSION_INFO << "] - " << FGEN_HOMEPAGE_URL
+           << "\n"
+           << FGEN_LICENSE_INFO << "\n";
+    };
+
+    llvm::cl::SetVersionPrinter(print_version);
+
+    llvm::cl::ParseCommandLineOptions(argc, argv);
+
+    /*
+     * Seems like 'ParseCommandLineOptions' has to be called before
+     * running this. Otherwise 'PrintHelpMessage' will cause a
+     * segmentation fault.
+     */
+    if (argc <= 1) {
+        /* Show no hidden options, show categorized options */
+        llvm::cl::PrintHelpMessage(false, true);
+        std::exit(EXIT_FAILURE);
+    }
+
+    auto &Files = InputFiles;
+
+    /*
+     * A location or range restricts the generated functions to the
+     * declarations found there, e.g. the one under an editor's cursor.
+     */
+    std::string RangeFile;
+    FGenConfiguration::Location RangeBegin, RangeEnd;
+
+    if (!CursorLocation.empty() || !CursorRange.empty()) {
+        bool Ok;
+
+        if (!CursorLocation.empty() && !CursorRange.empty()) {
+            util::cl::error() << "fgen: options \"-at\" and \"-range\" "
+                              << "are mutually exclusive\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        if (FlagProject || !PatchFile.empty()) {
+            util::cl::error() << "fgen: options \"-at\" and \"-range\" "
+                              << "cannot be combined with \"-project\" or "
+                              << "\"-patch\"\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        if (!CursorLocation.empty()) {
+            Ok = parseLocation(CursorLocation, RangeFile, RangeBegin);
+            RangeEnd = RangeBegin;
+        } else {
+            Ok = parseRange(CursorRange, RangeFile, RangeBegin, RangeEnd);
+        }
+
+        if (!Ok) {
+            auto &Value = (CursorLocation.empty()) ? CursorRange
+                                                   : CursorLocation;
+
+            util::cl::error() << "fgen: invalid location \"" << Value
+                              << "\"\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        if (Files.empty() && FilesFrom.empty())
+            Files.push_back(RangeFile);
+
+        RangeFile = util::file::getRealPath(RangeFile);
+    }
+
+    /*
+     * The files of the list are checked one by one while they are
+     * processed. Skipping up to date files requires all of them at once.
+     */
+    FGenFileList FileList;
+    std::string FirstFile;
+    bool Stream = !FilesFrom.empty();
+
+    if (Stream) {
+        if (!Files.empty() || FlagProject || FlagWatch || !PatchFile.empty()) {
+            util::cl::error() << "fgen: option \"-files-from\" cannot be "
+                              << "combined with input files, \"-project\", "
+                              << "\"-watch\" or \"-patch\"\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        if (!FileList.open(FilesFrom, ErrMsg)) {
+            util::cl::error() << "fgen: failed to read file list \""
+                              << FilesFrom << "\" - " << ErrMsg << "\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        if (!FileList.peek(FirstFile)) {
+            util::cl::error() << "fgen: no source files specified - done.\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        if (FlagSkipUpToDate) {
+            for (const auto &File : FileList.files())
+                Files.push_back(File);
+
+            Stream = false;
+        }
+    }
+
+    if (FlagProject) {
+        if (!Files.empty() || FlagWatch || !PatchFile.empty()) {
+            util::cl::error() << "fgen: option \"-project\" cannot be "
+                              << "combined with input files, \"-watch\" "
+                              << "or \"-patch\"\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        /* Look for the compilation database in the current directory */
+        if (DatabasePath.empty())
+            DatabasePath = ".";
+    } else if (Files.empty() && !Stream) {
+        util::cl::error() << "fgen: no source files specified - done.\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    /*
+     * Serialized ASTs are read directly. Neither a compile command nor
+     * a parse is needed to generate their functions.
+     */
+    std::vector<std::string> SourceFiles;
+    std::vector<std::string> ASTFiles;
+
+    for (const auto &File : Files) {
+        if (util::path::isASTFile(File))
+            ASTFiles.push_back(File);
+        else
+            SourceFiles.push_back(File);
+    }
+
+    if (FlagFastC && (FlagProject || FlagWatch || !PatchFile.empty())) {
+        util::cl::error() << "fgen: option \"-fast-c\" cannot be combined "
+                          << "with \"-project\", \"-watch\" or \"-patch\"\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (!Outputs.empty() && (FlagWatch || !PatchFile.empty())) {
+        util::cl::error() << "fgen: option \"-emit\" cannot be combined "
+                          << "with \"-watch\" or \"-patch\"\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (!ASTFiles.empty() && (FlagWatch || !PatchFile.empty())) {
+        util::cl::error() << "fgen: serialized ASTs cannot be combined with "
+                          << "\"-watch\" or \"-patch\"\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (FlagMD && DepFileName.empty()) {
+        if (OutputFile.empty() || util::path::isTemplate(OutputFile)) {
+            util::cl::error() << "fgen: option \"-MD\" requires a single "
+                              << "output file or \"-MF\"\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        DepFileName = OutputFile + ".d";
+    }
+
+    if (!DepFileName.empty()) {
+        if (FlagWatch || !PatchFile.empty()) {
+            util::cl::error() << "fgen: dependency files cannot be combined "
+                              << "with \"-watch\" or \"-patch\"\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        if (OutputFile.empty() && Outputs.empty()) {
+            util::cl::error() << "fgen: dependency files require an output "
+                              << "file\n";
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    if (FlagSkipUpToDate && (DepFileName.empty() || FlagProject)) {
+        util::cl::error() << "fgen: option \"-skip-if-up-to-date\" requires "
+                          << "a dependency file and cannot be combined with "
+                          << "\"-project\"\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (!DatabasePath.empty()) {
+        bool Ok = FGenDb.autoDetect(DatabasePath, ErrMsg);
+        if (!Ok) {
+            util::cl::error() << "fgen: failed to load compilation database \"" 
+                              << DatabasePath << "\" - " << ErrMsg << "\n";
+            std::exit(EXIT_FAILURE);
+        }
+    } else if (((!SourceFiles.empty() || Stream) && !FlagFastC) ||
+               !PatchFile.empty()) {
+        /* Use user provided source file for auto detection */
+        auto &Source = (Stream) ? FirstFile : SourceFiles[0];
+        auto &File = (PatchFile.empty()) ? Source : PatchFile.getValue();
+
+        bool Ok = FGenDb.autoDetect(File, ErrMsg);
+        if (!Ok) {
+            util::cl::error() << "fgen: failed to find and load a compilation "
+                              << "database - " << ErrMsg << "\n";
+            std::exit(EXIT_FAILURE);
+        }
+    } else {
+        FGenDb.setEmpty();
+    }
+
+    auto Factory = FGenActionFactory();
+    auto &Configuration = Factory.configuration();
+
+    auto Begin = std::make_move_iterator(TargetVec.begin());
+    auto End = std::make_move_iterator(TargetVec.end());
+
+    Configuration.setAllowMove(FlagAllowMove);
+    Configuration.setTrimOutput(FlagTrimOutput);
+    Configuration.setImplementAccessors(FlagAccessors);
+    Configuration.setImplemenConversions(FlagConversions);
+    Configuration.setImplementStubs(FlagStubs);
+    Configuration.setNamespaceDefinitions(FlagNamespaces);
+    Configuration.setWriteIfChanged(FlagWriteIfChanged);
+    Configuration.setPairedHeaders(false);
+    Configuration.setOutputFile(getAbsoluteOutputFile(OutputFile));
+
+    /* Output files as given on the command line, for dependency files */
+    std::vector<std::string> TargetFiles = {OutputFile};
+
+    if (!RangeFile.empty())
+        Configuration.setRange(std::move(RangeFile), RangeBegin, RangeEnd);
+
+    if (FlagDeclCache || FlagChangedOnly) {
+        std::string DeclCache;
+
+        if (!getCacheDirectory("decls", DeclCache, ErrMsg)) {
+            util::cl::error() << "fgen: failed to set up declaration cache - "
+                              << ErrMsg << "\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        Configuration.setDeclCacheDirectory(std::move(DeclCache));
+        Configuration.setChangedOnly(FlagChangedOnly);
+    }
+
+    /*
+     * Input files parsed without their includes yield an incomplete IR.
+     * With "-changed-only" the output depends on the previous run, which
+     * the IR knows nothing about.
+     */
+    if (FlagIRCache && !FlagFastC && !FlagChangedOnly) {
+        std::string IRCache;
+
+        if (!getCacheDirectory("ir", IRCache, ErrMsg)) {
+            util::cl::error() << "fgen: failed to set up IR cache - "
+                              << ErrMsg << "\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        Configuration.setIRDirectory(std::move(IRCache));
+    }
+
+    auto &Targets = Configuration.targets();
     Targets.insert(Targets.end(), Begin, End);
 
-    clang::tooling::ClangTool Tool(FGenDb.get(), Files);
+    std::vector<std::shared_ptr<FGenConfiguration>> OutputConfigurations;
+
+    for (const auto &Value : Outputs) {
+        auto Output = std::make_shared<FGenConfiguration>(Configuration);
+
+        if (!parseOutput(Value, *Output, ErrMsg)) {
+            util::cl::error() << "fgen: invalid output \"" << Value
+                              << "\" - " << ErrMsg << "\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        TargetFiles.push_back(Output->outputFile());
+        Output->setOutputFile(getAbsoluteOutputFile(Output->outputFile()));
+
+        OutputConfigurations.push_back(std::move(Output));
+    }
+
+    std::string ModuleCache;
+
+    if (FlagModules && !getModuleCachePath(ModuleCache, ErrMsg)) {
+        util::cl::error() << "fgen: failed to set up module cache - "
+                          << ErrMsg << "\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    auto Runner = FGenRunner(FGenDb.get(), Factory);
+
+    Runner.setArgumentsAdjuster(getArgumentsAdjuster(ModuleCache));
+    Runner.setJobs(Jobs);
+
+    if (MaxMemory) {
+        if (!Jobs.getNumOccurrences())
+            Runner.setJobs(0);
+
+        Runner.setMaxMemory(static_cast<uint64_t>(MaxMemory) << 20);
+    }
+
+    /*
+     * Parallel runs are scheduled with the run times and memory
+     * footprints recorded during previous runs. Every run refines
+     * these predictions.
+     */
+    std::string HistoryPath;
+    std::shared_ptr<FGenHistory> History;
+
+    if (Runner.jobs() != 1) {
+        History = std::make_shared<FGenHistory>();
+
+        if (!getHistoryPath(HistoryPath, ErrMsg)) {
+            util::cl::warning() << "fgen: failed to locate history - "
+                                << ErrMsg << "\n";
+        } else if (!History->load(HistoryPath, ErrMsg)) {
+            util::cl::warning() << "fgen: failed to load history \""
+                                << HistoryPath << "\" - " << ErrMsg << "\n";
+        }
+
+        Runner.setHistory(History);
+        Factory.setHistory(History);
+    }
+
+    if (!PatchFile.empty()) {
+        auto Result = runPatchMode(Runner, Files, Factory);
+
+        saveHistory(Runner, HistoryPath);
+
+        return Result;
+    }
+
+    if (FlagWatch)
+        return runWatchMode(Runner, Files, Factory, ModuleCache, HistoryPath);
+
+    auto &OutputFile = Configuration.outputFile();
+
+    bool IsTemplate = util::path::isTemplate(OutputFile);
+
+    if (IsTemplate && FlagProject) {
+        util::cl::error() << "fgen: option \"-project\" requires a single "
+                          << "output file\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (IsTemplate && !checkOutputFiles(OutputFile, Files))
+        std::exit(EXIT_FAILURE);
+
+    /*
+     * Files which are processed in parallel must not write to the same
+     * stream. Collect their output and write it in the order of the
+     * input files once all of them are done. The same is necessary if
+     * the output file may only be replaced as a whole.
+     */
+    std::shared_ptr<FGenOutputCache> OutputCache;
+
+    bool Parallel = Runner.jobs() != 1 && (Files.size() > 1 || Stream);
+    bool Replace = FlagWriteIfChanged && !OutputFile.empty();
+    bool Mixed = !SourceFiles.empty() && !ASTFiles.empty();
+
+    /* Serialized ASTs of a streamed list are processed after the list */
+    if (Stream)
+        Mixed = true;
+
+    /* Files generated from their IR are processed before the others */
+    if (!Configuration.irDirectory().empty() && Files.size() > 1)
+        Mixed = true;
+
+    if ((Parallel || Replace || FlagProject || Mixed) && !IsTemplate) {
+        OutputCache = std::make_shared<FGenOutputCache>();
+        Factory.setOutputCache(OutputCache);
+    }
+
+    /*
+     * A single input file leaves all but one job idle. Let them share
+     * the generation of its functions instead.
+     */
+    if (!Parallel && !FlagProject)
+        Configuration.setGeneratorJobs(Runner.jobs());
+
+    /* Additional outputs are written just like the main output */
+    for (auto &Output : OutputConfigurations) {
+        auto &File = Output->outputFile();
+        bool IsOutputTemplate = util::path::isTemplate(File);
+        std::shared_ptr<FGenOutputCache> Cache;
+
+        if (IsOutputTemplate && FlagProject) {
+            util::cl::error() << "fgen: option \"-project\" requires a "
+                              << "single output file for \"-emit\"\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        if (IsOutputTemplate && !checkOutputFiles(File, Files))
+            std::exit(EXIT_FAILURE);
+
+        bool Cached = Parallel || FlagWriteIfChanged || FlagProject || Mixed;
+
+        if (Cached && !IsOutputTemplate)
+            Cache = std::make_shared<FGenOutputCache>();
+
+        Factory.addOutput(Output, std::move(Cache));
+    }
+
+    std::shared_ptr<FGenDepFile> DepFile;
+
+    if (!DepFileName.empty()) {
+        DepFile = std::make_shared<FGenDepFile>();
+
+        if (!DepFile->load(DepFileName, ErrMsg)) {
+            util::cl::warning() << "fgen: failed to load dependency file \""
+                                << DepFileName << "\" - " << ErrMsg << "\n";
+        }
+
+        Factory.setDepFile(DepFile);
+    }
+
+    /*
+     * Input files whose outputs are newer than everything they depended
+     * on during the previous run would produce the very same outputs.
+     * If an output file is shared by all input files, it is only up to
+     * date if all of them are.
+     */
+    if (FlagSkipUpToDate) {
+        const auto IsUpToDate = [&TargetFiles,
+                                 &DepFile](const std::string &File) {
+            for (const auto &Target : getTargets(TargetFiles, File)) {
+                if (!DepFile->isUpToDate(Target, FlagWriteIfChanged))
+                    return false;
+            }
+
+            return true;
+        };
+
+        bool PerInput = OutputFile.empty() || IsTemplate;
+
+        for (const auto &Output : Factory.outputs()) {
+            auto &File = Output.Configuration->outputFile();
+            PerInput &= util::path::isTemplate(File);
+        }
+
+        if (PerInput) {
+            auto End = std::remove_if(SourceFiles.begin(), SourceFiles.end(),
+                                      IsUpToDate);
+            SourceFiles.erase(End, SourceFiles.end());
+
+            End = std::remove_if(ASTFiles.begin(), ASTFiles.end(), IsUpToDate);
+            ASTFiles.erase(End, ASTFiles.end());
+        } else if (std::all_of(Files.begin(), Files.end(), IsUpToDate)) {
+            SourceFiles.clear();
+            ASTFiles.clear();
+        }
+
+        if (SourceFiles.empty() && ASTFiles.empty()) {
+            if (FlagPrintStats)
+                printStatistics();
+
+            return EXIT_SUCCESS;
+        }
+    }
+
+    auto StatCache = llvm::makeIntrusiveRefCnt<FGenStatCache>(
+        llvm::vfs::getRealFileSystem());
+
+    if (!StatCacheFile.empty() && !StatCache->load(StatCacheFile, ErrMsg)) {
+        util::cl::warning() << "fgen: failed to load stat cache \""
+                            << StatCacheFile << "\" - " << ErrMsg << "\n";
+    }
+
+    Runner.setStatCache(StatCache);
+
+    /*
+     * Output files of single translation units are written by a
+     * separate thread while the next translation unit is parsed.
+     * Output to stdout is written right away.
+     */
+    std::shared_ptr<FGenWriter> Writer;
+
+    if (hasOutputFiles(Factory)) {
+        Writer = std::make_shared<FGenWriter>();
+        Factory.setWriter(Writer);
+    }
+
+    auto ModulesBefore = (FlagModules) ? countModules(ModuleCache) : 0;
+
+    llvm::ArrayRef<std::string> Inputs = Files;
+    std::vector<std::string> Sources;
+    int Result;
+
+    if (FlagProject) {
+        Result = runProjectMode(FGenDb.get(), Runner, Factory, ModuleCache,
+                                StatCache, Sources);
+        Inputs = Sources;
+    } else if (Stream) {
+        Result = runFileList(FileList, Runner, Factory);
+        Inputs = FileList.files();
+    } else {
+        /*
+         * Most files of a large tree declare none of the targets. Sort
+         * them out before paying for a full parse.
+         */
+        if (FlagPrefilter && !Targets.empty()) {
+            auto Prefilter = FGenPrefilter(Targets);
+
+            const auto Skip = [&Prefilter](const std::string &File) {
+                return !Prefilter.mayMatch(File);
+            };
+
+            auto End = std::remove_if(SourceFiles.begin(), SourceFiles.end(),
+                                      Skip);
+            SourceFiles.erase(End, SourceFiles.end());
+        }
+
+        int IRResult = EXIT_SUCCESS;
+
+        if (!Configuration.irDirectory().empty())
+            IRResult = runIRFiles(Factory, SourceFiles);
+
+        if (SourceFiles.empty())
+            Result = 0;
+        else if (FlagFastC)
+            Result = FGenFastCRunner(Factory, Runner.jobs()).run(SourceFiles);
+        else
+            Result = Runner.run(SourceFiles);
+
+        if (IRResult)
+            Result = IRResult;
+
+        if (!ASTFiles.empty()) {
+            auto Ret = runASTFiles(Factory, ASTFiles);
+            if (Ret)
+                Result = Ret;
+        }
+    }
+
+    std::vector<std::string> WriteErrors;
+
+    if (Writer && !Writer->wait(WriteErrors)) {
+        for (const auto &Error : WriteErrors)
+            util::cl::error() << "fgen: " << Error << "\n";
+
+        Result = EXIT_FAILURE;
+    }
+
+    if (OutputCache)
+        appendOutput(*OutputCache, Inputs, OutputFile);
+
+    for (const auto &Output : Factory.outputs()) {
+        if (Output.OutputCache) {
+            appendOutput(*Output.OutputCache, Inputs,
+                         Output.Configuration->outputFile());
+        }
+    }
+
+    /*
+     * Outputs of a failed run may be incomplete. Drop the dependency
+     * file, so the next run does not consider them up to date.
+     */
+    if (DepFile && Result != EXIT_SUCCESS) {
+        llvm::sys::fs::remove(DepFileName);
+    } else if (DepFile) {
+        for (const auto &File : Inputs) {
+            auto Path = util::file::getRealPath(File);
+
+            for (const auto &Target : getTargets(TargetFiles, File))
+                DepFile->addRule(Target, Path);
+        }
+
+        if (!DepFile->save(DepFileName, ErrMsg)) {
+            util::cl::error() << "fgen: failed to write dependency file \""
+                              << DepFileName << "\" - " << ErrMsg << "\n";
+            Result = EXIT_FAILURE;
+        }
+    }
+
+    if (!StatCacheFile.empty() && !StatCache->save(StatCacheFile, ErrMsg)) {
+        util::cl::warning() << "fgen: failed to save stat cache \""
+                            << StatCacheFile << "\" - " << ErrMsg << "\n";
+    }
+
+    saveHistory(Runner, HistoryPath);
+
+    if (FlagModules)
+        NumModulesBuilt += countModules(ModuleCache) - ModulesBefore;
+
+    if (FlagPrintStats)
+        printStatistics();
 
-    return Tool.run(&Factory);
+    return Result;
 }
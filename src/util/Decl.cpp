@@ -58,6 +58,14 @@ std::string generateUSR(const clang::Decl *Decl)
     return std::string(USRBuffer.begin(), USRBuffer.end());
 }
 
+bool generateUSR(const clang::Decl *Decl, llvm::SmallVectorImpl<char> &Buffer)
+{
+    Buffer.clear();
+
+    /* 'generateUSRForDecl()' returns true if it failed */
+    return !clang::index::generateUSRForDecl(Decl, Buffer);
+}
+
 void getFullContext(const clang::NamedDecl *Decl,
                     llvm::SmallVectorImpl<const clang::DeclContext *> &Vec)
 {
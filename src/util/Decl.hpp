@@ -33,6 +33,8 @@ llvm::StringRef getNameOrDefault(const clang::Decl *Decl,
 
 std::string generateUSR(const clang::Decl *Decl);
 
+bool generateUSR(const clang::Decl *Decl, llvm::SmallVectorImpl<char> &Buffer);
+
 void getFullContext(const clang::NamedDecl *Decl,
                     llvm::SmallVectorImpl<const clang::DeclContext *> &Vec);
 
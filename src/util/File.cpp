@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <util/File.hpp>
+#include <util/Statistics.hpp>
+
+namespace util {
+namespace file {
+
+static util::stats::Counter NumUnchangedFiles(
+    "outputs-unchanged", "Number of output files left untouched");
+
+bool writeAtomic(llvm::StringRef Path,
+                 llvm::StringRef Content,
+                 std::string &ErrMsg)
+{
+    llvm::SmallString<256> TmpPath;
+    int FD;
+
+    /*
+     * The temporary file is created right next to the destination.
+     * This guarantees that both files reside on the same file system
+     * and 'rename()' is able to atomically replace the destination.
+     */
+    auto Error = llvm::sys::fs::createUniqueFile(Path + ".fgen-%%%%%%", FD,
+                                                 TmpPath);
+    if (Error) {
+        ErrMsg = Error.message();
+        return false;
+    }
+
+    llvm::raw_fd_ostream OS(FD, true);
+
+    OS << Content;
+    OS.close();
+
+    if (OS.has_error()) {
+        ErrMsg = OS.error().message();
+        OS.clear_error();
+
+        llvm::sys::fs::remove(TmpPath);
+        return false;
+    }
+
+    Error = llvm::sys::fs::rename(TmpPath, Path);
+    if (Error) {
+        ErrMsg = Error.message();
+
+        llvm::sys::fs::remove(TmpPath);
+        return false;
+    }
+
+    return true;
+}
+
+bool writeIfChanged(llvm::StringRef Path,
+                    llvm::StringRef Content,
+                    std::string &ErrMsg)
+{
+    /*
+     * Build systems decide upon the modification time whether a file
+     * needs to be compiled again. Leave the file untouched if its
+     * content would not change. Large files get memory mapped by
+     * 'getFile()', so this comparison is cheap compared to a rebuild.
+     */
+    auto Buffer = llvm::MemoryBuffer::getFile(Path, -1, false);
+    if (Buffer && (*Buffer)->getBuffer() == Content) {
+        ++NumUnchangedFiles;
+        return true;
+    }
+
+    return writeAtomic(Path, Content, ErrMsg);
+}
+
+std::string getRealPath(llvm::StringRef Path)
+{
+    llvm::SmallString<256> Buffer;
+
+    if (llvm::sys::fs::real_path(Path, Buffer))
+        return Path.str();
+
+    return Buffer.str().str();
+}
+
+std::string getRealPath(const clang::FileManager &FileManager,
+                        llvm::StringRef Path)
+{
+    llvm::SmallString<256> Buffer(Path);
+    llvm::SmallString<256> RealPath;
+
+    /*
+     * Relative paths are relative to the directory of the compile
+     * command, which is only known to the file manager.
+     */
+    FileManager.makeAbsolutePath(Buffer);
+
+    if (llvm::sys::fs::real_path(Buffer, RealPath))
+        return Buffer.str().str();
+
+    return RealPath.str().str();
+}
+
+std::vector<std::string>
+getDependencies(const clang::SourceManager &SourceManager)
+{
+    auto &FileManager = SourceManager.getFileManager();
+
+    std::vector<std::string> Dependencies;
+
+    /*
+     * Every file which was read while parsing the translation unit
+     * has an entry in the source manager. Together these files form
+     * the include closure of the main file.
+     */
+    auto Begin = SourceManager.fileinfo_begin();
+    auto End = SourceManager.fileinfo_end();
+
+    for (auto It = Begin; It != End; ++It)
+        Dependencies.push_back(getRealPath(FileManager, It->first->getName()));
+
+    return Dependencies;
+}
+
+}
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FGEN_UTIL_FILE_HPP_
+#define FGEN_UTIL_FILE_HPP_
+
+#include <string>
+#include <vector>
+
+#include <clang/Basic/FileManager.h>
+#include <clang/Basic/SourceManager.h>
+#include <llvm/ADT/StringRef.h>
+
+namespace util {
+namespace file {
+
+bool writeAtomic(llvm::StringRef Path,
+                 llvm::StringRef Content,
+                 std::string &ErrMsg);
+
+bool writeIfChanged(llvm::StringRef Path,
+                    llvm::StringRef Content,
+                    std::string &ErrMsg);
+
+std::string getRealPath(llvm::StringRef Path);
+
+std::string getRealPath(const clang::FileManager &FileManager,
+                        llvm::StringRef Path);
+
+std::vector<std::string>
+getDependencies(const clang::SourceManager &SourceManager);
+
+}
+}
+
+#endif /* FGEN_UTIL_FILE_HPP_ */
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <util/Path.hpp>
+
+namespace util {
+namespace path {
+
+bool isTemplate(llvm::StringRef Path)
+{
+    return Path.contains("%{");
+}
+
+bool isASTFile(llvm::StringRef Path)
+{
+    /* Files written by "-emit-ast" and precompiled headers */
+    auto Extension = llvm::sys::path::extension(Path);
+
+    return Extension.equals_lower(".ast") || Extension.equals_lower(".pch");
+}
+
+bool isHeaderFile(llvm::StringRef Path)
+{
+    auto Extension = llvm::sys::path::extension(Path);
+
+    return Extension.equals_lower(".h") || Extension.equals_lower(".hh") ||
+           Extension.equals_lower(".hpp") || Extension.equals_lower(".hxx");
+}
+
+std::string expandTemplate(llvm::StringRef Template, llvm::StringRef File)
+{
+    /*
+     * Supported placeholders for the input file "src/file.hpp":
+     *
+     *      %{dir}      --->    "src"
+     *      %{name}     --->    "file.hpp"
+     *      %{stem}     --->    "file"
+     *      %{ext}      --->    "hpp"
+     *      %%          --->    "%"
+     *
+     * Unknown placeholders are copied to the result as they are.
+     */
+    std::string Result;
+    llvm::raw_string_ostream OS(Result);
+
+    while (!Template.empty()) {
+        auto Index = Template.find('%');
+
+        OS << Template.substr(0, Index);
+
+        if (Index == llvm::StringRef::npos)
+            break;
+
+        Template = Template.substr(Index);
+
+        if (Template.startswith("%%")) {
+            OS << '%';
+            Template = Template.substr(2);
+            continue;
+        }
+
+        auto End = Template.find('}');
+        if (!Template.startswith("%{") || End == llvm::StringRef::npos) {
+            OS << '%';
+            Template = Template.substr(1);
+            continue;
+        }
+
+        auto Key = Template.slice(2, End);
+
+        if (Key == "dir") {
+            auto Directory = llvm::sys::path::parent_path(File);
+            OS << (Directory.empty() ? llvm::StringRef(".") : Directory);
+        } else if (Key == "name") {
+            OS << llvm::sys::path::filename(File);
+        } else if (Key == "stem") {
+            OS << llvm::sys::path::stem(File);
+        } else if (Key == "ext") {
+            OS << llvm::sys::path::extension(File).ltrim('.');
+        } else {
+            OS << Template.substr(0, End + 1);
+        }
+
+        Template = Template.substr(End + 1);
+    }
+
+    return OS.str();
+}
+
+}
+}
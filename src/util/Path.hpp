@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FGEN_UTIL_PATH_HPP_
+#define FGEN_UTIL_PATH_HPP_
+
+#include <string>
+
+#include <llvm/ADT/StringRef.h>
+
+namespace util {
+namespace path {
+
+bool isTemplate(llvm::StringRef Path);
+bool isASTFile(llvm::StringRef Path);
+bool isHeaderFile(llvm::StringRef Path);
+
+std::string expandTemplate(llvm::StringRef Template, llvm::StringRef File);
+
+}
+}
+
+#endif /* FGEN_UTIL_PATH_HPP_ */
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+
+#include <llvm/Support/Format.h>
+
+#include <util/Statistics.hpp>
+
+namespace util {
+namespace stats {
+
+static std::vector<Counter *> &registry()
+{
+    /* Avoid the static initialization order fiasco */
+    static std::vector<Counter *> Counters;
+
+    return Counters;
+}
+
+Counter::Counter(const char *Name, const char *Description)
+    : Name_(Name), Description_(Description), Value_(0)
+{
+    registry().push_back(this);
+}
+
+Counter &Counter::operator++()
+{
+    Value_.fetch_add(1, std::memory_order_relaxed);
+
+    return *this;
+}
+
+Counter &Counter::operator+=(uint64_t Value)
+{
+    Value_.fetch_add(Value, std::memory_order_relaxed);
+
+    return *this;
+}
+
+void Counter::reset()
+{
+    Value_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Counter::value() const
+{
+    return Value_.load(std::memory_order_relaxed);
+}
+
+const char *Counter::name() const
+{
+    return Name_;
+}
+
+const char *Counter::description() const
+{
+    return Description_;
+}
+
+uint64_t get(llvm::StringRef Name)
+{
+    for (const auto Counter : registry()) {
+        if (Name == Counter->name())
+            return Counter->value();
+    }
+
+    return 0;
+}
+
+void print(llvm::raw_ostream &OS)
+{
+    OS << "fgen statistics:\n";
+
+    for (const auto Counter : registry()) {
+        OS << llvm::format("%12llu", (unsigned long long) Counter->value()) << "  "
+           << llvm::format("%-24s", Counter->name()) << " - "
+           << Counter->description() << "\n";
+    }
+}
+
+void reset()
+{
+    for (auto Counter : registry())
+        Counter->reset();
+}
+
+}
+}
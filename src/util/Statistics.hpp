@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FGEN_UTIL_STATISTICS_HPP_
+#define FGEN_UTIL_STATISTICS_HPP_
+
+#include <atomic>
+#include <cstdint>
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace util {
+namespace stats {
+
+/*
+ * Simple counter which registers itself on construction. All
+ * registered counters can be printed with 'print()'. Counters are
+ * meant to be defined as static objects and may be incremented from
+ * multiple threads.
+ */
+
+class Counter {
+public:
+    Counter(const char *Name, const char *Description);
+
+    Counter(const Counter &Other) = delete;
+    Counter &operator=(const Counter &Other) = delete;
+
+    Counter &operator++();
+    Counter &operator+=(uint64_t Value);
+
+    void reset();
+
+    uint64_t value() const;
+    const char *name() const;
+    const char *description() const;
+
+private:
+    const char *Name_;
+    const char *Description_;
+    std::atomic<uint64_t> Value_;
+};
+
+uint64_t get(llvm::StringRef Name);
+
+void print(llvm::raw_ostream &OS = llvm::errs());
+
+/* Sets all counters to zero, e.g. between the runs of a long session */
+void reset();
+
+}
+}
+
+#endif /* FGEN_UTIL_STATISTICS_HPP_ */
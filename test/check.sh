@@ -0,0 +1,670 @@
+#!/usr/bin/env bash
+
+#
+# Copyright (C) 2019  Steffen Nüssle
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+#
+# Runs fgen on the sample files in "test/check" and compares the
+# generated output with the expected output. Every check works on a
+# fresh copy of the samples and all caches are kept in a temporary
+# directory, so the user's cache is never touched.
+#
+# Usage: test/check.sh [<fgen binary>]
+#
+
+FGEN=$(realpath "${1:-build/fgen}")
+TESTS=$(realpath "$(dirname "$0")")
+SAMPLES="$TESTS/check"
+WORKDIR=$(mktemp -d)
+
+# Compiler used to create input files, e.g. serialized ASTs
+CXX=${CXX:-clang++}
+
+# The compiler plugin and the library are only checked if they were built
+PLUGIN="$(dirname "$FGEN")/libfgen.so"
+LIBRARY_CHECK="$(dirname "$FGEN")/check-libfgen"
+
+trap 'rm -rf "$WORKDIR"' EXIT
+
+export XDG_CACHE_HOME="$WORKDIR/cache"
+
+NUM_PASSED=0
+NUM_FAILED=0
+
+pass()
+{
+    printf "PASS: %s\n" "$1"
+    NUM_PASSED=$((NUM_PASSED + 1))
+}
+
+fail()
+{
+    printf "FAIL: %s\n" "$1"
+    NUM_FAILED=$((NUM_FAILED + 1))
+}
+
+skip()
+{
+    printf "SKIP: %s\n" "$1"
+}
+
+# Usage: expect <name> <expected file> <actual file>
+expect()
+{
+    if diff -u "$2" "$3"; then
+        pass "$1"
+    else
+        fail "$1"
+    fi
+}
+
+# Usage: expect_true <name> <command>...
+expect_true()
+{
+    local Name="$1"
+    shift
+
+    if "$@"; then
+        pass "$Name"
+    else
+        fail "$Name"
+    fi
+}
+
+# Prints the value of the counter <name> from the statistics in <file>
+counter()
+{
+    awk -v Name="$2" '$2 == Name { print $1 }' "$1"
+}
+
+# Copies the samples into an empty directory and changes into it
+setup()
+{
+    rm -rf "$WORKDIR/run" "$XDG_CACHE_HOME"
+    cp -r "$SAMPLES" "$WORKDIR/run"
+    cd "$WORKDIR/run" || exit 1
+}
+
+fgen()
+{
+    "$FGEN" "$@" 2> stderr.txt
+}
+
+check_stdout()
+{
+    setup
+
+    fgen shapes.hpp > out.cpp
+    expect "stdout" shapes.expected out.cpp
+}
+
+# Usage: wait_for <command>...
+# Runs <command> until it succeeds, but for ten seconds at most
+wait_for()
+{
+    local i
+
+    for i in $(seq 100); do
+        "$@" && return 0
+        sleep 0.1
+    done
+
+    return 1
+}
+
+check_watch()
+{
+    setup
+
+    sed "s/^int count()/long count()/" shapes.expected > long.expected
+
+    "$FGEN" -watch -print-stats -o out.cpp shapes.hpp 2> stderr.txt &
+    local Pid=$!
+
+    expect_true "watch: first run" wait_for cmp -s shapes.expected out.cpp
+
+    sed -i "s/^int count();/long count();/" shapes.hpp
+
+    expect_true "watch: output replaced after a change" \
+        wait_for cmp -s long.expected out.cpp
+
+    # Statistics are printed per run instead of adding up
+    expect_true "watch: statistics of the second run" \
+        [ "$(counter stderr.txt files-parsed | tail -n 1)" = 1 ]
+
+    kill "$Pid"
+    wait "$Pid" 2> /dev/null
+}
+
+check_stat_cache()
+{
+    setup
+
+    printf "\nint base() { return 0; }\n\n\n" > base.expected
+    printf "\nint base() { return 0; }\n\nint extra() { return 0; }\n\n\n" \
+        > extra.expected
+
+    local Cache="$WORKDIR/stat-cache.txt"
+    rm -f "$Cache"
+
+    fgen -stat-cache "$Cache" search.hpp > out.cpp
+    expect "stat-cache: first run" base.expected out.cpp
+
+    expect_true "stat-cache: file format" \
+        grep -q "^fgen-stat-cache 2$" "$Cache"
+
+    fgen -stat-cache "$Cache" -print-stats search.hpp > out.cpp
+    expect "stat-cache: cached run" base.expected out.cpp
+
+    expect_true "stat-cache: entries kept" \
+        [ "$(counter stderr.txt stat-cache-outdated)" = 0 ]
+
+    # The header found missing before must be found once it exists
+    touch extra.hpp
+
+    fgen -stat-cache "$Cache" -print-stats search.hpp > out.cpp
+    expect "stat-cache: created header" extra.expected out.cpp
+
+    expect_true "stat-cache: entries dropped" \
+        [ "$(counter stderr.txt stat-cache-outdated)" -gt 0 ]
+}
+
+check_output_files()
+{
+    setup
+
+    printf "\nint base() { return 0; }\n\n\n" > base.expected
+
+    fgen -o "serial/%{stem}.cpp" shapes.hpp search.hpp
+    expect "output files: first input" shapes.expected serial/shapes.cpp
+    expect "output files: second input" base.expected serial/search.cpp
+
+    fgen -j 2 -o "parallel/%{stem}.cpp" shapes.hpp search.hpp
+    expect "output files: first input in parallel" \
+        shapes.expected parallel/shapes.cpp
+    expect "output files: second input in parallel" \
+        base.expected parallel/search.cpp
+
+    # Relative output files refer to the directory fgen was started in
+    mkdir sub
+    cd sub || return
+
+    fgen -o "serial/%{stem}.cpp" ../shapes.hpp ../search.hpp
+    expect "output files: started in another directory" \
+        ../shapes.expected serial/shapes.cpp
+
+    fgen -j 2 -o "parallel/%{stem}.cpp" ../shapes.hpp ../search.hpp
+    expect "output files: started in another directory in parallel" \
+        ../shapes.expected parallel/shapes.cpp
+
+    fgen -o out.cpp ../shapes.hpp
+    expect "output files: single file in another directory" \
+        ../shapes.expected out.cpp
+
+    cd ..
+}
+
+check_write_if_changed()
+{
+    setup
+
+    local Time
+    Time=$(date -d "2000-01-01" +%s)
+
+    sed "s/^int count()/long count()/" shapes.expected > long.expected
+
+    fgen -write-if-changed -o out.cpp shapes.hpp
+    expect "write-if-changed: first run" shapes.expected out.cpp
+
+    touch -d "@$Time" out.cpp
+
+    fgen -write-if-changed -o out.cpp shapes.hpp
+    expect "write-if-changed: not appended" shapes.expected out.cpp
+
+    expect_true "write-if-changed: unchanged file kept" \
+        [ "$(stat -c %Y out.cpp)" = "$Time" ]
+
+    sed -i "s/^int count();/long count();/" shapes.hpp
+
+    fgen -write-if-changed -o out.cpp shapes.hpp
+    expect "write-if-changed: changed output" long.expected out.cpp
+
+    expect_true "write-if-changed: changed file replaced" \
+        [ "$(stat -c %Y out.cpp)" != "$Time" ]
+}
+
+check_patch()
+{
+    setup
+
+    fgen -patch shapes.cpp shapes.hpp
+    expect "patch: missing definitions inserted" shapes.cpp.expected shapes.cpp
+
+    fgen -patch shapes.cpp shapes.hpp
+    expect "patch: nothing inserted twice" shapes.cpp.expected shapes.cpp
+}
+
+check_ast_file()
+{
+    setup
+
+    "$CXX" -xc++ -std=c++14 -emit-ast -o shapes.ast shapes.hpp
+
+    fgen -print-stats shapes.ast > out.cpp
+    expect "ast file: output" shapes.expected out.cpp
+
+    expect_true "ast file: loaded instead of parsed" \
+        [ "$(counter stderr.txt ast-files-loaded)" = 1 ]
+}
+
+check_range()
+{
+    setup
+
+    fgen -at shapes.hpp:27:5 shapes.hpp > out.cpp
+    expect "at: function" at.expected out.cpp
+
+    fgen -at shapes.hpp:31:1 shapes.hpp > out.cpp
+    expect "at: record" record.expected out.cpp
+
+    fgen -range shapes.hpp:25:5-26:22 shapes.hpp > out.cpp
+    expect "range: functions" range.expected out.cpp
+}
+
+check_prefilter()
+{
+    setup
+
+    printf "\nnamespace geo {\n\nint count() { return 0; }\n\n\n}\n\n" \
+        > count.expected
+
+    fgen -fcontains geo::count -print-stats -o out.cpp search.hpp shapes.hpp
+    expect "prefilter: output" count.expected out.cpp
+
+    expect_true "prefilter: file without a target skipped" \
+        [ "$(counter stderr.txt parses-avoided)" = 1 ]
+
+    # The namespace of the target is only written in another file
+    printf "#define NS_BEGIN namespace geo {\n#define NS_END }\n" > ns.hpp
+    printf "#include \"ns.hpp\"\n\nNS_BEGIN int count(); NS_END\n" \
+        > macro.hpp
+
+    fgen -fcontains geo::count -print-stats -o macro.cpp macro.hpp
+    expect "prefilter: name from a macro" count.expected macro.cpp
+
+    expect_true "prefilter: file using a macro parsed" \
+        [ "$(counter stderr.txt parses-avoided)" = 0 ]
+}
+
+check_fast_c()
+{
+    setup
+
+    mkdir c
+    cp "$TESTS/c/accessors.c" c/
+    printf "%s\n" -xc -std=c11 > c/compile_flags.txt
+
+    fgen -o parsed.c c/accessors.c
+
+    fgen -fast-c -print-stats -o fast.c c/accessors.c
+    expect "fast-c: same output as a full parse" parsed.c fast.c
+
+    expect_true "fast-c: file parsed without includes" \
+        [ "$(counter stderr.txt fast-c-files)" = 1 ]
+
+    cp c/accessors.c c/copy.c
+    fgen -o parsed-copy.c c/copy.c
+
+    fgen -fast-c -j 2 -print-stats -o "%{stem}.fast.c" \
+        c/accessors.c c/copy.c missing.c
+    expect "fast-c: first file in parallel" parsed.c accessors.fast.c
+    expect "fast-c: second file in parallel" parsed-copy.c copy.fast.c
+
+    expect_true "fast-c: missing file not counted" \
+        [ "$(counter stderr.txt fast-c-files)" = 2 ]
+}
+
+check_emit()
+{
+    setup
+
+    fgen -emit stubs.cpp:stubs -o out.cpp shapes.hpp
+    expect "emit: main output" shapes.expected out.cpp
+    expect "emit: additional output" stubs.expected stubs.cpp
+}
+
+check_plugin()
+{
+    if [ ! -f "$PLUGIN" ]; then
+        skip "plugin: not built"
+        return
+    fi
+
+    setup
+
+    mkdir src
+    printf "#include \"../shapes.hpp\"\n" > src/shapes.cpp
+
+    "$CXX" -xc++ -std=c++14 -fsyntax-only -fplugin="$PLUGIN" \
+        -Xclang -plugin-arg-fgen -Xclang "o=%{dir}/%{stem}.gen.cpp" \
+        src/shapes.cpp
+    expect "plugin: header of the source file" \
+        shapes.expected src/shapes.gen.cpp
+
+    # The system header of the same name is no header of the source file
+    printf "int ticks();\n" > time.hpp
+    printf "#include <time.h>\n#include \"../time.hpp\"\n" > src/time.cpp
+    printf "\nint ticks() { return 0; }\n\n\n" > ticks.expected
+
+    "$CXX" -xc++ -std=c++14 -fsyntax-only -fplugin="$PLUGIN" \
+        -Xclang -plugin-arg-fgen -Xclang "o=%{dir}/%{stem}.gen.cpp" \
+        src/time.cpp
+    expect "plugin: system header not paired" ticks.expected src/time.gen.cpp
+
+    # A failed write must not end the compiler
+    touch blocked
+
+    local Status
+
+    "$CXX" -xc++ -std=c++14 -fsyntax-only -fplugin="$PLUGIN" \
+        -Xclang -plugin-arg-fgen -Xclang "o=blocked/%{stem}.cpp" \
+        src/shapes.cpp 2> stderr.txt
+    Status=$?
+
+    expect_true "plugin: failed write is an error" [ "$Status" -ne 0 ]
+    expect_true "plugin: compiler finished after a failed write" \
+        grep -q "1 error generated" stderr.txt
+}
+
+check_library()
+{
+    if [ ! -x "$LIBRARY_CHECK" ]; then
+        skip "library: not built"
+        return
+    fi
+
+    setup
+
+    "$LIBRARY_CHECK" shapes.hpp -xc++ -std=c++14 > out.cpp
+    expect "library: concurrent calls" shapes.expected out.cpp
+}
+
+check_depfile()
+{
+    setup
+
+    cat shapes.expected shapes.expected > twice.expected
+    touch -d "2000-01-01" shapes.hpp
+
+    fgen -MD -o out.cpp shapes.hpp
+    expect "depfile: output" shapes.expected out.cpp
+
+    expect_true "depfile: target" grep -q "^out.cpp:" out.cpp.d
+    expect_true "depfile: dependency" grep -q "/shapes.hpp" out.cpp.d
+
+    # The output is appended to unless the run is skipped
+    fgen -MD -skip-if-up-to-date -o out.cpp shapes.hpp
+    expect "depfile: up-to-date run skipped" shapes.expected out.cpp
+
+    touch shapes.hpp
+
+    fgen -MD -skip-if-up-to-date -o out.cpp shapes.hpp
+    expect "depfile: outdated run not skipped" twice.expected out.cpp
+
+    # An input changed after the output, but before the dependency file
+    cat twice.expected shapes.expected > thrice.expected
+    touch -d "2000-01-01" out.cpp
+    touch -d "2001-01-01" shapes.hpp
+
+    fgen -MD -skip-if-up-to-date -o out.cpp shapes.hpp
+    expect "depfile: output older than an input not skipped" \
+        thrice.expected out.cpp
+
+    # An output kept by "-write-if-changed" is as recent as the depfile
+    fgen -MD -write-if-changed -o kept.cpp shapes.hpp
+    touch -d "2000-01-01" kept.cpp
+
+    fgen -MD -write-if-changed -skip-if-up-to-date -print-stats \
+        -o kept.cpp shapes.hpp
+    expect_true "depfile: output kept by write-if-changed up to date" \
+        [ "$(counter stderr.txt outputs-up-to-date)" = 1 ]
+}
+
+# Writes a header with enough functions to be generated in chunks
+write_large_header()
+{
+    local n r m
+
+    for n in 0 1 2 3; do
+        printf "namespace n%d {\n\n" "$n"
+        printf "struct Value {\n    int v_;\n    unsigned flag_ : 1;\n};\n\n"
+
+        for r in $(seq 0 9); do
+            printf "class R%d {\npublic:\n" "$r"
+
+            for m in $(seq 0 59); do
+                printf "    int get%d() const;\n" "$m"
+                printf "    void set_v%d(Value v);\n" "$m"
+            done
+
+            printf "    R%d &operator=(const R%d &other);\n" "$r" "$r"
+            printf "private:\n    Value v_;\n    bool flag_ : 1;\n};\n\n"
+        done
+
+        for m in $(seq 0 49); do
+            printf "int value_v%d(const Value *value);\n" "$m"
+        done
+
+        printf "\n}\n\n"
+    done
+}
+
+check_chunks()
+{
+    setup
+
+    write_large_header > large.hpp
+
+    fgen -j 1 -o serial.cpp large.hpp
+
+    fgen -j 4 -print-stats -o chunks.cpp large.hpp
+    expect "chunks: same output as a single thread" serial.cpp chunks.cpp
+
+    expect_true "chunks: generated in chunks" \
+        [ "$(counter stderr.txt chunks-generated)" -gt 1 ]
+
+    # Chunks could not resume after functions skipped by the cache
+    fgen -j 4 -decl-cache -print-stats -o cached.cpp large.hpp
+    expect "chunks: same output with a decl cache" serial.cpp cached.cpp
+
+    expect_true "chunks: not used with a decl cache" \
+        [ "$(counter stderr.txt chunks-generated)" = 0 ]
+}
+
+check_history()
+{
+    setup
+
+    local Histories="$XDG_CACHE_HOME/fgen/histories"
+
+    fgen -j 2 -o out.cpp shapes.hpp search.hpp
+    expect_true "history: parallel run" \
+        grep -q "shapes.hpp" "$Histories"/*.history
+
+    mkdir other
+    (cd other && "$FGEN" -j 2 -o out.cpp ../search.hpp 2> /dev/null)
+    expect_true "history: one file per compilation database" \
+        [ "$(ls "$Histories" | wc -l)" = 2 ]
+
+    cp search.hpp watched.hpp
+
+    "$FGEN" -watch -j 2 -o watch.cpp watched.hpp 2> stderr.txt &
+    local Pid=$!
+
+    expect_true "history: watch mode" \
+        wait_for grep -q "watched.hpp" "$Histories"/*.history
+
+    kill "$Pid"
+    wait "$Pid" 2> /dev/null
+}
+
+check_files_from()
+{
+    setup
+
+    printf "\nint base() { return 0; }\n\n\n" > base.expected
+    printf "shapes.hpp\nsearch.hpp\n" > files.txt
+
+    fgen -files-from files.txt -o "%{stem}.out"
+    expect "files-from: first file" shapes.expected shapes.out
+    expect "files-from: second file" base.expected search.out
+
+    printf "search.hpp\n" | fgen -files-from - > out.cpp
+    expect "files-from: stdin" base.expected out.cpp
+
+    printf "shapes.hpp\n" | fgen -files-from - -o "%{stem}.cpp"
+    expect "files-from: stdin to output files" shapes.expected shapes.cpp
+
+    # Output files below a regular file cannot be written
+    touch blocked
+    fgen -files-from files.txt -o "blocked/%{stem}.out"
+    expect_true "files-from: failed writes fail the run" [ $? -ne 0 ]
+    expect_true "files-from: failed writes are reported" \
+        grep -q "blocked/search.out" stderr.txt
+}
+
+check_project()
+{
+    setup
+
+    # A library outside of the project, which is not a system library
+    mkdir -p "$WORKDIR/vendor"
+    printf "int vendor_init();\n" > "$WORKDIR/vendor/vendor.hpp"
+    printf "#include <vendor.hpp>\n" > vendor.cpp
+
+    local Command="$CXX -xc++ -std=c++14 -I$WORKDIR/vendor -c"
+
+    cat > compile_commands.json << EOF
+[
+    { "directory": "$PWD", "file": "shapes.cpp",
+      "command": "$Command shapes.cpp" },
+    { "directory": "$PWD", "file": "vendor.cpp",
+      "command": "$Command vendor.cpp" }
+]
+EOF
+
+    fgen -project -o first.cpp
+    expect_true "project: unresolved functions" grep -q "area()" first.cpp
+    expect_true "project: functions of other libraries" \
+        [ "$(grep -c vendor_init first.cpp)" = 0 ]
+
+    fgen -project -print-stats -o second.cpp
+    expect "project: unchanged project" first.cpp second.cpp
+    expect_true "project: output taken from the index" \
+        [ "$(counter stderr.txt project-outputs-reused)" = 1 ]
+}
+
+check_decl_cache()
+{
+    setup
+
+    printf "\nnamespace geo {\n\nlong count() { return 0; }\n\n\n}\n\n" \
+        > changed.expected
+
+    fgen -decl-cache -o first.cpp shapes.hpp
+    expect "decl-cache: first run" shapes.expected first.cpp
+
+    fgen -decl-cache -print-stats -o second.cpp shapes.hpp
+    expect "decl-cache: cached run" shapes.expected second.cpp
+
+    expect_true "decl-cache: definitions taken from the cache" \
+        [ "$(counter stderr.txt definitions-cached)" = 8 ]
+
+    fgen -decl-cache -ftrim -print-stats -o trimmed.cpp shapes.hpp
+    expect_true "decl-cache: other generator options use another cache" \
+        [ "$(counter stderr.txt definitions-cached)" = 0 ]
+
+    sed -i "s/^int count();/long count();/" shapes.hpp
+
+    fgen -changed-only -o changed.cpp shapes.hpp
+    expect "decl-cache: changed definitions only" changed.expected changed.cpp
+
+    # A C accessor depends on the fields of the record it reads
+    printf "struct Point {\n    int x;\n};\n\nint point_x(const Point *p);\n" \
+        > point.hpp
+    printf "\nint point_x(const Point *p) { return p->x; }\n\n\n" \
+        > accessor.expected
+    printf "\nint point_x(const Point *p) { return 0; }\n\n\n" > stub.expected
+
+    fgen -decl-cache -o accessor.cpp point.hpp
+    expect "decl-cache: accessor" accessor.expected accessor.cpp
+
+    sed -i "s/int x;/int y;/" point.hpp
+
+    fgen -decl-cache -o stub.cpp point.hpp
+    expect "decl-cache: accessor after a field changed" stub.expected stub.cpp
+}
+
+check_ir_cache()
+{
+    setup
+
+    write_large_header > large.hpp
+
+    fgen -ir-cache -o first.cpp shapes.hpp
+    expect "ir-cache: first run" shapes.expected first.cpp
+
+    fgen -ir-cache -print-stats -o second.cpp shapes.hpp
+    expect "ir-cache: run from the IR" shapes.expected second.cpp
+
+    expect_true "ir-cache: input file not parsed" \
+        [ "$(counter stderr.txt ir-files-loaded)" = 1 ]
+
+    # Other generator options must not need a parse either
+    fgen -fstubs=false -o parsed.cpp shapes.hpp
+    fgen -ir-cache -fstubs=false -print-stats -o loaded.cpp shapes.hpp
+    expect "ir-cache: changed options" parsed.cpp loaded.cpp
+
+    expect_true "ir-cache: changed options not parsed" \
+        [ "$(counter stderr.txt ir-files-loaded)" = 1 ]
+
+    fgen -o large-parsed.cpp large.hpp
+    fgen -ir-cache -j 4 -o large-first.cpp large.hpp
+    expect "ir-cache: large header in chunks" large-parsed.cpp large-first.cpp
+
+    fgen -ir-cache -print-stats -o large-loaded.cpp large.hpp
+    expect "ir-cache: large header" large-parsed.cpp large-loaded.cpp
+
+    expect_true "ir-cache: large header not parsed" \
+        [ "$(counter stderr.txt ir-files-loaded)" = 1 ]
+
+    touch shapes.hpp
+
+    fgen -ir-cache -print-stats -o third.cpp shapes.hpp
+    expect "ir-cache: modified input" shapes.expected third.cpp
+
+    expect_true "ir-cache: modified input parsed again" \
+        [ "$(counter stderr.txt ir-files-loaded)" = 0 ]
+}
+
+for Check in $(declare -F | awk '$3 ~ /^check_/ { print $3 }'); do
+    "$Check"
+done
+
+printf "\n%d passed, %d failed\n" "$NUM_PASSED" "$NUM_FAILED"
+
+[ "$NUM_FAILED" -eq 0 ]
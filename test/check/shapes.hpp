@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+namespace geo {
+
+class Shape {
+public:
+    Shape();
+    ~Shape();
+
+    int x() const;
+    void set_x(int x);
+    double area() const;
+    bool empty() const;
+    Shape &operator=(const Shape &other);
+
+private:
+    int x_;
+    int y_;
+};
+
+int count();
+
+}
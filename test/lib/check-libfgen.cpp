@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2019  Steffen Nüssle
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Uses "libfgen" the way a program holding its own ASTs would. Used by
+ * "test/check.sh" to check the library:
+ *
+ *      check-libfgen <file> [<compiler argument> ...]
+ *
+ * The file is parsed into two contexts. Each context is generated by two
+ * threads at the same time and all of them must return the same output,
+ * which is printed once.
+ */
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <clang/Frontend/ASTUnit.h>
+#include <clang/Tooling/Tooling.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <FGenConfiguration.hpp>
+#include <FGenLibrary.hpp>
+
+int main(int argc, const char *argv[])
+{
+    if (argc < 2) {
+        llvm::errs() << "usage: check-libfgen <file> [<argument> ...]\n";
+        return EXIT_FAILURE;
+    }
+
+    auto Buffer = llvm::MemoryBuffer::getFile(argv[1]);
+    if (!Buffer) {
+        llvm::errs() << "check-libfgen: failed to read \"" << argv[1]
+                     << "\" - " << Buffer.getError().message() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> Args(argv + 2, argv + argc);
+    std::vector<std::unique_ptr<clang::ASTUnit>> Units;
+
+    for (int i = 0; i < 2; ++i) {
+        auto Unit = clang::tooling::buildASTFromCodeWithArgs(
+            (*Buffer)->getBuffer(), Args, argv[1]);
+
+        if (!Unit) {
+            llvm::errs() << "check-libfgen: failed to parse \"" << argv[1]
+                         << "\"\n";
+            return EXIT_FAILURE;
+        }
+
+        Units.push_back(std::move(Unit));
+    }
+
+    const FGenConfiguration Configuration;
+
+    std::vector<std::string> Outputs(2 * Units.size());
+    std::vector<std::thread> Threads;
+
+    for (size_t i = 0; i < Outputs.size(); ++i) {
+        auto &Context = Units[i / 2]->getASTContext();
+        auto &Output = Outputs[i];
+
+        Threads.emplace_back([&Context, &Configuration, &Output]() {
+            Output = fgen::generate(Context, Configuration);
+        });
+    }
+
+    for (auto &Thread : Threads)
+        Thread.join();
+
+    for (const auto &Output : Outputs) {
+        if (Output != Outputs[0]) {
+            llvm::errs() << "check-libfgen: concurrent calls returned "
+                         << "different outputs\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    llvm::outs() << Outputs[0];
+
+    return EXIT_SUCCESS;
+}